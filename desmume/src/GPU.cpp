@@ -38,6 +38,11 @@
 #include "readwrite.h"
 #include "matrix.h"
 #include "emufile.h"
+#include "utils/jobpool.h"
+
+#ifdef ENABLE_SSE2
+#include <emmintrin.h>
+#endif
 
 #ifdef FASTBUILD
 	#undef FORCEINLINE
@@ -56,7 +61,8 @@ GPU::MosaicLookup GPU::mosaicLookup;
 //#define DEBUG_TRI
 
 CACHE_ALIGN u8 GPU_screen[4*256*192];
-CACHE_ALIGN u8 sprWin[256];
+CACHE_ALIGN u32 GPU_screen32[256*384];
+static GPU_OutputFormat gpu_outputFormat = GPU_OUTPUT_RGB555;
 
 
 u16			gpu_angle = 0;
@@ -209,6 +215,7 @@ void GPU_Reset(GPU *g, u8 l)
 	g->BGSize[0][1] = g->BGSize[1][1] = g->BGSize[2][1] = g->BGSize[3][1] = 256;
 
 	g->spriteRenderMode = GPU::SPRITE_1D;
+	g->sprBinsDirty = true;
 
 	g->bgPrio[4] = 0xFF;
 
@@ -312,6 +319,72 @@ FORCEINLINE u16 GPU::blend(u16 colA, u16 colB)
 	return _blend(colA, colB, blendTable);
 }
 
+#if defined(ENABLE_SSE2) && !defined(WORDS_BIGENDIAN)
+//the color math of the fade and blend tables, on eight 15bit colors at once.
+//every product fits in 16 bits, and the tables divide by 16 rounding down, which is a shift for these non negative values
+
+static FORCEINLINE __m128i GPU_Select(__m128i mask, __m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(mask,a),_mm_andnot_si128(mask,b));
+}
+
+static FORCEINLINE void GPU_SplitColors(__m128i c, __m128i &r, __m128i &g, __m128i &b)
+{
+	const __m128i mask5 = _mm_set1_epi16(0x1F);
+	r = _mm_and_si128(c,mask5);
+	g = _mm_and_si128(_mm_srli_epi16(c,5),mask5);
+	b = _mm_and_si128(_mm_srli_epi16(c,10),mask5);
+}
+
+static FORCEINLINE __m128i GPU_JoinColors(__m128i r, __m128i g, __m128i b)
+{
+	return _mm_or_si128(r,_mm_or_si128(_mm_slli_epi16(g,5),_mm_slli_epi16(b,10)));
+}
+
+//as fadeInColors[evy]
+static FORCEINLINE __m128i GPU_FadeIn(__m128i c, __m128i evy)
+{
+	const __m128i max5 = _mm_set1_epi16(31);
+	__m128i r,g,b;
+	GPU_SplitColors(c,r,g,b);
+	r = _mm_add_epi16(r,_mm_srli_epi16(_mm_mullo_epi16(_mm_sub_epi16(max5,r),evy),4));
+	g = _mm_add_epi16(g,_mm_srli_epi16(_mm_mullo_epi16(_mm_sub_epi16(max5,g),evy),4));
+	b = _mm_add_epi16(b,_mm_srli_epi16(_mm_mullo_epi16(_mm_sub_epi16(max5,b),evy),4));
+	return GPU_JoinColors(r,g,b);
+}
+
+//as fadeOutColors[evy]
+static FORCEINLINE __m128i GPU_FadeOut(__m128i c, __m128i evy)
+{
+	__m128i r,g,b;
+	GPU_SplitColors(c,r,g,b);
+	r = _mm_sub_epi16(r,_mm_srli_epi16(_mm_mullo_epi16(r,evy),4));
+	g = _mm_sub_epi16(g,_mm_srli_epi16(_mm_mullo_epi16(g,evy),4));
+	b = _mm_sub_epi16(b,_mm_srli_epi16(_mm_mullo_epi16(b,evy),4));
+	return GPU_JoinColors(r,g,b);
+}
+
+//as gpuBlendTable555[eva][evb]
+static FORCEINLINE __m128i GPU_Blend(__m128i a, __m128i b, __m128i eva, __m128i evb)
+{
+	const __m128i max5 = _mm_set1_epi16(31);
+	__m128i ra,ga,ba,rb,gb,bb;
+	GPU_SplitColors(a,ra,ga,ba);
+	GPU_SplitColors(b,rb,gb,bb);
+	ra = _mm_min_epi16(max5,_mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(ra,eva),_mm_mullo_epi16(rb,evb)),4));
+	ga = _mm_min_epi16(max5,_mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(ga,eva),_mm_mullo_epi16(gb,evb)),4));
+	ba = _mm_min_epi16(max5,_mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(ba,eva),_mm_mullo_epi16(bb,evb)),4));
+	return GPU_JoinColors(ra,ga,ba);
+}
+
+//eight bytes of a 0/0xFF mask, widened to 16bit lanes
+static FORCEINLINE __m128i GPU_LoadMask8(const u8 *mask)
+{
+	const __m128i m = _mm_loadl_epi64((const __m128i*)mask);
+	return _mm_unpacklo_epi8(m,m);
+}
+#endif
+
 
 void GPU_setMasterBrightness (GPU *gpu, u16 val)
 {
@@ -505,54 +578,68 @@ FORCEINLINE u8 GPU::withinRect(u16 x) const
 // setting some values twice
 FORCEINLINE void GPU::renderline_checkWindows(u16 x, bool &draw, bool &effect) const
 {
-	// Check if win0 if enabled, and only check if it is
-	// howevever, this has already been taken care of by the window precalculation
-	//if (WIN0_ENABLED)
+	assert(x<256);
+
+	//resolved for the whole line by setup_windowMasks
+	draw = winDraw[currBgNum][x] != 0;
+	effect = winEffect[currBgNum][x] != 0;
+}
+
+//resolves what the windows select for every layer and pixel of the line: win0 over win1 over the obj window over the outside.
+//the obj window comes from the sprites, so this has to wait until they have been rendered
+void GPU::setup_windowMasks()
+{
+	if(!(WIN0_ENABLED | WIN1_ENABLED | WINOBJ_ENABLED))
 	{
-		// it is in win0, do we display ?
-		// high priority	
-		if (withinRect<0>(x))
-		{
-			//INFO("bg%i passed win0 : (%i %i) was within (%i %i)(%i %i)\n", bgnum, x, gpu->currLine, gpu->WIN0H0, gpu->WIN0V0, gpu->WIN0H1, gpu->WIN0V1);
-			draw = (WININ0 >> currBgNum)&1;
-			effect = (WININ0_SPECIAL);
-			return;
-		}
+		memset(winDraw, 0xFF, sizeof(winDraw));
+		memset(winEffect, 0xFF, sizeof(winEffect));
+		return;
 	}
 
-	// Check if win1 if enabled, and only check if it is
-	//if (WIN1_ENABLED)
-	// howevever, this has already been taken care of by the window precalculation
+	const u8 *win0 = curr_win[0];
+	const u8 *win1 = curr_win[1];
+	const u8 *winObj = WINOBJ_ENABLED ? sprWin : win_empty;
+
+	for(int layer = 0; layer < 6; layer++)
 	{
-		// it is in win1, do we display ?
-		// mid priority
-		if(withinRect<1>(x))
+		//the backdrop has no enable bit, as it is always drawn
+		const u8 draw0 = ((WININ0 >> layer) & 1) ? 0xFF : 0, effect0 = WININ0_SPECIAL ? 0xFF : 0;
+		const u8 draw1 = ((WININ1 >> layer) & 1) ? 0xFF : 0, effect1 = WININ1_SPECIAL ? 0xFF : 0;
+		const u8 drawObj = ((WINOBJ >> layer) & 1) ? 0xFF : 0, effectObj = WINOBJ_SPECIAL ? 0xFF : 0;
+		const u8 drawOut = ((WINOUT >> layer) & 1) ? 0xFF : 0, effectOut = WINOUT_SPECIAL ? 0xFF : 0;
+
+		u8 *draw = winDraw[layer];
+		u8 *effect = winEffect[layer];
+		int x = 0;
+
+#if defined(ENABLE_SSE2) && !defined(WORDS_BIGENDIAN)
+		const __m128i zero = _mm_setzero_si128();
+		for(; x < 256; x += 16)
 		{
-			//INFO("bg%i passed win1 : (%i %i) was within (%i %i)(%i %i)\n", bgnum, x, gpu->currLine, gpu->WIN1H0, gpu->WIN1V0, gpu->WIN1H1, gpu->WIN1V1);
-			draw	= (WININ1 >> currBgNum)&1;
-			effect = (WININ1_SPECIAL);
-			return;
+			const __m128i out0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(win0+x)),zero);
+			const __m128i out1 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(win1+x)),zero);
+			const __m128i outObj = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(winObj+x)),zero);
+
+			__m128i d = GPU_Select(outObj, _mm_set1_epi8(drawOut), _mm_set1_epi8(drawObj));
+			d = GPU_Select(out1, d, _mm_set1_epi8(draw1));
+			d = GPU_Select(out0, d, _mm_set1_epi8(draw0));
+			_mm_storeu_si128((__m128i*)(draw+x), d);
+
+			__m128i e = GPU_Select(outObj, _mm_set1_epi8(effectOut), _mm_set1_epi8(effectObj));
+			e = GPU_Select(out1, e, _mm_set1_epi8(effect1));
+			e = GPU_Select(out0, e, _mm_set1_epi8(effect0));
+			_mm_storeu_si128((__m128i*)(effect+x), e);
 		}
-	}
+#endif
 
-	//if(true) //sprwin test hack
-	if (WINOBJ_ENABLED)
-	{
-		// it is in winOBJ, do we display ?
-		// low priority
-		if (sprWin[x])
+		for(; x < 256; x++)
 		{
-			draw	= (WINOBJ >> currBgNum)&1;
-			effect	= (WINOBJ_SPECIAL);
-			return;
+			if(win0[x]) { draw[x] = draw0; effect[x] = effect0; }
+			else if(win1[x]) { draw[x] = draw1; effect[x] = effect1; }
+			else if(winObj[x]) { draw[x] = drawObj; effect[x] = effectObj; }
+			else { draw[x] = drawOut; effect[x] = effectOut; }
 		}
 	}
-
-	if (WINOBJ_ENABLED | WIN1_ENABLED | WIN0_ENABLED)
-	{
-		draw	= (WINOUT >> currBgNum) & 1;
-		effect	= (WINOUT_SPECIAL);
-	}
 }
 
 /*****************************************************************************/
@@ -586,8 +673,15 @@ FORCEINLINE FASTCALL void GPU::_master_setFinal3dColor(int dstX, int srcX)
 	}
 
 	int bg_under = bgPixels[dstX];
+	#ifndef X432R_CUSTOMRENDERER_ENABLED
+	hiRes3dSrc[dstX] = srcX;
+	hiRes3dUnder[dstX] = HostReadWord(dst, passing);
+	#endif
 	if(blend2[bg_under])
 	{
+		#ifndef X432R_CUSTOMRENDERER_ENABLED
+		hiRes3dMode[dstX] = HIRES3D_BLEND;
+		#endif
 		alpha++;
 		if(alpha<32)
 		{
@@ -613,10 +707,11 @@ FORCEINLINE FASTCALL void GPU::_master_setFinal3dColor(int dstX, int srcX)
 		final = R6G6B6TORGB15(red,green,blue);
 		//perform the special effect
 		#ifndef X432R_CUSTOMRENDERER_ENABLED
+		hiRes3dMode[dstX] = HIRES3D_OPAQUE;
 		if(windowEffect)
 			switch(FUNC) {
-				case Increase: final = currentFadeInColors[final&0x7FFF]; break;
-				case Decrease: final = currentFadeOutColors[final&0x7FFF]; break;
+				case Increase: final = currentFadeInColors[final&0x7FFF]; hiRes3dMode[dstX] = HIRES3D_FADEIN; break;
+				case Decrease: final = currentFadeOutColors[final&0x7FFF]; hiRes3dMode[dstX] = HIRES3D_FADEOUT; break;
 				case NoBlend: 
 				case Blend:
 					break;
@@ -876,6 +971,15 @@ FORCEINLINE void GPU::setFinalColorBG(u16 color, const u32 x)
 	//assert((color&0x8000)==0);
 	if(!BACKDROP) color &= 0x7FFF; //but for the backdrop we can easily guarantee earlier that theres no bit here
 
+	#ifndef X432R_CUSTOMRENDERER_ENABLED
+	//bg pixels are composited a line at a time by compositeBGLine. the debug tools render wider than a line, pixel by pixel
+	if(!BACKDROP && !debug)
+	{
+		bgLine[x] = color | 0x8000;
+		return;
+	}
+	#endif
+
 	bool draw;
 
 	const int test = BACKDROP?FUNCNUM:setFinalColorBck_funcNum;
@@ -900,6 +1004,91 @@ FORCEINLINE void GPU::setFinalColorBG(u16 color, const u32 x)
 }
 
 
+//does for the pixels a bg layer left in bgLine what _master_setFinalBGColor does for each.
+//only the upstream renderer gets here; the X432R one hands every pixel to its backBuffer as it comes
+template<BlendFunc FUNC>
+void GPU::_compositeBGLine()
+{
+	u16 *dst = (u16*)currDst;
+	const u8 *draw = winDraw[currBgNum];
+	const u8 *effect = winEffect[currBgNum];
+	const u8 layer = currBgNum;
+	const bool effects = (FUNC != NoBlend) && blend1;
+	int x = 0;
+
+#if defined(ENABLE_SSE2) && !defined(WORDS_BIGENDIAN)
+	const __m128i opaqueBit = _mm_set1_epi16((s16)0x8000);
+	const __m128i evy = _mm_set1_epi16(BLDY_EVY);
+	const __m128i eva = _mm_set1_epi16(BLDALPHA_EVA);
+	const __m128i evb = _mm_set1_epi16(BLDALPHA_EVB);
+	const __m128i layer8 = _mm_set1_epi8(layer);
+
+	for(; x < 256; x += 8)
+	{
+		const __m128i src = _mm_loadu_si128((const __m128i*)(bgLine+x));
+		const __m128i drawn = _mm_and_si128(_mm_srai_epi16(src,15),GPU_LoadMask8(draw+x));
+		if(!_mm_movemask_epi8(drawn)) continue;
+
+		const __m128i under = _mm_loadu_si128((const __m128i*)(dst+x));
+		__m128i color = _mm_andnot_si128(opaqueBit,src);
+		if(effects)
+		{
+			__m128i affected = GPU_LoadMask8(effect+x);
+			__m128i fx;
+			if(FUNC == Blend)
+			{
+				//only over a second target
+				const __m128i below = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(bgPixels+x)),_mm_setzero_si128());
+				__m128i second = _mm_setzero_si128();
+				for(int i = 0; i < 6; i++)
+					if(blend2[i]) second = _mm_or_si128(second,_mm_cmpeq_epi16(below,_mm_set1_epi16(i)));
+				affected = _mm_and_si128(affected,second);
+				fx = GPU_Blend(color,under,eva,evb);
+			}
+			else if(FUNC == Increase) fx = GPU_FadeIn(color,evy);
+			else fx = GPU_FadeOut(color,evy);
+			color = GPU_Select(affected,fx,color);
+		}
+
+		_mm_storeu_si128((__m128i*)(dst+x),GPU_Select(drawn,_mm_or_si128(color,opaqueBit),under));
+		const __m128i drawn8 = _mm_packs_epi16(drawn,drawn);
+		const __m128i pixels = _mm_loadl_epi64((const __m128i*)(bgPixels+x));
+		_mm_storel_epi64((__m128i*)(bgPixels+x),GPU_Select(drawn8,layer8,pixels));
+	}
+#endif
+
+	for(; x < 256; x++)
+	{
+		const u16 src = bgLine[x];
+		if(!(src & 0x8000) || !draw[x]) continue;
+
+		u16 color = src & 0x7FFF;
+		if(effects && effect[x])
+		{
+			switch(FUNC) {
+				case Blend: if(blend2[bgPixels[x]]) color = blend(color,dst[x]); break;
+				case Increase: color = currentFadeInColors[color]; break;
+				case Decrease: color = currentFadeOutColors[color]; break;
+				case NoBlend: break;
+			}
+		}
+		dst[x] = color | 0x8000;
+		bgPixels[x] = layer;
+	}
+}
+
+void GPU::compositeBGLine()
+{
+	//the window doesn't matter here, winDraw and winEffect are all set without one
+	switch(setFinalColorBck_funcNum & 3)
+	{
+		case 0: _compositeBGLine<NoBlend>(); break;
+		case 1: _compositeBGLine<Blend>(); break;
+		case 2: _compositeBGLine<Increase>(); break;
+		case 3: _compositeBGLine<Decrease>(); break;
+	}
+}
+
 FORCEINLINE void GPU::setFinalColor3d(int dstX, int srcX)
 {
 	switch(setFinalColor3d_funcNum)
@@ -959,10 +1148,10 @@ FORCEINLINE void GPU::___setFinalColorBck(u16 color, const u32 x, const int opaq
 	else color &= 0x7FFF;
 
 	//due to the early out, enabled must always be true
-	//x_int = enabled ? GPU::mosaicLookup.width[x].trunc : x;
-	x_int = GPU::mosaicLookup.width[x].trunc;
+	//x_int = enabled ? mosaic.width[x].trunc : x;
+	x_int = mosaic.width[x].trunc;
 
-	if(GPU::mosaicLookup.width[x].begin && GPU::mosaicLookup.height[currLine].begin) {}
+	if(mosaic.width[x].begin && mosaic.height[currLine].begin) {}
 	else color = mosaicColors.bg[currBgNum][x_int];
 	mosaicColors.bg[currBgNum][x] = color;
 
@@ -1033,11 +1222,11 @@ static void mosaicSpriteLinePixel(GPU * gpu, int x, u16 l, u8 * dst, u8 * dst_al
 	objColor.alpha = dst_alpha[x];
 	objColor.opaque = opaque;
 
-	x_int = enabled ? GPU::mosaicLookup.width[x].trunc : x;
+	x_int = enabled ? gpu->mosaic.width[x].trunc : x;
 
 	if(enabled)
 	{
-		if(GPU::mosaicLookup.width[x].begin && GPU::mosaicLookup.height[y].begin) {}
+		if(gpu->mosaic.width[x].begin && gpu->mosaic.height[y].begin) {}
 		else objColor = gpu->mosaicColors.obj[x_int];
 	}
 	gpu->mosaicColors.obj[x] = objColor;
@@ -1050,7 +1239,7 @@ static void mosaicSpriteLinePixel(GPU * gpu, int x, u16 l, u8 * dst, u8 * dst_al
 FORCEINLINE static void mosaicSpriteLine(GPU * gpu, u16 l, u8 * dst, u8 * dst_alpha, u8 * typeTab, u8 * prioTab)
 {
 	//don't even try this unless the mosaic is effective
-	if(gpu->mosaicLookup.widthValue != 0 || gpu->mosaicLookup.heightValue != 0)
+	if(gpu->mosaic.widthValue != 0 || gpu->mosaic.heightValue != 0)
 		for(int i=0;i<256;i++)
 			mosaicSpriteLinePixel(gpu,i,l,dst,dst_alpha,typeTab,prioTab);
 }
@@ -1565,7 +1754,7 @@ INLINE void render_sprite_Win (GPU * gpu, u16 l, u8 * src,
 		for(i = 0; i < lg; i++, sprX++,x+=xdir)
 			//sprWin[sprX] = (src[x])?1:0;
 			if(src[(x&7) + ((x&0xFFF8)<<3)]) 
-				sprWin[sprX] = 1;
+				gpu->sprWin[sprX] = 1;
 	} else {
 		for(i = 0; i < lg; i++, ++sprX, x+=xdir)
 		{
@@ -1575,7 +1764,7 @@ INLINE void render_sprite_Win (GPU * gpu, u16 l, u8 * src,
 			else       palette_entry = palette & 0xF;
 			//sprWin[sprX] = (palette_entry)?1:0;
 			if(palette_entry)
-				sprWin[sprX] = 1;
+				gpu->sprWin[sprX] = 1;
 		}
 	}
 }
@@ -1661,6 +1850,47 @@ static u32 bmp_sprite_address(GPU* gpu, _OAM_ * spriteInfo, size sprSize, s32 y)
 }
 
 
+void GPU::binSprites()
+{
+	memset(sprBins.count, 0, sizeof(sprBins.count));
+
+	for(int i = 0; i < 128; i++)
+	{
+		//disabled sprites are decoded too, as their attr3 may hold rotation/scale parameters
+		_OAM_ &spriteInfo = sprBins.oam[i];
+		SlurpOAM(&spriteInfo, oam, i);
+
+		if (spriteInfo.RotScale == 2)
+			continue;
+
+		//the same visibility tests as _spriteRender: y wraps around, x doesn't
+		const size sprSize = sprSizeTab[spriteInfo.Size][spriteInfo.Shape];
+		s32 fieldX = sprSize.x, fieldY = sprSize.y;
+		if (spriteInfo.RotScale == 3)
+		{
+			fieldX <<= 1;
+			fieldY <<= 1;
+		}
+
+		const s32 sprX = spriteInfo.X;
+		if((sprX==256) || (sprX+fieldX<=0))
+			continue;
+
+		s32 sprY = spriteInfo.Y;
+		if (sprY>=192)
+			sprY = (s32)((s8)(spriteInfo.Y));
+
+		for(s32 y = 0; y < fieldY; y++)
+		{
+			const u32 line = (sprY + y) & 255;
+			if(line < 192)
+				sprBins.sprites[line][sprBins.count[line]++] = i;
+		}
+	}
+
+	sprBinsDirty = false;
+}
+
 template<GPU::SpriteRenderMode MODE>
 void GPU::_spriteRender(u8 * dst, u8 * dst_alpha, u8 * typeTab, u8 * prioTab)
 {
@@ -1672,11 +1902,17 @@ void GPU::_spriteRender(u8 * dst, u8 * dst_alpha, u8 * typeTab, u8 * prioTab)
 	struct _DISPCNT * dispCnt = &(gpu->dispx_st)->dispx_DISPCNT.bits;
 	u8 block = gpu->sprBoundary;
 
-	for(int i = 0; i<128; i++)     
+	if(sprBinsDirty)
+		binSprites();
+
+	//only the sprites on this line; the tests below still give their position within it
+	const u8 *lineSprites = sprBins.sprites[l];
+	const int lineCount = sprBins.count[l];
+
+	for(int n = 0; n<lineCount; n++)
 	{
-		_OAM_ oam;
-		_OAM_* spriteInfo = &oam;
-		SlurpOAM(spriteInfo, gpu->oam, i);
+		const int i = lineSprites[n];
+		_OAM_* spriteInfo = &sprBins.oam[i];
 
 		//for each sprite:
 		if(cost>=2130)
@@ -1748,10 +1984,10 @@ void GPU::_spriteRender(u8 * dst, u8 * dst_alpha, u8 * typeTab, u8 * prioTab)
 			blockparameter = (spriteInfo->RotScalIndex + (spriteInfo->HFlip<< 3) + (spriteInfo->VFlip << 4))*4;
 
 			// Get rotation/scale parameters
-			dx = SlurpOAMAffineParam(gpu->oam,blockparameter+0);
-			dmx = SlurpOAMAffineParam(gpu->oam,blockparameter+1);
-			dy = SlurpOAMAffineParam(gpu->oam,blockparameter+2);
-			dmy = SlurpOAMAffineParam(gpu->oam,blockparameter+3);
+			dx = sprBins.oam[blockparameter+0].attr3;
+			dmx = sprBins.oam[blockparameter+1].attr3;
+			dy = sprBins.oam[blockparameter+2].attr3;
+			dmy = sprBins.oam[blockparameter+3].attr3;
 
 
 			// Calculate fixed poitn 8.8 start offsets
@@ -2008,6 +2244,210 @@ void GPU::_spriteRender(u8 * dst, u8 * dst_alpha, u8 * typeTab, u8 * prioTab)
 //			SCREEN FUNCTIONS
 /*****************************************************************************/
 
+//lines of GPU_screen (0-383) into GPU_screen32, in the output format
+static void GPU_ConvertLines(u32 first, u32 count)
+{
+	const u16 *src = (u16*)GPU_screen + first*256;
+	u32 *dst = GPU_screen32 + first*256;
+	const u32 pixels = count*256;
+
+	switch(gpu_outputFormat)
+	{
+		case GPU_OUTPUT_RGB555:
+			break;
+
+		case GPU_OUTPUT_RGBA8888:
+			for(u32 i = 0; i < pixels; i++)
+				dst[i] = RGB15TO32(src[i], 0xFF);
+			break;
+
+		case GPU_OUTPUT_BGRA8888:
+		{
+			const u32 alpha = LE_TO_LOCAL_32(0xFF000000);
+			for(u32 i = 0; i < pixels; i++)
+				dst[i] = RGB15TO24_REVERSE(src[i]) | alpha;
+			break;
+		}
+	}
+}
+
+static u32 *GPU_screenHighRes = NULL;
+static u32 gpu_highResScale = 1;
+
+//a color of GPU_screen in the format of GPU_screenHighRes
+static FORCEINLINE u32 GPU_HighResColor(u16 color)
+{
+	if(gpu_outputFormat == GPU_OUTPUT_BGRA8888)
+		return RGB15TO24_REVERSE(color) | LE_TO_LOCAL_32(0xFF000000);
+	return RGB15TO32(color, 0xFF);
+}
+
+//lines of GPU_screen (0-383) into GPU_screenHighRes, each pixel repeated
+static void GPU_ScaleLines(u32 first, u32 count)
+{
+	if(!GPU_screenHighRes) return;
+
+	const u32 scale = gpu_highResScale;
+	const u32 width = 256*scale;
+	for(u32 l = first; l < first+count; l++)
+	{
+		const u16 *src = (u16*)GPU_screen + l*256;
+		u32 *dst = GPU_screenHighRes + l*scale*width;
+		for(u32 x = 0; x < 256; x++)
+		{
+			const u32 color = GPU_HighResColor(src[x]);
+			for(u32 i = 0; i < scale; i++)
+				*dst++ = color;
+		}
+		for(u32 i = 1; i < scale; i++)
+			memcpy(GPU_screenHighRes + (l*scale+i)*width, GPU_screenHighRes + l*scale*width, width*4);
+	}
+}
+
+#ifndef X432R_CUSTOMRENDERER_ENABLED
+//a sample of the larger 3d frame composited as _master_setFinal3dColor did with the pixel it lies in
+static FORCEINLINE u16 GPU_HighRes3dColor(GPU *gpu, u8 mode, u16 under, const u8 *color)
+{
+	const u8 red = color[0];
+	const u8 green = color[1];
+	const u8 blue = color[2];
+	const u8 alpha = color[3];
+
+	//the 3d layer drew nothing on this part of the pixel
+	if(alpha == 0) return under & 0x7FFF;
+
+	switch(mode)
+	{
+		case GPU::HIRES3D_BLEND:
+			if(alpha+1 < 32)
+			{
+				COLOR c2, cfinal;
+				c2.val = under;
+				cfinal.bits.red = ((red * (alpha+1)) + ((c2.bits.red<<1) * (31 - alpha)))>>6;
+				cfinal.bits.green = ((green * (alpha+1)) + ((c2.bits.green<<1) * (31 - alpha)))>>6;
+				cfinal.bits.blue = ((blue * (alpha+1)) + ((c2.bits.blue<<1) * (31 - alpha)))>>6;
+				return cfinal.val & 0x7FFF;
+			}
+			return R6G6B6TORGB15(red,green,blue);
+		case GPU::HIRES3D_FADEIN: return gpu->currentFadeInColors[R6G6B6TORGB15(red,green,blue)];
+		case GPU::HIRES3D_FADEOUT: return gpu->currentFadeOutColors[R6G6B6TORGB15(red,green,blue)];
+		default: return R6G6B6TORGB15(red,green,blue);
+	}
+}
+
+//line l of a screen into GPU_screenHighRes, once it is finished in GPU_screen.
+//the pixels the 3d layer ended up on top of are composited again from the 3d frame drawn at the same scale
+//(or from the usual one, if the renderer drew no such frame); the others, including those where a 2d layer
+//was blended over the 3d one, are repeated
+static void GPU_RenderLine_highRes(NDS_Screen *screen, u16 l)
+{
+	GPU *gpu = screen->gpu;
+	const u32 line = screen->offset + l;
+
+	if(!gpu->hiRes3dLine || gpu->dispMode != 1)
+	{
+		GPU_ScaleLines(line, 1);
+		return;
+	}
+
+	const u32 scale = gpu_highResScale;
+	const u32 width = 256*scale;
+	const u16 *src = (u16*)GPU_screen + line*256;
+
+	const u8 *src3d = gpu->_3dColorLine;
+	u32 scale3d = 1;
+	if(gfx3d_highResScale == (int)scale)
+	{
+		src3d = gfx3d_highResScreen + l*scale*width*4;
+		scale3d = scale;
+	}
+
+	//the master brightness of the line, which GPU_screen already has
+	const u16 *bright = NULL;
+	const u32 factor = std::min<u32>(gpu->MasterBrightFactor, 16);
+	if(factor != 0 && gpu->MasterBrightMode == 1) bright = fadeInColors[factor];
+	if(factor != 0 && gpu->MasterBrightMode == 2) bright = fadeOutColors[factor];
+
+	for(u32 sy = 0; sy < scale; sy++)
+	{
+		u32 *dst = GPU_screenHighRes + (line*scale + sy)*width;
+		const u8 *row3d = src3d + (scale3d == 1 ? 0 : sy*width*4);
+
+		for(u32 x = 0; x < 256; x++, dst += scale)
+		{
+			if(gpu->bgPixels[x] != 0)
+			{
+				const u32 color = GPU_HighResColor(src[x]);
+				for(u32 sx = 0; sx < scale; sx++)
+					dst[sx] = color;
+				continue;
+			}
+
+			const u8 mode = gpu->hiRes3dMode[x];
+			const u16 under = gpu->hiRes3dUnder[x];
+			const u8 *color3d = row3d + gpu->hiRes3dSrc[x]*scale3d*4;
+			for(u32 sx = 0; sx < scale; sx++)
+			{
+				u16 final = GPU_HighRes3dColor(gpu, mode, under, color3d + (scale3d == 1 ? 0 : sx*4));
+				if(bright) final = bright[final & 0x7FFF];
+				dst[sx] = GPU_HighResColor(final);
+			}
+		}
+	}
+}
+
+//takes CommonSettings.GFX3D_RenderScale up. only between frames, while no line is being rendered
+static void GPU_UpdateHighResScale()
+{
+	const u32 scale = std::max(1, std::min((int)CommonSettings.GFX3D_RenderScale, GFX3D_MAX_RENDER_SCALE));
+	if(scale == gpu_highResScale) return;
+
+	free(GPU_screenHighRes);
+	GPU_screenHighRes = NULL;
+	gpu_highResScale = scale;
+
+	if(scale > 1)
+	{
+		GPU_screenHighRes = (u32*)malloc(256*scale * 384*scale * 4);
+		GPU_ScaleLines(0, 384);
+	}
+}
+#endif
+
+u32 GPU_GetHighResScale()
+{
+	return gpu_highResScale;
+}
+
+const u32* GPU_GetHighResScreen()
+{
+	return GPU_screenHighRes;
+}
+
+void GPU_ConvertScreen()
+{
+	GPU_FinishAsyncLine();
+	GPU_ConvertLines(0, 384);
+	GPU_ScaleLines(0, 384);
+}
+
+void GPU_SetOutputFormat(GPU_OutputFormat format)
+{
+	GPU_FinishAsyncLine();
+	gpu_outputFormat = format;
+	GPU_ConvertLines(0, 384);
+	GPU_ScaleLines(0, 384);
+}
+
+GPU_OutputFormat GPU_GetOutputFormat()
+{
+	return gpu_outputFormat;
+}
+
+#ifndef X432R_CUSTOMRENDERER_ENABLED
+static void GPU_ForgetLines();
+#endif
+
 int Screen_Init()
 {
 	MainScreen.gpu = GPU_Init(0);
@@ -2026,6 +2466,8 @@ int Screen_Init()
 
 void Screen_Reset(void)
 {
+	GPU_FinishAsyncLine();
+
 	GPU_Reset(MainScreen.gpu, 0);
 	GPU_Reset(SubScreen.gpu, 1);
 	MainScreen.offset = 0;
@@ -2034,9 +2476,15 @@ void Screen_Reset(void)
 	memset(GPU_screen, 0, sizeof(GPU_screen));
 	for(int i = 0; i < (256*192*2); i++)
 		((u16*)GPU_screen)[i] = 0x7FFF;
+	GPU_ConvertLines(0, 384);
+	GPU_ScaleLines(0, 384);
 
 	disp_fifo.head = disp_fifo.tail = 0;
 	osd->clear();
+
+	#ifndef X432R_CUSTOMRENDERER_ENABLED
+	GPU_ForgetLines();
+	#endif
 	
 	#ifdef X432R_CUSTOMRENDERER_ENABLED
 	X432R::ClearBuffers();
@@ -2045,9 +2493,15 @@ void Screen_Reset(void)
 
 void Screen_DeInit(void)
 {
+	GPU_FinishAsyncLine();
+
 	GPU_DeInit(MainScreen.gpu);
 	GPU_DeInit(SubScreen.gpu);
 
+	free(GPU_screenHighRes);
+	GPU_screenHighRes = NULL;
+	gpu_highResScale = 1;
+
 	if (osd)  {delete osd; osd =NULL; }
 }
 
@@ -2127,73 +2581,11 @@ static void GPU_RenderLine_layer(NDS_Screen * screen, u16 l)
 
 	u16 backdrop_color = T1ReadWord(MMU.ARM9_VMEM, gpu->core * 0x400) & 0x7FFF;
 
-	#ifndef X432R_CUSTOMRENDERER_ENABLED
-	//we need to write backdrop colors in the same way as we do BG pixels in order to do correct window processing
-	//this is currently eating up 2fps or so. it is a reasonable candidate for optimization. 
-	gpu->currBgNum = 5;
-	switch(gpu->setFinalColorBck_funcNum)
-	{
-		//for backdrops, blend isnt applied (it's illogical, isnt it?)
-		case 0:
-		case 1:
-PLAIN_CLEAR:
-			memset_u16_le<256>(gpu->currDst,backdrop_color); 
-			break;
-
-		//for backdrops, fade in and fade out can be applied if it's a 1st target screen
-		case 2:
-			if(gpu->BLDCNT & 0x20) //backdrop is selected for color effect
-				memset_u16_le<256>(gpu->currDst,gpu->currentFadeInColors[backdrop_color]);
-			else goto PLAIN_CLEAR;
-			break;
-		case 3:
-			if(gpu->BLDCNT & 0x20) //backdrop is selected for color effect
-				memset_u16_le<256>(gpu->currDst,gpu->currentFadeOutColors[backdrop_color]);
-			else goto PLAIN_CLEAR;
-			break;
-
-		//windowed cases apparently need special treatment? why? can we not render the backdrop? how would that even work?
-		case 4: for(int x=0;x<256;x++) gpu->___setFinalColorBck<false,true,4>(backdrop_color,x,1); break;
-		case 5: for(int x=0;x<256;x++) gpu->___setFinalColorBck<false,true,5>(backdrop_color,x,1); break;
-		case 6: for(int x=0;x<256;x++) gpu->___setFinalColorBck<false,true,6>(backdrop_color,x,1); break;
-		case 7: for(int x=0;x<256;x++) gpu->___setFinalColorBck<false,true,7>(backdrop_color,x,1); break;
-	}
-	#else
-	//we need to write backdrop colors in the same way as we do BG pixels in order to do correct window processing
-	//this is currently eating up 2fps or so. it is a reasonable candidate for optimization. 
-	gpu->currBgNum = 5;
-	
-	u16 backdrop_color2 = backdrop_color;
-	
-	if(gpu->BLDCNT & 0x20)		//backdrop is selected for color effect
-	{
-		switch(gpu->setFinalColorBck_funcNum)
-		{
-			//for backdrops, fade in and fade out can be applied if it's a 1st target screen
-			case 2:
-			case 6:
-				backdrop_color2 = gpu->currentFadeInColors[backdrop_color];
-				break;
-		
-			case 3:
-			case 7:
-				backdrop_color2 = gpu->currentFadeOutColors[backdrop_color];
-				break;
-		}
-	}
-	
-	memset_u16_le<256>(gpu->currDst, backdrop_color2);
-	
-	X432R::backBuffer.UpdateRenderLineParams(gpu->core, backdrop_color2);
-	#endif
-	
-	memset(gpu->bgPixels,5,256);
-
 	// init background color & priorities
 	memset(sprAlpha, 0, 256);
 	memset(sprType, 0, 256);
 	memset(sprPrio, 0xFF, 256);
-	memset(sprWin, 0, 256);
+	memset(gpu->sprWin, 0, 256);
 	
 	// init pixels priorities
 	assert(NB_PRIORITIES==4);
@@ -2226,6 +2618,64 @@ PLAIN_CLEAR:
 		}
 	}
 
+	//the windows of the whole line, now that the obj window is known
+	gpu->setup_windowMasks();
+
+	#ifndef X432R_CUSTOMRENDERER_ENABLED
+	//the backdrop takes a fade where it is a 1st target screen and the window lets the effect through.
+	//blending it with what's under it makes no sense, there is nothing
+	gpu->currBgNum = 5;
+	u16 backdrop_effect = backdrop_color;
+	if(gpu->BLDCNT & 0x20) //backdrop is selected for color effect
+	{
+		switch(gpu->setFinalColorBck_funcNum & 3)
+		{
+			case 2: backdrop_effect = gpu->currentFadeInColors[backdrop_color]; break;
+			case 3: backdrop_effect = gpu->currentFadeOutColors[backdrop_color]; break;
+		}
+	}
+
+	if(gpu->setFinalColorBck_funcNum < 4)
+		memset_u16_le<256>(gpu->currDst,backdrop_effect);
+	else
+	{
+		//windowed pixels are marked opaque, as the other layers do
+		u16 *dst = (u16*)gpu->currDst;
+		const u8 *effect = gpu->winEffect[5];
+		for(int x=0;x<256;x++)
+			dst[x] = (effect[x] ? backdrop_effect : backdrop_color) | 0x8000;
+	}
+	#else
+	//we need to write backdrop colors in the same way as we do BG pixels in order to do correct window processing
+	//this is currently eating up 2fps or so. it is a reasonable candidate for optimization. 
+	gpu->currBgNum = 5;
+	
+	u16 backdrop_color2 = backdrop_color;
+	
+	if(gpu->BLDCNT & 0x20)		//backdrop is selected for color effect
+	{
+		switch(gpu->setFinalColorBck_funcNum)
+		{
+			//for backdrops, fade in and fade out can be applied if it's a 1st target screen
+			case 2:
+			case 6:
+				backdrop_color2 = gpu->currentFadeInColors[backdrop_color];
+				break;
+		
+			case 3:
+			case 7:
+				backdrop_color2 = gpu->currentFadeOutColors[backdrop_color];
+				break;
+		}
+	}
+	
+	memset_u16_le<256>(gpu->currDst, backdrop_color2);
+	
+	X432R::backBuffer.UpdateRenderLineParams(gpu->core, backdrop_color2);
+	#endif
+	
+	memset(gpu->bgPixels,5,256);
+
 	
 	if (!gpu->LayersEnable[0] && !gpu->LayersEnable[1] && !gpu->LayersEnable[2] && !gpu->LayersEnable[3])
 		BG_enabled = FALSE;
@@ -2263,6 +2713,7 @@ PLAIN_CLEAR:
 
 							gfx3d_GetLineData(l, &gpu->_3dColorLine);
 							u8* colorLine = gpu->_3dColorLine;
+							gpu->hiRes3dLine = true;
 
 							for(int k = 0; k < 256; k++)
 							{
@@ -2285,12 +2736,21 @@ PLAIN_CLEAR:
 
 
 
+#ifndef X432R_CUSTOMRENDERER_ENABLED
+					//the layer is rendered into bgLine and then composited over the line at once
+					memset(gpu->bgLine,0,sizeof(gpu->bgLine));
+#endif
+
 #ifndef DISABLE_MOSAIC
 					if(gpu->curr_mosaic_enabled)
 						gpu->modeRender<true>(i16);
 					else 
 #endif
 						gpu->modeRender<false>(i16);
+
+#ifndef X432R_CUSTOMRENDERER_ENABLED
+					gpu->compositeBGLine();
+#endif
 				} //layer enabled
 			}
 		}
@@ -2369,6 +2829,8 @@ template<bool SKIP> static void GPU_RenderLine_DispCapture(u16 l)
 		if(!skip)
 		if (l < gpu->dispCapCnt.capy)
 		{
+			MMU_SetVRAMDirty(cap_dst_adr, ofsmul);
+
 			switch (gpu->dispCapCnt.capSrc)
 			{
 				case 0:		// Capture source is SourceA
@@ -2580,7 +3042,17 @@ static INLINE void GPU_RenderLine_MasterBrightness(NDS_Screen * screen, u16 l)
 		{
 			if(factor != 16)
 			{
-				for(i16 = 0; i16 < 256; ++i16)
+				i16 = 0;
+#if defined(ENABLE_SSE2) && !defined(WORDS_BIGENDIAN)
+				const __m128i evy = _mm_set1_epi16(factor);
+				const __m128i colorBits = _mm_set1_epi16(0x7FFF);
+				for(; i16 < 256; i16 += 8)
+				{
+					const __m128i c = _mm_and_si128(_mm_load_si128((const __m128i*)(dst + (i16<<1))),colorBits);
+					_mm_store_si128((__m128i*)(dst + (i16<<1)),GPU_FadeIn(c,evy));
+				}
+#endif
+				for(; i16 < 256; ++i16)
 				{
 					((u16*)dst)[i16] = fadeInColors[factor][((u16*)dst)[i16]&0x7FFF];
 				}
@@ -2599,7 +3071,17 @@ static INLINE void GPU_RenderLine_MasterBrightness(NDS_Screen * screen, u16 l)
 		{
 			if(factor != 16)
 			{
-				for(i16 = 0; i16 < 256; ++i16)
+				i16 = 0;
+#if defined(ENABLE_SSE2) && !defined(WORDS_BIGENDIAN)
+				const __m128i evy = _mm_set1_epi16(factor);
+				const __m128i colorBits = _mm_set1_epi16(0x7FFF);
+				for(; i16 < 256; i16 += 8)
+				{
+					const __m128i c = _mm_and_si128(_mm_load_si128((const __m128i*)(dst + (i16<<1))),colorBits);
+					_mm_store_si128((__m128i*)(dst + (i16<<1)),GPU_FadeOut(c,evy));
+				}
+#endif
+				for(; i16 < 256; ++i16)
 				{
 					((u16*)dst)[i16] = fadeOutColors[factor][((u16*)dst)[i16]&0x7FFF];
 				}
@@ -2705,7 +3187,58 @@ void GPU::update_winh(int WIN_NUM)
 	}
 }
 
-void GPU_RenderLine(NDS_Screen * screen, u16 l, bool skip)
+#ifndef X432R_CUSTOMRENDERER_ENABLED
+//When CommonSettings.reuse_2d_lines is set, a line which would come out as it did the last time it was rendered
+//(menus, a touch screen ui that doesnt move) is copied from then instead of rendered again.
+//A line depends on the engine's registers, which hold the running affine reference points too, on the layers
+//the user enabled, and on the palette, oam and vram the engine reads, whose writes gpu_memGeneration counts.
+//Lines which depend on more than that (3d, vertical mosaic, vram display and the display fifo)
+//or which have side effects (display capture) are always rendered.
+#define GPU_MEMO_REGS 0x70
+
+struct GPU_LineMemo
+{
+	bool valid;
+	u32 generation;
+	BOOL layers[5];
+	u8 regs[GPU_MEMO_REGS];
+	s32 affineAfter[4]; //BG2X, BG2Y, BG3X and BG3Y once the line was rendered
+	u16 line[256];
+};
+
+static GPU_LineMemo lineMemo[2][192];
+
+static void GPU_ForgetLines()
+{
+	memset(lineMemo, 0, sizeof(lineMemo));
+}
+
+static bool GPU_CanReuseLine(GPU *gpu)
+{
+	if(!CommonSettings.reuse_2d_lines) return false;
+	if(gpu->dispMode > 1) return false;
+	if(T1ReadWord((u8 *)&gpu->dispx_st->dispx_MISC.MOSAIC, 0) != 0) return false;
+
+	if(gpu->core == GPU_MAIN)
+	{
+		const _DISPCNT &dispCnt = gpu->dispx_st->dispx_DISPCNT.bits;
+		if(gpu->dispCapCnt.enabled || (gpu->dispCapCnt.val & 0x80000000)) return false;
+		if(dispCnt.BG0_Enable && dispCnt.BG0_3D) return false;
+	}
+
+	return true;
+}
+
+//the registers a line is rendered from. DISPSTAT and VCOUNT, the 3d and capture control and the fifo are left out
+static void GPU_LineMemoRegs(GPU *gpu, u8 *regs)
+{
+	memcpy(regs, gpu->dispx_st, GPU_MEMO_REGS);
+	memset(regs + 0x04, 0, 4);
+	memset(regs + 0x60, 0, 0x0C);
+}
+#endif
+
+static void GPU_RenderLine_screen(NDS_Screen * screen, u16 l, bool skip)
 {
 	GPU * gpu = screen->gpu;
 
@@ -2725,6 +3258,8 @@ void GPU_RenderLine(NDS_Screen * screen, u16 l, bool skip)
 		gpu->refreshAffineStartRegs(-1,-1);
 	}
 
+	gpu->hiRes3dLine = false;
+
 	if(skip)
 	{
 		gpu->currLine = l;
@@ -2760,6 +3295,33 @@ void GPU_RenderLine(NDS_Screen * screen, u16 l, bool skip)
 		}
 	}
 
+	#ifndef X432R_CUSTOMRENDERER_ENABLED
+	GPU_LineMemo *memo = NULL;
+	u8 memoRegs[GPU_MEMO_REGS];
+	if(GPU_CanReuseLine(gpu))
+	{
+		memo = &lineMemo[gpu->core][l];
+		GPU_LineMemoRegs(gpu, memoRegs);
+
+		if(memo->valid && memo->generation == gpu_memGeneration[gpu->core]
+			&& !memcmp(memo->layers, gpu->LayersEnable, sizeof(memo->layers))
+			&& !memcmp(memo->regs, memoRegs, GPU_MEMO_REGS))
+		{
+			gpu->currLine = l;
+			memcpy(GPU_screen + (screen->offset + l) * 512, memo->line, 512);
+
+			//the affine layers step on as they would have
+			gpu->dispx_st->dispx_BG2PARMS.BGxX = memo->affineAfter[0];
+			gpu->dispx_st->dispx_BG2PARMS.BGxY = memo->affineAfter[1];
+			gpu->dispx_st->dispx_BG3PARMS.BGxX = memo->affineAfter[2];
+			gpu->dispx_st->dispx_BG3PARMS.BGxY = memo->affineAfter[3];
+
+			if (gpu->core == GPU_MAIN && l == 191) { disp_fifo.head = disp_fifo.tail = 0; }
+			return;
+		}
+	}
+	#endif
+
 	//cache some parameters which are assumed to be stable throughout the rendering of the entire line
 	gpu->currLine = l;
 	u16 mosaic_control = T1ReadWord((u8 *)&gpu->dispx_st->dispx_MISC.MOSAIC, 0);
@@ -2769,10 +3331,10 @@ void GPU_RenderLine(NDS_Screen * screen, u16 l, bool skip)
 	//mosaic test hacks
 	//mosaic_width = mosaic_height = 3;
 
-	GPU::mosaicLookup.widthValue = mosaic_width;
-	GPU::mosaicLookup.heightValue = mosaic_height;
-	GPU::mosaicLookup.width = &GPU::mosaicLookup.table[mosaic_width][0];
-	GPU::mosaicLookup.height = &GPU::mosaicLookup.table[mosaic_height][0];
+	gpu->mosaic.widthValue = mosaic_width;
+	gpu->mosaic.heightValue = mosaic_height;
+	gpu->mosaic.width = &GPU::mosaicLookup.table[mosaic_width][0];
+	gpu->mosaic.height = &GPU::mosaicLookup.table[mosaic_height][0];
 
 	if(gpu->need_update_winh[0]) gpu->update_winh(0);
 	if(gpu->need_update_winh[1]) gpu->update_winh(1);
@@ -2844,14 +3406,118 @@ void GPU_RenderLine(NDS_Screen * screen, u16 l, bool skip)
 
 	#ifndef X432R_CUSTOMRENDERER_ENABLED
 	GPU_RenderLine_MasterBrightness(screen, l);
+
+	if(memo)
+	{
+		memo->valid = true;
+		memo->generation = gpu_memGeneration[gpu->core];
+		memcpy(memo->layers, gpu->LayersEnable, sizeof(memo->layers));
+		memcpy(memo->regs, memoRegs, GPU_MEMO_REGS);
+		memo->affineAfter[0] = gpu->dispx_st->dispx_BG2PARMS.BGxX;
+		memo->affineAfter[1] = gpu->dispx_st->dispx_BG2PARMS.BGxY;
+		memo->affineAfter[2] = gpu->dispx_st->dispx_BG3PARMS.BGxX;
+		memo->affineAfter[3] = gpu->dispx_st->dispx_BG3PARMS.BGxY;
+		memcpy(memo->line, GPU_screen + (screen->offset + l) * 512, 512);
+	}
 	#else
 	if( X432R::backBuffer.IsHighResolutionRenderingSkipped(gpu->core) )
 		GPU_RenderLine_MasterBrightness(screen, l);
 	#endif
 }
 
+void GPU_RenderLine(NDS_Screen * screen, u16 l, bool skip)
+{
+	GPU_RenderLine_screen(screen, l, skip);
+
+	//the final pass: the finished line in the output format
+	if(!skip && gpu_outputFormat != GPU_OUTPUT_RGB555)
+		GPU_ConvertLines(screen->offset + l, 1);
+
+	#ifndef X432R_CUSTOMRENDERER_ENABLED
+	if(!skip && GPU_screenHighRes)
+		GPU_RenderLine_highRes(screen, l);
+	#endif
+}
+
+//the job which composites the deferred line(s). the pending flag is only touched by the emulation thread;
+//waiting on the job group is what synchronizes with the worker
+bool gpu_asyncLinePending = false;
+static JobGroup asyncLineJob;
+
+static struct AsyncLine
+{
+	NDS_Screen *screens[2];
+	int count;
+	u16 l;
+} asyncLine;
+
+static void* GPU_RenderLine_async(void*)
+{
+	for(int i=0;i<asyncLine.count;i++)
+		GPU_RenderLine(asyncLine.screens[i], asyncLine.l, false);
+	return NULL;
+}
+
+//the main engine can only be deferred if rendering the line has no side effects the cpu can see
+//(display capture writes vram and DISPCAPCNT, the fifo is fed by dma) and doesnt pull in the 3d renderer
+static bool GPU_CanDeferMainLine(u16 l)
+{
+	GPU *gpu = MainScreen.gpu;
+	const _DISPCNT &dispCnt = gpu->dispx_st->dispx_DISPCNT.bits;
+
+	if(gpu->dispCapCnt.enabled) return false;
+	if(l == 0 && (gpu->dispCapCnt.val & 0x80000000)) return false;
+	if(gpu->dispMode == 3) return false;
+	if(dispCnt.BG0_Enable && dispCnt.BG0_3D) return false;
+
+	return true;
+}
+
+void GPU_FinishAsyncLine()
+{
+	if(!gpu_asyncLinePending) return;
+	asyncLineJob.wait();
+	gpu_asyncLinePending = false;
+}
+
+void GPU_RenderLines(u16 l, bool skip)
+{
+	//the previous line may still be in flight
+	GPU_FinishAsyncLine();
+
+	#ifndef X432R_CUSTOMRENDERER_ENABLED
+	//the high resolution screen changes size between frames only
+	if(l == 0) GPU_UpdateHighResScale();
+	#endif
+
+	//a skipped line is nearly free, so theres nothing worth moving off this thread
+	if(!CommonSettings.async_2d || CommonSettings.single_core() || skip)
+	{
+		GPU_RenderLine(&MainScreen, l, skip);
+		GPU_RenderLine(&SubScreen, l, skip);
+		return;
+	}
+
+	const bool deferMain = GPU_CanDeferMainLine(l);
+
+	asyncLine.count = 0;
+	asyncLine.l = l;
+	if(deferMain) asyncLine.screens[asyncLine.count++] = &MainScreen;
+	asyncLine.screens[asyncLine.count++] = &SubScreen;
+
+	//always the same worker, so the engines' state stays in one cache
+	asyncLineJob.run(GPU_RenderLine_async, NULL, 0);
+	gpu_asyncLinePending = true;
+
+	//the main engine composites alongside the worker when it couldnt be deferred
+	if(!deferMain)
+		GPU_RenderLine(&MainScreen, l, false);
+}
+
 void gpu_savestate(EMUFILE* os)
 {
+	GPU_FinishAsyncLine();
+
 	//version
 	write32le(1,os);
 	
@@ -2869,6 +3535,8 @@ void gpu_savestate(EMUFILE* os)
 
 bool gpu_loadstate(EMUFILE* is, int size)
 {
+	GPU_FinishAsyncLine();
+
 	//read version
 	u32 version;
 
@@ -2905,6 +3573,12 @@ bool gpu_loadstate(EMUFILE* is, int size)
 
 	MainScreen.gpu->updateBLDALPHA();
 	SubScreen.gpu->updateBLDALPHA();
+
+	#ifndef X432R_CUSTOMRENDERER_ENABLED
+	GPU_ForgetLines();
+	#endif
+	GPU_ConvertLines(0, 384);
+	GPU_ScaleLines(0, 384);
 	return !is->fail();
 }
 
@@ -618,6 +618,7 @@ struct GPU
 	} mosaicColors;
 
 	u8 sprNum[256];
+	u8 sprWin[256];
 	u8 h_win[2][256];
 	const u8 *curr_win[2];
 	void update_winh(int WIN_NUM); 
@@ -625,6 +626,12 @@ struct GPU
 	
 	template<int WIN_NUM> void setup_windows();
 
+	//the windows resolved for the whole line, per layer (bgs, obj, backdrop) and pixel:
+	//0xFF where the layer is drawn, or takes the color effect, and 0 where not
+	CACHE_ALIGN u8 winDraw[6][256];
+	CACHE_ALIGN u8 winEffect[6][256];
+	void setup_windowMasks();
+
 	u8 core;
 
 	u8 dispMode;
@@ -690,6 +697,14 @@ struct GPU
 
 	u8* _3dColorLine;
 
+	//how the 3d layer made each pixel of the line, so that the high resolution output (see GPU_GetHighResScreen)
+	//can make them again from the larger 3d frame. only meaningful where bgPixels is 0 on a line which drew 3d
+	enum HiRes3dMode { HIRES3D_OPAQUE, HIRES3D_BLEND, HIRES3D_FADEIN, HIRES3D_FADEOUT };
+	bool hiRes3dLine;
+	u8 hiRes3dMode[256];
+	u8 hiRes3dSrc[256]; //the pixel of the 3d line, after scrolling
+	u16 hiRes3dUnder[256]; //the color the 3d layer was drawn over
+
 
 	static struct MosaicLookup {
 
@@ -706,11 +721,14 @@ struct GPU
 					te.trunc = i/mosaic*mosaic;
 				}
 		}
+	} mosaicLookup;
 
-		TableEntry *width, *height;
+	//the mosaic table rows in effect for the line being rendered.
+	//kept per engine (not in the shared table) so both engines can render a line at the same time
+	struct MosaicLine {
+		MosaicLookup::TableEntry *width, *height;
 		int widthValue, heightValue;
-		
-	} mosaicLookup;
+	} mosaic;
 	bool curr_mosaic_enabled;
 
 	u16 blend(u16 colA, u16 colB);
@@ -730,6 +748,17 @@ struct GPU
 		SPRITE_1D, SPRITE_2D
 	} spriteRenderMode;
 
+	//the sprites which show on each line, in oam order, with their oam decoded.
+	//built when a line is rendered after oam was written (see GPU_InvalidateOAM), which most games do once a frame
+	struct SpriteBins
+	{
+		_OAM_ oam[128];
+		u8 count[192];
+		u8 sprites[192][128];
+	} sprBins;
+	bool sprBinsDirty;
+	void binSprites();
+
 	template<GPU::SpriteRenderMode MODE>
 	void _spriteRender(u8 * dst, u8 * dst_alpha, u8 * typeTab, u8 * prioTab);
 	
@@ -745,6 +774,12 @@ struct GPU
 	void setFinalColor3d(int dstX, int srcX);
 	
 	template<bool BACKDROP, int FUNCNUM> void setFinalColorBG(u16 color, const u32 x);
+
+	//a bg layer collects its pixels here (with bit 15 set where it is opaque), and then they are
+	//windowed, blended and written out a whole line at a time
+	CACHE_ALIGN u16 bgLine[256];
+	void compositeBGLine();
+	template<BlendFunc FUNC> void _compositeBGLine();
 	template<bool MOSAIC, bool BACKDROP> FORCEINLINE void __setFinalColorBck(u16 color, const u32 x, const int opaque);
 	template<bool MOSAIC, bool BACKDROP, int FUNCNUM> FORCEINLINE void ___setFinalColorBck(u16 color, const u32 x, const int opaque);
 
@@ -817,6 +852,31 @@ static void REG_DISPx_pack_test(GPU * gpu)
 
 CACHE_ALIGN extern u8 GPU_screen[4*256*192];
 
+//Besides GPU_screen (RGB555, what savestates keep), the finished lines can also be written out as 32bit colors,
+//so that frontends which display those don't each convert the whole screen every frame.
+//The formats are named by byte order, the alpha byte is always 0xFF.
+enum GPU_OutputFormat
+{
+	GPU_OUTPUT_RGB555, //GPU_screen only
+	GPU_OUTPUT_RGBA8888, //as GL_RGBA/GL_UNSIGNED_BYTE
+	GPU_OUTPUT_BGRA8888 //as agg's bgra32, or a cairo RGB24 or GL_BGRA on little endian hosts
+};
+
+CACHE_ALIGN extern u32 GPU_screen32[256*384];
+
+void GPU_SetOutputFormat(GPU_OutputFormat format);
+GPU_OutputFormat GPU_GetOutputFormat();
+
+//converts all of GPU_screen into GPU_screen32 again, for frontends which write GPU_screen themselves
+void GPU_ConvertScreen();
+
+//With CommonSettings.GFX3D_RenderScale above 1 the finished lines are also written at that many times their size,
+//with the 3d layer taken from the frame the 3d renderer drew at that size and the 2d layers scaled up.
+//The screen is 256*scale pixels wide and 384*scale high, in the 32bit output format (RGBA8888 while that is RGB555).
+//A new scale takes effect from the next frame; until then GPU_GetHighResScale() returns the old one.
+u32 GPU_GetHighResScale();
+const u32* GPU_GetHighResScreen(); //NULL while the scale is 1
+
 
 GPU * GPU_Init(u8 l);
 void GPU_Reset(GPU *g, u8 l);
@@ -863,8 +923,37 @@ int GPU_ChangeGraphicsCore(int coreid);
 
 void GPU_set_DISPCAPCNT(u32 val) ;
 void GPU_RenderLine(NDS_Screen * screen, u16 l, bool skip = false) ;
+
+//renders line l of both engines. when CommonSettings.async_2d is set, the sub engine (and the main engine,
+//if it isnt capturing or showing 3d) is composited on a worker thread while emulation continues.
+//the emulator must call GPU_FinishAsyncLine() before touching anything the 2d engines read or write;
+//GPU_SyncAsyncLine() does that for ARM9 bus writes.
+void GPU_RenderLines(u16 l, bool skip);
+void GPU_FinishAsyncLine();
+
+extern bool gpu_asyncLinePending;
+
+FORCEINLINE void GPU_SyncAsyncLine(u32 adr)
+{
+	if(!gpu_asyncLinePending) return;
+
+	//palette, vram and oam, the 2d engine registers, vram bank control and POWCNT1 (screen swap)
+	const u32 region = adr >> 24;
+	if(region == 5 || region == 6 || region == 7
+		|| (adr >= 0x04000000 && adr < 0x04000070)
+		|| (adr >= 0x04001000 && adr < 0x04001070)
+		|| (adr >= 0x04000240 && adr < 0x0400024A)
+		|| (adr & ~3) == 0x04000304)
+		GPU_FinishAsyncLine();
+}
 void GPU_setMasterBrightness (GPU *gpu, u16 val);
 
+//oam was written at adr: the engine it belongs to bins its sprites again before its next line
+FORCEINLINE void GPU_InvalidateOAM(u32 adr)
+{
+	((adr & ADDRESS_STEP_1KB) ? SubScreen : MainScreen).gpu->sprBinsDirty = true;
+}
+
 inline void GPU_setWIN0_H(GPU* gpu, u16 val) { gpu->WIN0H0 = val >> 8; gpu->WIN0H1 = val&0xFF; gpu->need_update_winh[0] = true; }
 inline void GPU_setWIN0_H0(GPU* gpu, u8 val) { gpu->WIN0H0 = val;  gpu->need_update_winh[0] = true; }
 inline void GPU_setWIN0_H1(GPU* gpu, u8 val) { gpu->WIN0H1 = val;  gpu->need_update_winh[0] = true; }
@@ -921,7 +1010,9 @@ void gpu_SetRotateScreen(u16 angle);
 
 
 //---CUSTOM--->
+#ifdef HOST_WINDOWS
 #include "X432R_BuildSwitch.h"
+#endif
 
 #ifdef X432R_CUSTOMRENDERER_ENABLED
 #include "MMU.h"
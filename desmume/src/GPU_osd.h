@@ -29,7 +29,9 @@
 
 
 //---CUSTOM--->
+#ifdef HOST_WINDOWS
 #include "X432R_BuildSwitch.h"
+#endif
 //<---CUSTOM---
 
 
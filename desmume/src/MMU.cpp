@@ -282,6 +282,10 @@ u8 vram_lcdc_map[VRAM_LCDC_PAGES];
 //this maps to 16KB pages in the LCDC buffer which is what will actually contain the data
 u8 vram_arm9_map[VRAM_ARM9_PAGES];
 
+u8 vram_dirty[VRAM_DIRTY_PAGES];
+u8 vram_engines[VRAM_ENGINE_PAGES];
+u32 gpu_memGeneration[2];
+
 //this chooses which banks are mapped in the 128K banks starting at 0x06000000 in ARM7
 u8 vram_arm7_map[2];
 
@@ -456,6 +460,85 @@ static FORCEINLINE u32 MMU_LCDmap(u32 addr, bool& unmapped, bool& restricted)
 		return LCDC_HACKY_LOCATION + (vram_page<<14) + ofs;
 }
 
+MMU_Page MMU_pages[2][MMU_PAGE_COUNT];
+
+//points the page at adr to the memory the handlers would reach there, if they would do no more than access it
+template<int PROCNUM>
+static void MMU_RemapPage(u32 adr)
+{
+	MMU_Page &page = MMU_pages[PROCNUM][adr >> MMU_PAGE_SHIFT];
+	memset(&page, 0, sizeof(MMU_Page));
+
+	const u32 region = adr >> 24;
+	if(PROCNUM == ARMCPU_ARM9)
+	{
+		if(region < 2)
+		{
+			//itcm is mirrored across the whole range
+			page.target = adr;
+			page.mem = MMU.ARM9_ITCM + (adr & 0x7FFF);
+			page.mask = MMU_PAGE_SIZE-1;
+			return;
+		}
+		if(region == 4 || (region >= 8 && region < 0xF)) return;
+	}
+	else
+	{
+		//the bios is protected, and the rest is io or unused
+		if(region != 2 && region != 3 && region != 6) return;
+	}
+
+	bool unmapped, restricted;
+	const u32 target = MMU_LCDmap<PROCNUM>(adr, unmapped, restricted);
+	if(unmapped) return;
+
+	const u32 mask = (region == 2) ? _MMU_MAIN_MEM_MASK : MMU.MMU_MASK[PROCNUM][target>>20];
+	page.mask = mask & (MMU_PAGE_SIZE-1);
+	page.mem = MMU.MMU_MEM[PROCNUM][target>>20] + (target & mask & ~page.mask);
+	page.target = target;
+
+	if(PROCNUM == ARMCPU_ARM9 && region >= 5 && region <= 7)
+		page.flags = MMU_PAGE_NOWRITE8 | MMU_PAGE_GPU | ((region == 6) ? MMU_PAGE_VRAM : 0) | ((region == 7) ? MMU_PAGE_OAM : 0);
+}
+
+void MMU_RemapPages(u32 region)
+{
+	for(u32 adr = region << 24; adr < (region + 1) << 24; adr += MMU_PAGE_SIZE)
+	{
+		MMU_RemapPage<ARMCPU_ARM9>(adr);
+		MMU_RemapPage<ARMCPU_ARM7>(adr);
+	}
+}
+
+void MMU_RemapAllPages()
+{
+	for(u32 region = 0; region < 16; region++)
+		MMU_RemapPages(region);
+}
+
+//does the side effects of a write through a page and returns where it goes
+template<int PROCNUM>
+static FORCEINLINE u8* MMU_WritePage(const MMU_Page &page, u32 adr)
+{
+	const u32 target = page.target | (adr & page.mask);
+	if(PROCNUM == ARMCPU_ARM9 && (page.flags & MMU_PAGE_GPU))
+	{
+		GPU_SyncAsyncLine(adr);
+		if(page.flags & MMU_PAGE_VRAM)
+			MMU_SetVRAMDirty(target & 0xFFFFF);
+		else
+			MMU_GPUMemWritten((adr & ADDRESS_STEP_1KB) ? 2 : 1); //palette and oam are split between the engines by halves
+		if(page.flags & MMU_PAGE_OAM)
+			GPU_InvalidateOAM(adr);
+	}
+#ifdef HAVE_JIT
+	if (JIT_MAPPED(target, PROCNUM))
+		JIT_INVALIDATE(JIT_COMPILED_FUNC_PREMASKED(target, PROCNUM, 0));
+#endif
+	OPCACHE_INVALIDATE(target);
+	return page.mem + (adr & page.mask);
+}
+
 
 #define LOG_VRAM_ERROR() LOG("No data for block %i MST %i\n", block, VRAMBankCnt & 0x07);
 
@@ -772,6 +855,7 @@ void MMU_VRAM_unmap_all()
 		vram_lcdc_map[i] = VRAM_PAGE_UNMAPPED;
 	for(int i=0;i<VRAM_ARM9_PAGES;i++)
 		vram_arm9_map[i] = VRAM_PAGE_UNMAPPED;
+	memset(vram_engines, 0, sizeof(vram_engines));
 
 	for (int i = 0; i < 4; i++)
 	{
@@ -791,12 +875,43 @@ void MMU_VRAM_unmap_all()
 		MMU.texInfo.textureSlotAddr[i] = MMU.blank_memory;
 }
 
+//marks the vram pages an engine reads from a pointer into ARM9_LCD
+static void MMU_VRAMmapEngine(const u8 *ptr, u8 engine)
+{
+	if(ptr >= MMU.ARM9_LCD && ptr < MMU.ARM9_LCD + VRAM_ENGINE_PAGES*ADDRESS_STEP_16KB)
+		vram_engines[(ptr - MMU.ARM9_LCD) / ADDRESS_STEP_16KB] |= engine;
+}
+
+//finds out which engines read each vram page after the banks were mapped again.
+//as the mapping itself changes what the engines read, it counts as a write to both
+static void MMU_VRAMmapEngines()
+{
+	memset(vram_engines, 0, sizeof(vram_engines));
+
+	//each of the four windows (ABG, BBG, AOBJ, BOBJ) spans 128 pages, mirrors included
+	for(int i=0;i<VRAM_ARM9_PAGES;i++)
+		if(vram_arm9_map[i] != VRAM_PAGE_UNMAPPED)
+			vram_engines[vram_arm9_map[i]] |= (i & VRAM_PAGE_BBG) ? 2 : 1;
+
+	for(int engine=0;engine<2;engine++)
+	{
+		for(int i=0;i<4;i++)
+			MMU_VRAMmapEngine(MMU.ExtPal[engine][i], 1<<engine);
+		for(int i=0;i<2;i++)
+			MMU_VRAMmapEngine(MMU.ObjExtPal[engine][i], 1<<engine);
+	}
+
+	MMU_GPUMemWritten(3);
+}
+
 static inline void MMU_VRAMmapControl(u8 block, u8 VRAMBankCnt)
 {
 	//handle WRAM, first of all
 	if(block == 7)
 	{
 		MMU.WRAMCNT = VRAMBankCnt & 3;
+		opcache_invalidate_region(0x03);
+		MMU_RemapPages(0x03);
 		return;
 	}
 
@@ -805,6 +920,7 @@ static inline void MMU_VRAMmapControl(u8 block, u8 VRAMBankCnt)
 
 	//unmap everything
 	MMU_VRAM_unmap_all();
+	opcache_invalidate_region(0x06);
 
 	//unmap VRAM_BANK_C and VRAM_BANK_D from arm7. theyll get mapped again in a moment if necessary
 	T1WriteByte(MMU.MMU_MEM[ARMCPU_ARM7][0x40], 0x240, 0);
@@ -899,6 +1015,9 @@ static inline void MMU_VRAMmapControl(u8 block, u8 VRAMBankCnt)
 	}
 
 	//-------------------------------
+
+	MMU_VRAMmapEngines();
+	MMU_RemapPages(0x06);
 }
 
 //////////////////////////////////////////////////////////////
@@ -1015,6 +1134,7 @@ void MMU_Reset()
 	SubScreen.offset  = 192;
 	
 	MMU_VRAM_unmap_all();
+	MMU_RemapAllPages();
 
 	MMU.powerMan_CntReg = 0x00;
 	MMU.powerMan_CntRegWritten = FALSE;
@@ -1051,6 +1171,7 @@ void SetupMMU(bool debugConsole, bool dsi) {
 	if(dsi) _MMU_MAIN_MEM_MASK = 0xFFFFFF;
 	_MMU_MAIN_MEM_MASK16 = _MMU_MAIN_MEM_MASK & ~1;
 	_MMU_MAIN_MEM_MASK32 = _MMU_MAIN_MEM_MASK & ~3;
+	MMU_RemapPages(0x02);
 }
 
 static void execsqrt() {
@@ -1073,7 +1194,7 @@ static void execsqrt() {
 	MMU.sqrtCycles = nds_timer + 26;
 	MMU.sqrtResult = ret;
 	MMU.sqrtRunning = TRUE;
-	NDS_Reschedule();
+	NDS_RescheduleSqrt();
 }
 
 static void execdiv() {
@@ -1132,7 +1253,7 @@ static void execdiv() {
 	MMU.divResult = res;
 	MMU.divMod = mod;
 	MMU.divRunning = TRUE;
-	NDS_Reschedule();
+	NDS_RescheduleDivider();
 }
 
 DSI_TSC::DSI_TSC()
@@ -2307,6 +2428,134 @@ void DmaController::exec()
 	driver->DEBUG_UpdateIORegView(BaseDriver::EDEBUG_IOREG_DMA);
 }
 
+//main memory from adr on for len bytes, or NULL when those bytes aren't all in main memory or wrap around one of its mirrors
+static u8* DMA_mainMemory(u32 adr, u32 len)
+{
+	if((adr & 0x0F000000) != 0x02000000) return NULL;
+	const u32 ofs = adr & _MMU_MAIN_MEM_MASK;
+	if(ofs + len > _MMU_MAIN_MEM_MASK + 1) return NULL;
+	return MMU.MAIN_MEM + ofs;
+}
+
+//dma reads from and writes to dtcm are discarded, even where it is patched over main memory
+static bool DMA_hitsDTCM(u32 adr, u32 len)
+{
+	return adr < MMU.DTCMRegion + 0x4000 && MMU.DTCMRegion < adr + len;
+}
+
+//drops the compiled code and the cached opcodes for the bytes a bulk copy stored
+template<int PROCNUM>
+static void DMA_invalidateCode(u32 adr, u32 len, bool mainmem)
+{
+	//the pages of the JIT and of the opcode cache both are 256 bytes
+	for(u32 page = adr & ~0xFF; page < adr + len; page += 0x100)
+	{
+#ifdef HAVE_JIT
+		if(mainmem)
+		{
+			JIT_INVALIDATE(JIT_COMPILED_FUNC_KNOWNBANK(page, MAIN_MEM, _MMU_MAIN_MEM_MASK, 0));
+		}
+		else if(JIT_MAPPED(page, PROCNUM))
+		{
+			JIT_INVALIDATE(JIT_COMPILED_FUNC_PREMASKED(page, PROCNUM, 0));
+		}
+#endif
+		OPCACHE_INVALIDATE(page);
+	}
+}
+
+//Copies or fills a dma from main memory into main memory, or on the arm9 into palette, vram or oam, as bulk runs
+//rather than word by word through the memory map, which for graphics uploads of hundreds of KB a frame adds up.
+//Every byte in these ranges is plain memory, so the only side effects are those done here per run:
+//the access time (the same for every word of a region), dirtying vram, and dropping code stored over.
+//Returns false, having done nothing, for any other dma.
+template<int PROCNUM>
+static bool DMA_bulkCopy(u32 src, u32 dst, u32 todo, u32 sz, u32 srcinc, u32 dstinc, int &time_elapsed)
+{
+	if(dstinc != sz || (srcinc != sz && srcinc != 0)) return false;
+	if((src | dst) & (sz-1)) return false;
+
+	//the debugger and lua watch single accesses
+	if(CheckDebugEvent(DEBUG_EVENT_WRITE)) return false;
+#ifdef HAVE_LUA
+	if(hookedRegions[LUAMEMHOOK_READ].NotEmpty() || hookedRegions[LUAMEMHOOK_WRITE].NotEmpty()) return false;
+#endif
+
+	const u32 bytes = todo * sz;
+	const u32 srclen = srcinc ? bytes : sz;
+	u8* source = DMA_mainMemory(src, srclen);
+	if(!source) return false;
+	if(PROCNUM == ARMCPU_ARM9 && DMA_hitsDTCM(src, srclen)) return false;
+
+	const bool mainmem = (dst & 0x0F000000) == 0x02000000;
+	if(mainmem)
+	{
+		const u8* dest = DMA_mainMemory(dst, bytes);
+		if(!dest) return false;
+		if(PROCNUM == ARMCPU_ARM9 && DMA_hitsDTCM(dst, bytes)) return false;
+		//a copy up into itself repeats what it already copied, word by word
+		if(srcinc && dest > source && dest < source + bytes) return false;
+	}
+	else
+	{
+		const u32 region = (dst >> 24) & 0xF;
+		if(PROCNUM != ARMCPU_ARM9 || region < 5 || region > 7) return false;
+		if((dst & 0x00FFFFFF) + bytes > 0x01000000) return false;
+		GPU_SyncAsyncLine(dst);
+	}
+
+	if(sz == 4)
+		time_elapsed += todo * (_MMU_accesstime<PROCNUM,MMU_AT_DMA,32,MMU_AD_READ,TRUE>(src,true) + _MMU_accesstime<PROCNUM,MMU_AT_DMA,32,MMU_AD_WRITE,TRUE>(dst,true));
+	else
+		time_elapsed += todo * (_MMU_accesstime<PROCNUM,MMU_AT_DMA,16,MMU_AD_READ,TRUE>(src,true) + _MMU_accesstime<PROCNUM,MMU_AT_DMA,16,MMU_AD_WRITE,TRUE>(dst,true));
+
+	const u32 value = (sz == 4) ? T1ReadLong(source, 0) : T1ReadWord(source, 0);
+
+	for(u32 done = 0; done < bytes; )
+	{
+		u32 len = bytes - done;
+		u32 adr = (dst + done) & 0x0FFFFFFF;
+		u8* host;
+		if(mainmem)
+			host = MMU.MAIN_MEM + (adr & _MMU_MAIN_MEM_MASK);
+		else
+		{
+			//vram is mapped by pages, palette and oam are mirrored within them
+			const MMU_Page &page = MMU_pages[ARMCPU_ARM9][adr >> MMU_PAGE_SHIFT];
+			len = std::min(len, MMU_PAGE_SIZE - (adr & (MMU_PAGE_SIZE-1)));
+			if(!page.mem)
+			{
+				done += len;
+				continue;
+			}
+			len = std::min(len, page.mask + 1 - (adr & page.mask));
+			host = page.mem + (adr & page.mask);
+			adr = page.target | (adr & page.mask);
+			if(page.flags & MMU_PAGE_VRAM)
+				MMU_SetVRAMDirty(adr & 0xFFFFF, len);
+			else
+				MMU_GPUMemWritten(3); //a run may span both engines' halves of palette or oam
+			if(page.flags & MMU_PAGE_OAM)
+			{
+				GPU_InvalidateOAM(0);
+				GPU_InvalidateOAM(ADDRESS_STEP_1KB);
+			}
+		}
+
+		if(srcinc)
+			memmove(host, source + done, len);
+		else if(sz == 4)
+			for(u32 i = 0; i < len; i += 4) T1WriteLong(host, i, value);
+		else
+			for(u32 i = 0; i < len; i += 2) T1WriteWord(host, i, value);
+
+		DMA_invalidateCode<PROCNUM>(adr, len, mainmem);
+		done += len;
+	}
+
+	return true;
+}
+
 template<int PROCNUM>
 void DmaController::doCopy()
 {
@@ -2362,7 +2611,10 @@ void DmaController::doCopy()
 	//we might make another function to do just the raw copy op which can use them with checks
 	//outside the loop
 	int time_elapsed = 0;
-	if(sz==4) {
+	if(DMA_bulkCopy<PROCNUM>(src, dst, todo, sz, srcinc, dstinc, time_elapsed)) {
+		src += srcinc * todo;
+		dst += dstinc * todo;
+	} else if(sz==4) {
 		for(s32 i=(s32)todo; i>0; i--)
 		{
 			time_elapsed += _MMU_accesstime<PROCNUM,MMU_AT_DMA,32,MMU_AD_READ,TRUE>(src,true);
@@ -3253,15 +3505,25 @@ void FASTCALL _MMU_ARM9_write08(u32 adr, u8 val)
 
 	mmu_log_debug_ARM9(adr, "(write08) 0x%02X", val);
 
+	const MMU_Page &page = MMU_pages[ARMCPU_ARM9][adr >> MMU_PAGE_SHIFT];
+	if(page.mem && !(page.flags & MMU_PAGE_NOWRITE8))
+	{
+		T1WriteByte(MMU_WritePage<ARMCPU_ARM9>(page, adr), 0, val);
+		return;
+	}
+
 	if(adr < 0x02000000)
 	{
 #ifdef HAVE_JIT
-		JIT_COMPILED_FUNC_KNOWNBANK(adr, ARM9_ITCM, 0x7FFF, 0) = 0;
+		JIT_INVALIDATE(JIT_COMPILED_FUNC_KNOWNBANK(adr, ARM9_ITCM, 0x7FFF, 0));
 #endif
+		OPCACHE_INVALIDATE(adr);
 		T1WriteByte(MMU.ARM9_ITCM, adr & 0x7FFF, val);
 		return;
 	}
 
+	GPU_SyncAsyncLine(adr);
+
 	if (slot2_write<ARMCPU_ARM9, u8>(adr, val))
 		return;
 
@@ -3515,8 +3777,9 @@ void FASTCALL _MMU_ARM9_write08(u32 adr, u8 val)
 
 #ifdef HAVE_JIT
 	if (JIT_MAPPED(adr, ARMCPU_ARM9))
-		JIT_COMPILED_FUNC_PREMASKED(adr, ARMCPU_ARM9, 0) = 0;
+		JIT_INVALIDATE(JIT_COMPILED_FUNC_PREMASKED(adr, ARMCPU_ARM9, 0));
 #endif
+	OPCACHE_INVALIDATE(adr);
 
 	// Removed the &0xFF as they are implicit with the adr&0x0FFFFFFF [shash]
 	MMU.MMU_MEM[ARMCPU_ARM9][adr>>20][adr&MMU.MMU_MASK[ARMCPU_ARM9][adr>>20]]=val;
@@ -3529,15 +3792,25 @@ void FASTCALL _MMU_ARM9_write16(u32 adr, u16 val)
 
 	mmu_log_debug_ARM9(adr, "(write16) 0x%04X", val);
 
+	const MMU_Page &page = MMU_pages[ARMCPU_ARM9][adr >> MMU_PAGE_SHIFT];
+	if(page.mem)
+	{
+		T1WriteWord(MMU_WritePage<ARMCPU_ARM9>(page, adr), 0, val);
+		return;
+	}
+
 	if (adr < 0x02000000)
 	{
 #ifdef HAVE_JIT
-		JIT_COMPILED_FUNC_KNOWNBANK(adr, ARM9_ITCM, 0x7FFF, 0) = 0;
+		JIT_INVALIDATE(JIT_COMPILED_FUNC_KNOWNBANK(adr, ARM9_ITCM, 0x7FFF, 0));
 #endif
+		OPCACHE_INVALIDATE(adr);
 		T1WriteWord(MMU.ARM9_ITCM, adr & 0x7FFF, val);
 		return;
 	}
 
+	GPU_SyncAsyncLine(adr);
+
 	if (slot2_write<ARMCPU_ARM9, u16>(adr, val))
 		return;
 
@@ -3966,10 +4239,15 @@ void FASTCALL _MMU_ARM9_write16(u32 adr, u16 val)
 	adr = MMU_LCDmap<ARMCPU_ARM9>(adr, unmapped, restricted);
 	if(unmapped) return;
 
+	//vram lands in the LCDC range here
+	if((adr>>24) == 6)
+		MMU_SetVRAMDirty(adr & 0xFFFFF);
+
 #ifdef HAVE_JIT
 	if (JIT_MAPPED(adr, ARMCPU_ARM9))
-		JIT_COMPILED_FUNC_PREMASKED(adr, ARMCPU_ARM9, 0) = 0;
+		JIT_INVALIDATE(JIT_COMPILED_FUNC_PREMASKED(adr, ARMCPU_ARM9, 0));
 #endif
+	OPCACHE_INVALIDATE(adr);
 
 	// Removed the &0xFF as they are implicit with the adr&0x0FFFFFFF [shash]
 	T1WriteWord(MMU.MMU_MEM[ARMCPU_ARM9][adr>>20], adr&MMU.MMU_MASK[ARMCPU_ARM9][adr>>20], val);
@@ -3982,16 +4260,25 @@ void FASTCALL _MMU_ARM9_write32(u32 adr, u32 val)
 	
 	mmu_log_debug_ARM9(adr, "(write32) 0x%08X", val);
 
+	const MMU_Page &page = MMU_pages[ARMCPU_ARM9][adr >> MMU_PAGE_SHIFT];
+	if(page.mem)
+	{
+		T1WriteLong(MMU_WritePage<ARMCPU_ARM9>(page, adr), 0, val);
+		return;
+	}
+
 	if(adr<0x02000000)
 	{
 #ifdef HAVE_JIT
-		JIT_COMPILED_FUNC_KNOWNBANK(adr, ARM9_ITCM, 0x7FFF, 0) = 0;
-		JIT_COMPILED_FUNC_KNOWNBANK(adr, ARM9_ITCM, 0x7FFF, 1) = 0;
+		JIT_INVALIDATE(JIT_COMPILED_FUNC_KNOWNBANK(adr, ARM9_ITCM, 0x7FFF, 0));
 #endif
+		OPCACHE_INVALIDATE(adr);
 		T1WriteLong(MMU.ARM9_ITCM, adr & 0x7FFF, val);
 		return ;
 	}
 
+	GPU_SyncAsyncLine(adr);
+
 	if (slot2_write<ARMCPU_ARM9, u32>(adr, val))
 		return;
 
@@ -4397,13 +4684,15 @@ void FASTCALL _MMU_ARM9_write32(u32 adr, u32 val)
 	adr = MMU_LCDmap<ARMCPU_ARM9>(adr, unmapped, restricted);
 	if(unmapped) return;
 
+	//vram lands in the LCDC range here
+	if((adr>>24) == 6)
+		MMU_SetVRAMDirty(adr & 0xFFFFF);
+
 #ifdef HAVE_JIT
 	if (JIT_MAPPED(adr, ARMCPU_ARM9))
-	{
-		JIT_COMPILED_FUNC_PREMASKED(adr, ARMCPU_ARM9, 0) = 0;
-		JIT_COMPILED_FUNC_PREMASKED(adr, ARMCPU_ARM9, 1) = 0;
-	}
+		JIT_INVALIDATE(JIT_COMPILED_FUNC_PREMASKED(adr, ARMCPU_ARM9, 0));
 #endif
+	OPCACHE_INVALIDATE(adr);
 
 	// Removed the &0xFF as they are implicit with the adr&0x0FFFFFFF [shash]
 	T1WriteLong(MMU.MMU_MEM[ARMCPU_ARM9][adr>>20], adr&MMU.MMU_MASK[ARMCPU_ARM9][adr>>20], val);
@@ -4416,6 +4705,10 @@ u8 FASTCALL _MMU_ARM9_read08(u32 adr)
 	
 	mmu_log_debug_ARM9(adr, "(read08) 0x%02X", MMU.MMU_MEM[ARMCPU_ARM9][(adr>>20)&0xFF][adr&MMU.MMU_MASK[ARMCPU_ARM9][(adr>>20)&0xFF]]);
 
+	const MMU_Page &page = MMU_pages[ARMCPU_ARM9][adr >> MMU_PAGE_SHIFT];
+	if(page.mem)
+		return T1ReadByte(page.mem, adr & page.mask);
+
 	if(adr<0x02000000)
 		return T1ReadByte(MMU.ARM9_ITCM, adr&0x7FFF);
 
@@ -4527,6 +4820,10 @@ u16 FASTCALL _MMU_ARM9_read16(u32 adr)
 
 	mmu_log_debug_ARM9(adr, "(read16) 0x%04X", T1ReadWord_guaranteedAligned(MMU.MMU_MEM[ARMCPU_ARM9][adr >> 20], adr & MMU.MMU_MASK[ARMCPU_ARM9][adr >> 20]));
 
+	const MMU_Page &page = MMU_pages[ARMCPU_ARM9][adr >> MMU_PAGE_SHIFT];
+	if(page.mem)
+		return T1ReadWord_guaranteedAligned(page.mem, adr & page.mask);
+
 	if(adr<0x02000000)
 		return T1ReadWord_guaranteedAligned(MMU.ARM9_ITCM, adr & 0x7FFE);	
 
@@ -4640,6 +4937,10 @@ u32 FASTCALL _MMU_ARM9_read32(u32 adr)
 
 	mmu_log_debug_ARM9(adr, "(read32) 0x%08X", T1ReadLong_guaranteedAligned(MMU.MMU_MEM[ARMCPU_ARM9][adr >> 20], adr & MMU.MMU_MASK[ARMCPU_ARM9][adr>>20]));
 
+	const MMU_Page &page = MMU_pages[ARMCPU_ARM9][adr >> MMU_PAGE_SHIFT];
+	if(page.mem)
+		return T1ReadLong_guaranteedAligned(page.mem, adr & page.mask);
+
 	if(adr<0x02000000) 
 		return T1ReadLong_guaranteedAligned(MMU.ARM9_ITCM, adr&0x7FFC);
 
@@ -4786,6 +5087,13 @@ void FASTCALL _MMU_ARM7_write08(u32 adr, u8 val)
 
 	mmu_log_debug_ARM7(adr, "(write08) 0x%02X", val);
 
+	const MMU_Page &page = MMU_pages[ARMCPU_ARM7][adr >> MMU_PAGE_SHIFT];
+	if(page.mem)
+	{
+		T1WriteByte(MMU_WritePage<ARMCPU_ARM7>(page, adr), 0, val);
+		return;
+	}
+
 	if (adr < 0x02000000) return; //can't write to bios or entire area below main memory
 
 	if (slot2_write<ARMCPU_ARM7, u8>(adr, val))
@@ -4878,8 +5186,9 @@ void FASTCALL _MMU_ARM7_write08(u32 adr, u8 val)
 
 #ifdef HAVE_JIT
 	if (JIT_MAPPED(adr, ARMCPU_ARM7))
-		JIT_COMPILED_FUNC_PREMASKED(adr, ARMCPU_ARM7, 0) = 0;
+		JIT_INVALIDATE(JIT_COMPILED_FUNC_PREMASKED(adr, ARMCPU_ARM7, 0));
 #endif
+	OPCACHE_INVALIDATE(adr);
 	
 	// Removed the &0xFF as they are implicit with the adr&0x0FFFFFFF [shash]
 	MMU.MMU_MEM[ARMCPU_ARM7][adr>>20][adr&MMU.MMU_MASK[ARMCPU_ARM7][adr>>20]]=val;
@@ -4892,6 +5201,13 @@ void FASTCALL _MMU_ARM7_write16(u32 adr, u16 val)
 
 	mmu_log_debug_ARM7(adr, "(write16) 0x%04X", val);
 
+	const MMU_Page &page = MMU_pages[ARMCPU_ARM7][adr >> MMU_PAGE_SHIFT];
+	if(page.mem)
+	{
+		T1WriteWord(MMU_WritePage<ARMCPU_ARM7>(page, adr), 0, val);
+		return;
+	}
+
 	if (adr < 0x02000000) return; //can't write to bios or entire area below main memory
 
 	if (slot2_write<ARMCPU_ARM7, u16>(adr, val))
@@ -5060,8 +5376,9 @@ void FASTCALL _MMU_ARM7_write16(u32 adr, u16 val)
 
 #ifdef HAVE_JIT
 	if (JIT_MAPPED(adr, ARMCPU_ARM7))
-		JIT_COMPILED_FUNC_PREMASKED(adr, ARMCPU_ARM7, 0) = 0;
+		JIT_INVALIDATE(JIT_COMPILED_FUNC_PREMASKED(adr, ARMCPU_ARM7, 0));
 #endif
+	OPCACHE_INVALIDATE(adr);
 
 	// Removed the &0xFF as they are implicit with the adr&0x0FFFFFFF [shash]
 	T1WriteWord(MMU.MMU_MEM[ARMCPU_ARM7][adr>>20], adr&MMU.MMU_MASK[ARMCPU_ARM7][adr>>20], val);
@@ -5073,6 +5390,13 @@ void FASTCALL _MMU_ARM7_write32(u32 adr, u32 val)
 
 	mmu_log_debug_ARM7(adr, "(write32) 0x%08X", val);
 
+	const MMU_Page &page = MMU_pages[ARMCPU_ARM7][adr >> MMU_PAGE_SHIFT];
+	if(page.mem)
+	{
+		T1WriteLong(MMU_WritePage<ARMCPU_ARM7>(page, adr), 0, val);
+		return;
+	}
+
 	if (adr < 0x02000000) return; //can't write to bios or entire area below main memory
 
 	if (slot2_write<ARMCPU_ARM7, u32>(adr, val))
@@ -5159,11 +5483,9 @@ void FASTCALL _MMU_ARM7_write32(u32 adr, u32 val)
 
 #ifdef HAVE_JIT
 	if (JIT_MAPPED(adr, ARMCPU_ARM7))
-	{
-		JIT_COMPILED_FUNC_PREMASKED(adr, ARMCPU_ARM7, 0) = 0;
-		JIT_COMPILED_FUNC_PREMASKED(adr, ARMCPU_ARM7, 1) = 0;
-	}
+		JIT_INVALIDATE(JIT_COMPILED_FUNC_PREMASKED(adr, ARMCPU_ARM7, 0));
 #endif
+	OPCACHE_INVALIDATE(adr);
 
 	// Removed the &0xFF as they are implicit with the adr&0x0FFFFFFF [shash]
 	T1WriteLong(MMU.MMU_MEM[ARMCPU_ARM7][adr>>20], adr&MMU.MMU_MASK[ARMCPU_ARM7][adr>>20], val);
@@ -5176,6 +5498,10 @@ u8 FASTCALL _MMU_ARM7_read08(u32 adr)
 
 	mmu_log_debug_ARM7(adr, "(read08) 0x%02X", MMU.MMU_MEM[ARMCPU_ARM7][(adr>>20)&0xFF][adr&MMU.MMU_MASK[ARMCPU_ARM7][(adr>>20)&0xFF]]);
 
+	const MMU_Page &page = MMU_pages[ARMCPU_ARM7][adr >> MMU_PAGE_SHIFT];
+	if(page.mem)
+		return T1ReadByte(page.mem, adr & page.mask);
+
 	if (adr < 0x4000)
 	{
 		//the ARM7 bios can't be read by instructions outside of itself.
@@ -5241,6 +5567,10 @@ u16 FASTCALL _MMU_ARM7_read16(u32 adr)
 
 	mmu_log_debug_ARM7(adr, "(read16) 0x%04X", T1ReadWord(MMU.MMU_MEM[ARMCPU_ARM7][(adr>>20)&0xFF], adr & MMU.MMU_MASK[ARMCPU_ARM7][(adr>>20)&0xFF]));
 
+	const MMU_Page &page = MMU_pages[ARMCPU_ARM7][adr >> MMU_PAGE_SHIFT];
+	if(page.mem)
+		return T1ReadWord_guaranteedAligned(page.mem, adr & page.mask);
+
 	if (adr < 0x4000)
 	{
 		if (NDS_ARM7.instruct_adr > 0x3FFF)
@@ -5337,6 +5667,10 @@ u32 FASTCALL _MMU_ARM7_read32(u32 adr)
 
 	mmu_log_debug_ARM7(adr, "(read32) 0x%08X", T1ReadLong(MMU.MMU_MEM[ARMCPU_ARM7][(adr>>20)&0xFF], adr & MMU.MMU_MASK[ARMCPU_ARM7][(adr>>20)&0xFF]));
 
+	const MMU_Page &page = MMU_pages[ARMCPU_ARM7][adr >> MMU_PAGE_SHIFT];
+	if(page.mem)
+		return T1ReadLong_guaranteedAligned(page.mem, adr & page.mask);
+
 	if (adr < 0x4000)
 	{
 		//the ARM7 bios can't be read by instructions outside of itself.
@@ -32,6 +32,7 @@
 #ifdef HAVE_JIT
 #include "arm_jit.h"
 #endif
+#include "opcache.h"
 
 #define ARMCPU_ARM7 1
 #define ARMCPU_ARM9 0
@@ -562,6 +563,46 @@ extern VramConfiguration vramConfiguration;
 
 #define VRAM_ARM9_PAGES 512
 extern u8 vram_arm9_map[VRAM_ARM9_PAGES];
+
+//one flag per 4KB of ARM9_LCD, raised by everything that writes vram (the arm9 and its dma, display capture).
+//the texture cache collects and clears them to learn which of its textures need checking again
+#define VRAM_DIRTY_PAGE_SHIFT 12
+#define VRAM_DIRTY_PAGES (0xA4000>>VRAM_DIRTY_PAGE_SHIFT)
+extern u8 vram_dirty[VRAM_DIRTY_PAGES];
+
+//which 2d engines read each 16KB page of ARM9_LCD, as vram is mapped now (bit 0 for the main engine, bit 1 for the sub)
+#define VRAM_ENGINE_PAGES (0xA4000>>14)
+extern u8 vram_engines[VRAM_ENGINE_PAGES];
+
+//counts the writes to what each 2d engine reads: its half of palette and oam, and the vram mapped to it.
+//a line rendered from the same registers at the same generation comes out the same (see GPU_RenderLine)
+extern u32 gpu_memGeneration[2];
+
+FORCEINLINE void MMU_GPUMemWritten(u32 engines)
+{
+	gpu_memGeneration[0] += engines & 1;
+	gpu_memGeneration[1] += engines >> 1;
+}
+
+FORCEINLINE void MMU_SetVRAMDirty(u32 lcdc_ofs, u32 len)
+{
+	u32 last = (lcdc_ofs+len-1)>>VRAM_DIRTY_PAGE_SHIFT;
+	if(last >= VRAM_DIRTY_PAGES) last = VRAM_DIRTY_PAGES-1;
+	for(u32 page=lcdc_ofs>>VRAM_DIRTY_PAGE_SHIFT;page<=last;page++)
+		vram_dirty[page] = 1;
+
+	u32 engines = 0;
+	for(u32 page=lcdc_ofs>>14;page<=(last>>(14-VRAM_DIRTY_PAGE_SHIFT));page++)
+		engines |= vram_engines[page];
+	MMU_GPUMemWritten(engines);
+}
+
+//a single write
+FORCEINLINE void MMU_SetVRAMDirty(u32 lcdc_ofs)
+{
+	vram_dirty[lcdc_ofs>>VRAM_DIRTY_PAGE_SHIFT] = 1;
+	MMU_GPUMemWritten(vram_engines[lcdc_ofs>>14]);
+}
 FORCEINLINE void* MMU_gpu_map(u32 vram_addr)
 {
 	//this is supposed to map a single gpu vram address to emulator host memory
@@ -619,6 +660,36 @@ extern u32 _MMU_MAIN_MEM_MASK16;
 extern u32 _MMU_MAIN_MEM_MASK32;
 void SetupMMU(bool debugConsole, bool dsi);
 
+//Each cpu's memory map in 16KB pages (the granularity of vram and wram mapping), so that the handlers reach
+//plain memory with one lookup instead of going through their checks for io, slot-2 and vram mapping.
+//Pages without host memory (io, slot-2, unmapped, and the protected arm7 bios) keep going through the handlers.
+//Dtcm isn't in here; the callers check it first, as it is patched over the map.
+#define MMU_PAGE_SHIFT 14
+#define MMU_PAGE_SIZE (1 << MMU_PAGE_SHIFT)
+#define MMU_PAGE_COUNT (0x10000000 >> MMU_PAGE_SHIFT)
+
+enum
+{
+	MMU_PAGE_NOWRITE8 = 1, //8bit writes are dropped (by the handlers)
+	MMU_PAGE_GPU = 2, //writes are read by the 2d engines
+	MMU_PAGE_VRAM = 4, //writes dirty vram
+	MMU_PAGE_OAM = 8, //writes change the sprites
+};
+
+struct MMU_Page
+{
+	u8 *mem; //host memory of the page, or NULL if the handlers must do the access
+	u32 target; //where the page is mapped to, as the JIT and the opcode cache know the code in it
+	u16 mask; //of an address within mem
+	u16 flags;
+};
+
+extern MMU_Page MMU_pages[2][MMU_PAGE_COUNT];
+
+//rebuilds the pages of a 16MB region of both cpus, after its mapping changed
+void MMU_RemapPages(u32 region);
+void MMU_RemapAllPages();
+
 FORCEINLINE void CheckMemoryDebugEvent(EDEBUG_EVENT event, const MMU_ACCESS_TYPE type, const u32 procnum, const u32 addr, const u32 size, const u32 val)
 {
 	//TODO - ugh work out a better prefetch event system
@@ -811,8 +882,9 @@ FORCEINLINE void _MMU_write08(const int PROCNUM, const MMU_ACCESS_TYPE AT, const
 
 	if ( (addr & 0x0F000000) == 0x02000000) {
 #ifdef HAVE_JIT
-		JIT_COMPILED_FUNC_KNOWNBANK(addr, MAIN_MEM, _MMU_MAIN_MEM_MASK, 0) = 0;
+		JIT_INVALIDATE(JIT_COMPILED_FUNC_KNOWNBANK(addr, MAIN_MEM, _MMU_MAIN_MEM_MASK, 0));
 #endif
+		OPCACHE_INVALIDATE(addr);
 		T1WriteByte( MMU.MAIN_MEM, addr & _MMU_MAIN_MEM_MASK, val);
 #ifdef HAVE_LUA
 		CallRegisteredLuaMemHook(addr, 1, val, LUAMEMHOOK_WRITE);
@@ -850,8 +922,9 @@ FORCEINLINE void _MMU_write16(const int PROCNUM, const MMU_ACCESS_TYPE AT, const
 
 	if ( (addr & 0x0F000000) == 0x02000000) {
 #ifdef HAVE_JIT
-		JIT_COMPILED_FUNC_KNOWNBANK(addr, MAIN_MEM, _MMU_MAIN_MEM_MASK16, 0) = 0;
+		JIT_INVALIDATE(JIT_COMPILED_FUNC_KNOWNBANK(addr, MAIN_MEM, _MMU_MAIN_MEM_MASK16, 0));
 #endif
+		OPCACHE_INVALIDATE(addr);
 		T1WriteWord( MMU.MAIN_MEM, addr & _MMU_MAIN_MEM_MASK16, val);
 #ifdef HAVE_LUA
 		CallRegisteredLuaMemHook(addr, 2, val, LUAMEMHOOK_WRITE);
@@ -889,9 +962,9 @@ FORCEINLINE void _MMU_write32(const int PROCNUM, const MMU_ACCESS_TYPE AT, const
 
 	if ( (addr & 0x0F000000) == 0x02000000) {
 #ifdef HAVE_JIT
-		JIT_COMPILED_FUNC_KNOWNBANK(addr, MAIN_MEM, _MMU_MAIN_MEM_MASK32, 0) = 0;
-		JIT_COMPILED_FUNC_KNOWNBANK(addr, MAIN_MEM, _MMU_MAIN_MEM_MASK32, 1) = 0;
+		JIT_INVALIDATE(JIT_COMPILED_FUNC_KNOWNBANK(addr, MAIN_MEM, _MMU_MAIN_MEM_MASK32, 0));
 #endif
+		OPCACHE_INVALIDATE(addr);
 		T1WriteLong( MMU.MAIN_MEM, addr & _MMU_MAIN_MEM_MASK32, val);
 #ifdef HAVE_LUA
 		CallRegisteredLuaMemHook(addr, 4, val, LUAMEMHOOK_WRITE);
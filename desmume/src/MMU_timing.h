@@ -228,6 +228,9 @@ public:
 	}
 	FetchAccessUnit() { this->Reset(); }
 
+	// for the jit, which inlines accesses whose time doesn't depend on this
+	u32* lastAddressPtr() { return &m_lastAddress; }
+
 	void savestate(EMUFILE* os, int version)
 	{
 		write32le(m_lastAddress,os);
@@ -28,6 +28,7 @@
 #include "utils/decrypt/crc.h"
 #include "utils/advanscene.h"
 #include "utils/task.h"
+#include "utils/perftimer.h"
 
 #include "common.h"
 #include "armcpu.h"
@@ -97,6 +98,33 @@ int TotalLagFrames;
 
 TSCalInfo TSCal;
 
+NDS_SubsystemProfile nds_profile;
+
+NDS_SubsystemProfile::NDS_SubsystemProfile()
+	: enabled(false)
+{
+	reset();
+}
+
+void NDS_SubsystemProfile::reset()
+{
+	for(int i=0;i<=NDS_PROFILE_COUNT;i++)
+		ticks[i] = 0;
+	current = NDS_PROFILE_OUTSIDE;
+	lastTicks = getPerfTicks();
+}
+
+NDS_PROFILE_SUBSYSTEM NDS_SubsystemProfile::enter(NDS_PROFILE_SUBSYSTEM which)
+{
+	const u64 now = getPerfTicks();
+	ticks[current] += now - lastTicks;
+	lastTicks = now;
+
+	const NDS_PROFILE_SUBSYSTEM prev = current;
+	current = which;
+	return prev;
+}
+
 namespace DLDI
 {
 	bool tryPatch(void* data, size_t size, unsigned int device);
@@ -204,6 +232,8 @@ void NDS_DeInit(void)
 	arm_jit_close();
 #endif
 
+	JobPool_Shutdown();
+
 #ifdef LOG_ARM7
 	if (fp_dis7 != NULL) 
 	{
@@ -1094,10 +1124,140 @@ struct TSequenceItem_sqrtunit : public TSequenceItem
 
 };
 
+//the events of the sequencer, in the order execHardware runs them when several are due at once
+enum ESequenceEvent
+{
+	ESE_DISPCNT, ESE_WIFI, ESE_DIVIDER, ESE_SQRT, ESE_GXFIFO,
+	ESE_DMA, //8 channels, 4 for each cpu
+	ESE_TIMER = ESE_DMA+8, //8 timers, 4 for each cpu
+	ESE_COUNT = ESE_TIMER+8
+};
+
+#define ESE_BIT(ev) (1<<(ev))
+#define ESE_ALL (ESE_BIT(ESE_COUNT)-1)
+
+//The pending events, earliest first, as a binary heap indexed by event so that any of them can be moved or dropped in place.
+//Ties go to the event which comes first in ESequenceEvent.
+class EventHeap
+{
+public:
+	EventHeap() { clear(); }
+
+	void clear()
+	{
+		count = 0;
+		for(int i = 0; i < ESE_COUNT; i++)
+			pos[i] = -1;
+	}
+
+	//schedules an event, or moves it if it is scheduled already
+	void set(int ev, u64 time)
+	{
+		int i = pos[ev];
+		if(i < 0)
+		{
+			i = count++;
+			heap[i].ev = ev;
+			heap[i].time = time;
+			pos[ev] = i;
+			up(i);
+			return;
+		}
+		const u64 old = heap[i].time;
+		heap[i].time = time;
+		if(time < old) up(i);
+		else down(i);
+	}
+
+	void remove(int ev)
+	{
+		const int i = pos[ev];
+		if(i < 0) return;
+		pos[ev] = -1;
+		if(i == --count) return;
+		heap[i] = heap[count];
+		pos[heap[i].ev] = i;
+		up(i);
+		down(pos[heap[i].ev]);
+	}
+
+	u64 next() const { return count ? heap[0].time : kNever; }
+
+	//the events due at 'now', as ESE_BITs
+	u32 due(u64 now) const
+	{
+		u32 mask = 0;
+		collect(0, now, mask);
+		return mask;
+	}
+
+private:
+	struct Node
+	{
+		u64 time;
+		int ev;
+	};
+
+	Node heap[ESE_COUNT];
+	int pos[ESE_COUNT];
+	int count;
+
+	FORCEINLINE bool before(const Node &a, const Node &b) const
+	{
+		return a.time < b.time || (a.time == b.time && a.ev < b.ev);
+	}
+
+	void swap(int i, int j)
+	{
+		const Node tmp = heap[i];
+		heap[i] = heap[j];
+		heap[j] = tmp;
+		pos[heap[i].ev] = i;
+		pos[heap[j].ev] = j;
+	}
+
+	void up(int i)
+	{
+		while(i > 0 && before(heap[i], heap[(i-1)/2]))
+		{
+			swap(i, (i-1)/2);
+			i = (i-1)/2;
+		}
+	}
+
+	void down(int i)
+	{
+		for(;;)
+		{
+			int least = i;
+			const int left = 2*i+1, right = 2*i+2;
+			if(left < count && before(heap[left], heap[least])) least = left;
+			if(right < count && before(heap[right], heap[least])) least = right;
+			if(least == i) return;
+			swap(i, least);
+			i = least;
+		}
+	}
+
+	void collect(int i, u64 now, u32 &mask) const
+	{
+		if(i >= count || heap[i].time > now) return;
+		mask |= ESE_BIT(heap[i].ev);
+		collect(2*i+1, now, mask);
+		collect(2*i+2, now, mask);
+	}
+};
+
 struct Sequencer
 {
 	bool nds_vblankEnded;
 	bool reschedule;
+
+	//The components don't put their events into the heap themselves: they keep their own timestamps, which they
+	//may still adjust after notifying us (see DmaController::doCopy), so a notification (NDS_RescheduleDMA and the like)
+	//only marks the events dirty, and those are read back from the components the next time the heap is consulted.
+	EventHeap events;
+	u32 dirty;
 	TSequenceItem dispcnt;
 	TSequenceItem wifi;
 	TSequenceItem_divider divider;
@@ -1117,6 +1277,11 @@ struct Sequencer
 	void execHardware();
 	u64 findNext();
 
+	//whether an event is pending, and when it is due
+	bool pending(int ev, u64 &time);
+	void refresh();
+	void exec(int ev);
+
 	void save(EMUFILE* os)
 	{
 		write64le(nds_timer,os);
@@ -1152,6 +1317,9 @@ struct Sequencer
 		LOAD(dma,1,0); LOAD(dma,1,1); LOAD(dma,1,2); LOAD(dma,1,3); 
 #undef LOAD
 
+		events.clear();
+		dirty = ESE_ALL;
+
 		return true;
 	}
 
@@ -1164,6 +1332,7 @@ void NDS_RescheduleGXFIFO(u32 cost)
 		sequencer.gxfifo.enabled = true;
 	}
 	MMU.gfx3dCycles += cost;
+	sequencer.dirty |= ESE_BIT(ESE_GXFIFO);
 	NDS_Reschedule();
 }
 
@@ -1174,14 +1343,26 @@ void NDS_RescheduleTimers()
 	check(1,0); check(1,1); check(1,2); check(1,3);
 #undef check
 
+	sequencer.dirty |= ESE_BIT(ESE_TIMER+8) - ESE_BIT(ESE_TIMER);
 	NDS_Reschedule();
 }
 
 void NDS_RescheduleDMA()
 {
-	//TBD
+	sequencer.dirty |= ESE_BIT(ESE_DMA+8) - ESE_BIT(ESE_DMA);
 	NDS_Reschedule();
+}
 
+void NDS_RescheduleDivider()
+{
+	sequencer.dirty |= ESE_BIT(ESE_DIVIDER);
+	NDS_Reschedule();
+}
+
+void NDS_RescheduleSqrt()
+{
+	sequencer.dirty |= ESE_BIT(ESE_SQRT);
+	NDS_Reschedule();
 }
 
 static void initSchedule()
@@ -1236,17 +1417,12 @@ void Sequencer::init()
 	#else
 	wifi.enabled = false;
 	#endif
+
+	events.clear();
+	dirty = ESE_ALL;
 }
 
 //this isnt helping much right now. work on it later
-//#include "utils/task.h"
-//Task taskSubGpu(true);
-//void* renderSubScreen(void*)
-//{
-//	GPU_RenderLine(&SubScreen, nds.VCount, SkipCur2DFrame);
-//	return NULL;
-//}
-
 #if defined(_MSC_VER) && (_MSC_VER >= 1700)
 #ifdef X432R_PPL_TEST
 #include <ppl.h>
@@ -1262,11 +1438,13 @@ static void execHardware_hblank()
 	//scroll regs for the next scanline
 	if(nds.VCount<192)
 	{
-		//taskSubGpu.execute(renderSubScreen,NULL);
+		NDS_ProfileScope profileScope(NDS_PROFILE_GPU2D);
+
 		#ifndef X432R_CUSTOMRENDERER_ENABLED
-		GPU_RenderLine(&MainScreen, nds.VCount, frameSkipper.ShouldSkip2D());
-		GPU_RenderLine(&SubScreen, nds.VCount, frameSkipper.ShouldSkip2D());
+		GPU_RenderLines(nds.VCount, frameSkipper.ShouldSkip2D());
 		#else
+		//the per-line params are shared with a line that may still be rendering
+		GPU_FinishAsyncLine();
 		X432R::backBuffer.UpdateRenderLineParams( nds.VCount, frameSkipper.ShouldSkip2D() );
 		
 		#ifdef X432R_PROCESSTIME_CHECK
@@ -1274,8 +1452,7 @@ static void execHardware_hblank()
 		#endif
 		
 		#if !defined(_MSC_VER) || (_MSC_VER < 1700) || !defined(X432R_PPL_TEST2)
-		GPU_RenderLine( &MainScreen, nds.VCount, frameSkipper.ShouldSkip2D() );
-		GPU_RenderLine( &SubScreen, nds.VCount, frameSkipper.ShouldSkip2D() );
+		GPU_RenderLines( nds.VCount, frameSkipper.ShouldSkip2D() );
 		#else
 		concurrency::parallel_invoke
 		(
@@ -1284,7 +1461,6 @@ static void execHardware_hblank()
 		);
 		#endif
 		#endif
-		//taskSubGpu.finish();
 
 		//trigger hblank dmas
 		//but notice, we do that just after we finished drawing the line
@@ -1318,7 +1494,10 @@ static void execHardware_hblank()
 
 	//emulation housekeeping. for some reason we always do this at hblank,
 	//even though it sounds more reasonable to do it at hstart
-	SPU_Emulate_core();
+	{
+		NDS_ProfileScope profileScope(NDS_PROFILE_SPU);
+		SPU_Emulate_core();
+	}
 	driver->AVI_SoundUpdate(SPU_core->outbuf,spu_core_samples);
 	WAV_WavSoundUpdate(SPU_core->outbuf,spu_core_samples);
 }
@@ -1340,6 +1519,9 @@ static void execHardware_hstart_vblankStart()
 {
 	//printf("--------VBLANK!!!--------\n");
 
+	//the frame is complete once the last deferred line is; everything from here on may read GPU_screen
+	GPU_FinishAsyncLine();
+
 	//fire vblank interrupts if necessary
 	for(int i=0;i<2;i++)
 		if(MMU.reg_IF_pending[i] & (1<<IRQ_BIT_LCD_VBLANK))
@@ -1508,6 +1690,10 @@ void NDS_Reschedule()
 {
 	IF_DEVELOPER(if(!sequencer.reschedule) DEBUG_statistics.sequencerExecutionCounters[0]++;);
 	sequencer.reschedule = true;
+#ifdef HAVE_JIT
+	//make chained jit blocks return to armInnerLoop
+	arm_jit_link_budget[0] = arm_jit_link_budget[1] = 0;
+#endif
 }
 
 FORCEINLINE u32 _fast_min32(u32 a, u32 b, u32 c, u32 d)
@@ -1540,36 +1726,55 @@ FORCEINLINE u64 _fast_min(u64 a, u64 b)
 
 
 
-u64 Sequencer::findNext()
+bool Sequencer::pending(int ev, u64 &time)
 {
+	switch(ev)
+	{
 	//this one is always enabled so dont bother to check it
-	u64 next = dispcnt.next();
-
-	if(divider.isEnabled()) next = _fast_min(next,divider.next());
-	if(sqrtunit.isEnabled()) next = _fast_min(next,sqrtunit.next());
-	if(gxfifo.enabled) next = _fast_min(next,gxfifo.next());
-
+	case ESE_DISPCNT: time = dispcnt.next(); return true;
 #ifdef EXPERIMENTAL_WIFI_COMM
-	next = _fast_min(next,wifi.next());
+	case ESE_WIFI: time = wifi.next(); return wifi.enabled;
 #endif
+	case ESE_DIVIDER: time = divider.next(); return divider.isEnabled();
+	case ESE_SQRT: time = sqrtunit.next(); return sqrtunit.isEnabled();
+	case ESE_GXFIFO: time = gxfifo.next(); return gxfifo.enabled;
 
-#define test(X,Y) if(dma_##X##_##Y .isEnabled()) next = _fast_min(next,dma_##X##_##Y .next());
+#define test(X,Y) case ESE_DMA+X*4+Y: time = dma_##X##_##Y .next(); return dma_##X##_##Y .isEnabled();
 	test(0,0); test(0,1); test(0,2); test(0,3);
 	test(1,0); test(1,1); test(1,2); test(1,3);
 #undef test
-#define test(X,Y) if(timer_##X##_##Y .enabled) next = _fast_min(next,timer_##X##_##Y .next());
+#define test(X,Y) case ESE_TIMER+X*4+Y: time = timer_##X##_##Y .next(); return timer_##X##_##Y .enabled;
 	test(0,0); test(0,1); test(0,2); test(0,3);
 	test(1,0); test(1,1); test(1,2); test(1,3);
 #undef test
+	}
 
-	return next;
+	return false;
 }
 
-void Sequencer::execHardware()
+//reads the dirty events back from their components
+void Sequencer::refresh()
 {
-	if(dispcnt.isTriggered())
+	for(int ev = 0; dirty; ev++, dirty >>= 1)
 	{
+		if(!(dirty & 1)) continue;
+		u64 time;
+		if(pending(ev, time)) events.set(ev, time);
+		else events.remove(ev);
+	}
+}
 
+u64 Sequencer::findNext()
+{
+	refresh();
+	return events.next();
+}
+
+void Sequencer::exec(int ev)
+{
+	switch(ev)
+	{
+	case ESE_DISPCNT:
 		IF_DEVELOPER(DEBUG_statistics.sequencerExecutionCounters[1]++);
 
 		switch(dispcnt.param)
@@ -1605,29 +1810,51 @@ void Sequencer::execHardware()
 			dispcnt.param = ESI_DISPCNT_HStart;
 			break;
 		}
-	}
+		break;
 
 #ifdef EXPERIMENTAL_WIFI_COMM
-	if(wifi.isTriggered())
-	{
+	case ESE_WIFI:
 		WIFI_usTrigger();
 		wifi.timestamp += kWifiCycles;
-	}
+		break;
 #endif
 	
-	if(divider.isTriggered()) divider.exec();
-	if(sqrtunit.isTriggered()) sqrtunit.exec();
-	if(gxfifo.isTriggered()) gxfifo.exec();
-
+	case ESE_DIVIDER: divider.exec(); break;
+	case ESE_SQRT: sqrtunit.exec(); break;
+	case ESE_GXFIFO: gxfifo.exec(); break;
 
-#define test(X,Y) if(dma_##X##_##Y .isTriggered()) dma_##X##_##Y .exec();
+#define test(X,Y) case ESE_DMA+X*4+Y: dma_##X##_##Y .exec(); break;
 	test(0,0); test(0,1); test(0,2); test(0,3);
 	test(1,0); test(1,1); test(1,2); test(1,3);
 #undef test
-#define test(X,Y) if(timer_##X##_##Y .enabled) if(timer_##X##_##Y .isTriggered()) timer_##X##_##Y .exec();
+#define test(X,Y) case ESE_TIMER+X*4+Y: timer_##X##_##Y .exec(); break;
 	test(0,0); test(0,1); test(0,2); test(0,3);
 	test(1,0); test(1,1); test(1,2); test(1,3);
 #undef test
+	}
+}
+
+void Sequencer::execHardware()
+{
+	refresh();
+
+	//runs the due events in the order of ESequenceEvent. an event which comes due while running the ones before it
+	//(such as an hblank dma) still runs in this pass, one which comes due while running the ones after it waits for the next
+	u32 after = ESE_ALL;
+	for(;;)
+	{
+		const u32 due = events.due(nds_timer) & after;
+		if(!due) break;
+
+		int ev = 0;
+		while(!(due & ESE_BIT(ev))) ev++;
+
+		exec(ev);
+		after = ESE_ALL & ~(ESE_BIT(ev+1)-1);
+
+		dirty |= ESE_BIT(ev);
+		refresh();
+	}
 }
 
 void execHardware_interrupts();
@@ -1763,6 +1990,21 @@ static FORCEINLINE s32 minarmtime(s32 arm9, s32 arm7)
 		return arm7;
 }
 
+//a cpu in a busy wait can't see anything new until an event fires or the other cpu writes to memory,
+//so it skips ahead to the next event, or only as far as the other cpu has got if that one is still running.
+//the other cpu then catches up and runs just as it would have, and the loop is tried again once it is behind
+template<bool doother>
+static FORCEINLINE s32 skipIdleLoop(const int proc, const s32 s32next, const s32 self, const s32 other, const armcpu_t &othercpu)
+{
+	s32 target = s32next;
+	if(doother && !othercpu.waitIRQ && !nds.freezeBus && !othercpu.idleLoop)
+		target = min(target, other);
+	if(target <= self)
+		return self;
+	nds.idleCycles[proc] += target-self;
+	return target;
+}
+
 #ifdef HAVE_JIT
 template<bool doarm9, bool doarm7, bool jit>
 #else
@@ -1780,11 +2022,15 @@ static /*donotinline*/ std::pair<s32,s32> armInnerLoop(
 			{
 				arm9log();
 				debug();
+				NDS_ARM9.idleLoop = FALSE;
 #ifdef HAVE_JIT
-				arm9 += armcpu_exec<ARMCPU_ARM9,jit>();
+				//linked blocks may run on until the arm7 would have had its turn, or the next event is due
+				arm9 += armcpu_exec<ARMCPU_ARM9,jit>((doarm7 ? min(s32next, arm7) : s32next) - arm9);
 #else
 				arm9 += armcpu_exec<ARMCPU_ARM9>();
 #endif
+				if(NDS_ARM9.idleLoop)
+					arm9 = skipIdleLoop<doarm7>(ARMCPU_ARM9, s32next, arm9, arm7, NDS_ARM7);
 				#ifdef DEVELOPER
 					nds_debug_continuing[0] = false;
 				#endif
@@ -1802,11 +2048,15 @@ static /*donotinline*/ std::pair<s32,s32> armInnerLoop(
 			if(!NDS_ARM7.waitIRQ&&!nds.freezeBus)
 			{
 				arm7log();
+				NDS_ARM7.idleLoop = FALSE;
 #ifdef HAVE_JIT
-				arm7 += (armcpu_exec<ARMCPU_ARM7,jit>()<<1);
+				//the same for the arm7, whose cycles count twice here
+				arm7 += (armcpu_exec<ARMCPU_ARM7,jit>(((doarm9 ? min(s32next, arm9) : s32next) - arm7 + 1) >> 1)<<1);
 #else
 				arm7 += (armcpu_exec<ARMCPU_ARM7>()<<1);
 #endif
+				if(NDS_ARM7.idleLoop)
+					arm7 = skipIdleLoop<doarm9>(ARMCPU_ARM7, s32next, arm7, arm9, NDS_ARM9);
 				#ifdef DEVELOPER
 					nds_debug_continuing[1] = false;
 				#endif
@@ -1861,6 +2111,8 @@ void NDS_exec(s32 nb)
 	gdbstub_mutex_lock();
 	#endif
 
+	NDS_ProfileScope profileScope(NDS_PROFILE_OTHER);
+
 	LagFrameFlag=1;
 
 	sequencer.nds_vblankEnded = false;
@@ -1928,6 +2180,9 @@ void NDS_exec(s32 nb)
 
 			sequencer.reschedule = false;
 
+			//the events may have changed what a busy waiting cpu polls, so it has to go around its loop again
+			NDS_ARM9.idleLoop = NDS_ARM7.idleLoop = FALSE;
+
 			//cast these down to 32bits so that things run faster on 32bit procs
 			u64 nds_timer_base = nds_timer;
 			s32 arm9 = (s32)(nds_arm9_timer-nds_timer);
@@ -1941,13 +2196,17 @@ void NDS_exec(s32 nb)
 				}
 			#endif
 
+			std::pair<s32,s32> arm9arm7;
+			{
+				NDS_ProfileScope cpuProfileScope(NDS_PROFILE_CPU);
 #ifdef HAVE_JIT
-			std::pair<s32,s32> arm9arm7 = CommonSettings.use_jit
-				? armInnerLoop<true,true,true>(nds_timer_base,s32next,arm9,arm7)
-				: armInnerLoop<true,true,false>(nds_timer_base,s32next,arm9,arm7);
+				arm9arm7 = CommonSettings.use_jit
+					? armInnerLoop<true,true,true>(nds_timer_base,s32next,arm9,arm7)
+					: armInnerLoop<true,true,false>(nds_timer_base,s32next,arm9,arm7);
 #else
-				std::pair<s32,s32> arm9arm7 = armInnerLoop<true,true>(nds_timer_base,s32next,arm9,arm7);
+				arm9arm7 = armInnerLoop<true,true>(nds_timer_base,s32next,arm9,arm7);
 #endif
+			}
 
 			#ifdef DEVELOPER
 				if(singleStep)
@@ -2495,6 +2754,8 @@ void NDS_Reset()
 
 	#ifdef HAVE_JIT
 		arm_jit_reset(CommonSettings.use_jit);
+	#else
+		opcache_reset();
 	#endif
 
 
@@ -23,6 +23,7 @@
 #include <string>
 
 #include "types.h"
+#include "utils/jobpool.h"
 
 class BaseDriver;
 class CFIRMWARE;
@@ -149,6 +150,8 @@ void NDS_Reschedule();
 void NDS_RescheduleGXFIFO(u32 cost);
 void NDS_RescheduleDMA();
 void NDS_RescheduleTimers();
+void NDS_RescheduleDivider();
+void NDS_RescheduleSqrt();
 
 enum ENSATA_HANDSHAKE
 {
@@ -468,6 +471,58 @@ void NDS_SetupDefaultFirmware();
 
 template<bool FORCE> void NDS_exec(s32 nb = 560190<<1);
 
+//host time spent in each emulator subsystem, for benchmarking frontends.
+//time is attributed exclusively: while the 2d engine waits on the 3d renderer, that wait counts as 3d.
+//nothing is measured unless enabled, so regular frontends only pay for a branch at each call site.
+enum NDS_PROFILE_SUBSYSTEM
+{
+	NDS_PROFILE_OTHER = 0, //sequencer, dma, geometry engine and everything else in NDS_exec
+	NDS_PROFILE_CPU,
+	NDS_PROFILE_GPU2D,
+	NDS_PROFILE_GPU3D,
+	NDS_PROFILE_SPU,
+	NDS_PROFILE_COUNT,
+
+	//time spent outside of the emulator (in the frontend) is collected here and not reported
+	NDS_PROFILE_OUTSIDE = NDS_PROFILE_COUNT
+};
+
+struct NDS_SubsystemProfile
+{
+	NDS_SubsystemProfile();
+
+	bool enabled;
+	u64 ticks[NDS_PROFILE_COUNT+1];
+
+	//start attributing time to <which>; returns whatever was being attributed before
+	NDS_PROFILE_SUBSYSTEM enter(NDS_PROFILE_SUBSYSTEM which);
+	void reset();
+
+private:
+	NDS_PROFILE_SUBSYSTEM current;
+	u64 lastTicks;
+};
+
+extern NDS_SubsystemProfile nds_profile;
+
+//attributes the host time spent in its scope to one subsystem
+class NDS_ProfileScope
+{
+public:
+	NDS_ProfileScope(NDS_PROFILE_SUBSYSTEM which)
+		: active(nds_profile.enabled)
+	{
+		if(active) prev = nds_profile.enter(which);
+	}
+	~NDS_ProfileScope()
+	{
+		if(active) nds_profile.enter(prev);
+	}
+private:
+	bool active;
+	NDS_PROFILE_SUBSYSTEM prev;
+};
+
 extern int lagframecounter;
 
 extern struct TCommonSettings {
@@ -480,6 +535,7 @@ extern struct TCommonSettings {
 		, GFX3D_Zelda_Shadow_Depth_Hack(0)
 		, GFX3D_Renderer_Multisample(false)
 		, GFX3D_TXTHack(false)
+		, GFX3D_RenderScale(1)
 		, jit_max_block_size(100)
 		, loadToMemory(false)
 		, UseExtBIOS(false)
@@ -493,6 +549,10 @@ extern struct TCommonSettings {
 		, cheatsDisable(false)
 		, rigorous_timing(false)
 		, advanced_timing(true)
+		, async_2d(false)
+		, reuse_2d_lines(false)
+		, skip_idle_loops(true)
+		, use_opcache(true)
 		, micMode(InternalNoise)
 		, spuInterpolationMode(1)
 		, manualBackupType(0)
@@ -528,7 +588,6 @@ extern struct TCommonSettings {
 		use_jit = false;
 #endif
 
-		num_cores = NDS_GetCPUCoreCount();
 		NDS_SetupDefaultFirmware();
 	}
 	bool GFX3D_HighResolutionInterpolateColor;
@@ -540,6 +599,10 @@ extern struct TCommonSettings {
 	bool GFX3D_Renderer_Multisample;
 	bool GFX3D_TXTHack;
 
+	//how many times the DS resolution the SoftRasterizer draws 3d at (1 to GFX3D_MAX_RENDER_SCALE).
+	//above 1 the screens are also put out at that size, see GPU_GetHighResScreen()
+	int  GFX3D_RenderScale;
+
 	bool loadToMemory;
 
 	bool UseExtBIOS;
@@ -560,8 +623,8 @@ extern struct TCommonSettings {
 	
 	bool cheatsDisable;
 
-	int num_cores;
-	bool single_core() { return num_cores==1; }
+	//the thread count is configured on the shared pool, see JobPool_SetWorkerCount()
+	bool single_core() { return JobPool_GetWorkerCount() == 1; }
 	bool rigorous_timing;
 
 	int StylusPressure;
@@ -571,6 +634,18 @@ extern struct TCommonSettings {
 	
 	FAST_ALIGN bool advanced_timing;
 
+	//composite 2d scanlines on a worker thread (see GPU_RenderLines)
+	bool async_2d;
+
+	//copy 2d scanlines which would come out as they did last time instead of rendering them again (see GPU_RenderLine)
+	bool reuse_2d_lines;
+
+	//let a cpu caught in a busy wait skip ahead to the next event (see idleloop.h)
+	bool skip_idle_loops;
+
+	//let the interpreter keep the instructions it fetched and decoded (see opcache.h)
+	bool use_opcache;
+
 	bool use_jit;
 	u32	jit_max_block_size;
 	
@@ -623,7 +623,9 @@ public:
 
 
 //---CUSTOM--->
+#ifdef HOST_WINDOWS
 #include "X432R_BuildSwitch.h"
+#endif
 #include <set>
 
 /*
@@ -42,10 +42,15 @@
 #include "utils/AsmJit/AsmJit.h"
 #include "arm_jit.h"
 #include "bios.h"
+#include "idleloop.h"
 
 #define LOG_JIT_LEVEL 0
 #define PROFILER_JIT_LEVEL 0
 
+#include <deque>
+#include <vector>
+#include <map>
+
 #if (PROFILER_JIT_LEVEL > 0)
 #include <algorithm>
 #endif
@@ -190,7 +195,50 @@ static void init_jit_mem()
 DS_ALIGN(4096) uintptr_t compiled_funcs[1<<26] = {0};
 #endif
 
-static u8 recompile_counts[(1<<26)/16];
+//-----------------------------------------------------------------------------
+//   Code pages
+//-----------------------------------------------------------------------------
+
+// Every compiled block is listed under each page of guest code it covers. A store into a page flagged in
+// arm_jit_code_pages drops all of its blocks and clears the flag, so that further stores there are cheap
+// until something in the page is compiled again. The host code of a dropped block may still be running
+// (a block can overwrite itself), so its space is only reclaimed when compiling, which never happens
+// from inside a block.
+u8 arm_jit_code_pages[JIT_PAGE_COUNT] = {0};
+
+struct JIT_LINK_CACHE;
+static void release_link_cache(int proc, JIT_LINK_CACHE *cache);
+
+struct JIT_BLOCK
+{
+	uintptr_t *slot; // NULL for an unused entry
+	uintptr_t code;
+	u32 size; // bytes of host code
+	u32 segment;
+	int proc;
+	JIT_LINK_CACHE *cache;
+};
+
+struct JIT_PAGE
+{
+	JIT_PAGE() : period(0), drops(0) {}
+
+	std::vector<u32> blocks; // may still name blocks dropped through another page
+	u32 period; // the stretch of emulated time 'drops' counts for
+	u32 drops;
+};
+
+static std::vector<JIT_BLOCK> blocks;
+static std::vector<u32> free_blocks;
+static std::map<u32, JIT_PAGE> code_pages;
+
+// counts the stores which hit a flagged page, so that compiling can tell if one hit the code being compiled
+static u32 page_stores = 0;
+
+// code which keeps rewriting itself would be compiled over and over, so a page which lost its blocks
+// this often within one period (about a frame) is interpreted for the rest of that period
+#define JIT_PAGE_MAX_DROPS 8
+static u32 current_period() { return (u32)(nds_timer >> 20); }
 
 #ifdef HAVE_STATIC_CODE_BUFFER
 // On x86_64, allocate jitted code from a static buffer to ensure that it's within 2GB of .text
@@ -199,13 +247,191 @@ static u8 recompile_counts[(1<<26)/16];
 // FIXME win64 needs this too, x86_32 doesn't
 
 DS_ALIGN(4096) static u8 scratchpad[1<<25];
-static u8 *scratchptr;
+
+// The buffer is filled one segment at a time. When the current segment is full, compiling goes on in
+// the one with the least live code, dropping whatever blocks are still alive there.
+#define JIT_SEGMENT_SIZE (1<<20)
+#define JIT_SEGMENT_COUNT (sizeof(scratchpad)/JIT_SEGMENT_SIZE)
+struct JIT_SEGMENT
+{
+	u32 used;
+	u32 live;
+};
+static JIT_SEGMENT segments[JIT_SEGMENT_COUNT];
+static u32 current_segment;
+
+// where the code generated last went
+static u32 last_code_size;
+static u32 last_code_segment;
+#else
+// the code of dropped blocks, freed the next time something is compiled
+static std::vector<void*> stale_code;
+#endif
+
+static void drop_block(u32 index)
+{
+	JIT_BLOCK &block = blocks[index];
+	if(!block.slot) return;
+
+	if(*block.slot == block.code)
+		*block.slot = 0;
+#ifdef HAVE_STATIC_CODE_BUFFER
+	segments[block.segment].live -= block.size;
+#else
+	stale_code.push_back((void*)block.code);
+#endif
+	if(block.cache)
+		release_link_cache(block.proc, block.cache);
+
+	block.slot = NULL;
+	free_blocks.push_back(index);
+}
+
+void FASTCALL arm_jit_invalidate_page(u32 page)
+{
+	arm_jit_code_pages[page] = 0;
+	page_stores++;
+
+	std::map<u32, JIT_PAGE>::iterator it = code_pages.find(page);
+	if(it == code_pages.end()) return;
+	JIT_PAGE &p = it->second;
+
+	const u32 period = current_period();
+	if(p.period != period)
+	{
+		p.period = period;
+		p.drops = 0;
+	}
+	p.drops++;
+
+	for(size_t i = 0; i < p.blocks.size(); i++)
+		drop_block(p.blocks[i]);
+	p.blocks.clear();
+}
+
+template<int PROCNUM>
+static bool page_is_hot(u32 adr)
+{
+	std::map<u32, JIT_PAGE>::iterator it = code_pages.find(JIT_PAGE_OF(JIT_COMPILED_FUNC(adr, PROCNUM)));
+	return it != code_pages.end() && it->second.period == current_period() && it->second.drops > JIT_PAGE_MAX_DROPS;
+}
+
+// flags the pages from start_adr to end_adr, listing the block 'index' under them unless it is ~0
+template<int PROCNUM>
+static void flag_pages(u32 start_adr, u32 end_adr, u32 index)
+{
+	u32 last_page = 0xFFFFFFFF;
+	for(u32 adr = start_adr; adr - start_adr <= end_adr - start_adr; adr += 2)
+	{
+		if(!JIT_MAPPED(adr & 0x0FFFFFFF, PROCNUM)) continue;
+		const u32 page = JIT_PAGE_OF(JIT_COMPILED_FUNC(adr, PROCNUM));
+		if(page == last_page) continue;
+		last_page = page;
+		if(index != ~0U)
+			code_pages[page].blocks.push_back(index);
+		arm_jit_code_pages[page] = 1;
+	}
+}
+
+// installs the code generated last for the block from start_adr to the instruction at end_adr
+template<int PROCNUM>
+static void add_block(u32 start_adr, u32 end_adr, uintptr_t code, JIT_LINK_CACHE *cache)
+{
+	uintptr_t *slot = &JIT_COMPILED_FUNC(start_adr, PROCNUM);
+	*slot = code;
+
+	u32 index;
+	if(free_blocks.empty())
+	{
+		index = (u32)blocks.size();
+		blocks.push_back(JIT_BLOCK());
+	}
+	else
+	{
+		index = free_blocks.back();
+		free_blocks.pop_back();
+	}
+
+	JIT_BLOCK &block = blocks[index];
+	block.slot = slot;
+	block.code = code;
+#ifdef HAVE_STATIC_CODE_BUFFER
+	block.size = last_code_size;
+	block.segment = last_code_segment;
+#else
+	block.size = 0;
+	block.segment = 0;
+#endif
+	block.proc = PROCNUM;
+	block.cache = cache;
+
+	flag_pages<PROCNUM>(start_adr, end_adr, index);
+}
+
+// gives back the code generated last, which isn't going to be installed
+static void discard_code(void *code)
+{
+#ifdef HAVE_STATIC_CODE_BUFFER
+	segments[last_code_segment].live -= last_code_size;
+#else
+	AsmJit::MemoryManager::getGlobal()->free(code);
+#endif
+}
+
+static void free_stale_code()
+{
+#ifndef HAVE_STATIC_CODE_BUFFER
+	for(size_t i = 0; i < stale_code.size(); i++)
+		AsmJit::MemoryManager::getGlobal()->free(stale_code[i]);
+	stale_code.clear();
+#endif
+}
+
+static void clear_blocks()
+{
+	for(size_t i = 0; i < blocks.size(); i++)
+		if(blocks[i].slot)
+			drop_block((u32)i);
+	free_stale_code();
+	blocks.clear();
+	free_blocks.clear();
+	code_pages.clear();
+	memset(arm_jit_code_pages, 0, sizeof(arm_jit_code_pages));
+#ifdef HAVE_STATIC_CODE_BUFFER
+	memset(segments, 0, sizeof(segments));
+	current_segment = 0;
+#endif
+}
+
+#ifdef HAVE_STATIC_CODE_BUFFER
+static void next_segment()
+{
+	u32 best = current_segment;
+	for(u32 i = 1; i < JIT_SEGMENT_COUNT; i++)
+	{
+		u32 s = (current_segment + i) % JIT_SEGMENT_COUNT;
+		if(best == current_segment || segments[s].live < segments[best].live)
+			best = s;
+		if(segments[best].live == 0)
+			break;
+	}
+
+	if(segments[best].live)
+	{
+		for(size_t i = 0; i < blocks.size(); i++)
+			if(blocks[i].slot && blocks[i].segment == best)
+				drop_block((u32)i);
+	}
+
+	segments[best].used = 0;
+	segments[best].live = 0;
+	current_segment = best;
+}
 
 struct ASMJIT_API StaticCodeGenerator : public Context
 {
 	StaticCodeGenerator()
 	{
-		scratchptr = scratchpad;
 		int align = (uintptr_t)scratchpad & (sysconf(_SC_PAGESIZE) - 1);
 		int err = mprotect(scratchpad-align, sizeof(scratchpad)+align, PROT_READ|PROT_WRITE|PROT_EXEC);
 		if(err)
@@ -223,17 +449,20 @@ struct ASMJIT_API StaticCodeGenerator : public Context
 			*dest = NULL;
 			return kErrorNoFunction;
 		}
-		if(size > (uintptr_t)(scratchpad+sizeof(scratchpad)-scratchptr))
+		if(size > JIT_SEGMENT_SIZE)
 		{
-			fprintf(stderr, "Out of memory for asmjit. Clearing code cache.\n");
-			arm_jit_reset(1);
-			// If arm_jit_reset didn't involve recompiling op_cmp, we could keep the current function.
 			*dest = NULL;
-			return kErrorOk;
+			return kErrorNoHeapMemory;
 		}
-		void *p = scratchptr;
+		if(segments[current_segment].used + size > JIT_SEGMENT_SIZE)
+			next_segment();
+		JIT_SEGMENT &segment = segments[current_segment];
+		void *p = scratchpad + current_segment*JIT_SEGMENT_SIZE + segment.used;
 		size = assembler->relocCode(p);
-		scratchptr += size;
+		segment.used += (u32)size;
+		segment.live += (u32)size;
+		last_code_size = (u32)size;
+		last_code_segment = current_segment;
 		*dest = p;
 		return kErrorOk;
 	}
@@ -259,6 +488,16 @@ static GpVar bb_cpu;
 static GpVar bb_cycles;
 static GpVar bb_total_cycles;
 static u32 bb_constant_cycles;
+static bool bb_flags_dead;
+
+// guest registers and flags kept in host registers across the block (see "Register cache")
+static GpVar bb_reg[16];
+static bool bb_reg_cached[16];
+static bool bb_reg_dirty[16];
+static GpVar bb_nzcv;
+static bool bb_nzcv_cached;
+static bool bb_nzcv_dirty;
+static bool bb_in_cond;
 
 #define cpu (&ARMPROC)
 #define bb_next_instruction (bb_adr + bb_opcodesize)
@@ -328,7 +567,7 @@ static GpVar bb_profiler_entry;
 //-----------------------------------------------------------------------------
 //   Shifting macros
 //-----------------------------------------------------------------------------
-#define SET_NZCV(sign) { \
+#define SET_NZCV(sign) if(!bb_flags_dead) { \
 	JIT_COMMENT("SET_NZCV"); \
 	GpVar x = c.newGpVar(kX86VarTypeGpd); \
 	GpVar y = c.newGpVar(kX86VarTypeGpd); \
@@ -349,7 +588,7 @@ static GpVar bb_profiler_entry;
 	JIT_COMMENT("end SET_NZCV"); \
 }
 
-#define SET_NZC { \
+#define SET_NZC if(!bb_flags_dead) { \
 	JIT_COMMENT("SET_NZC"); \
 	GpVar x = c.newGpVar(kX86VarTypeGpd); \
 	GpVar y = c.newGpVar(kX86VarTypeGpd); \
@@ -365,7 +604,7 @@ static GpVar bb_profiler_entry;
 	JIT_COMMENT("end SET_NZC"); \
 }
 
-#define SET_NZC_SHIFTS_ZERO(cf) { \
+#define SET_NZC_SHIFTS_ZERO(cf) if(!bb_flags_dead) { \
 	JIT_COMMENT("SET_NZC_SHIFTS_ZERO"); \
 	c.and_(flags_ptr, 0x1F); \
 	if(cf) \
@@ -379,7 +618,7 @@ static GpVar bb_profiler_entry;
 	JIT_COMMENT("end SET_NZC_SHIFTS_ZERO"); \
 }
 
-#define SET_NZ(clear_cv) { \
+#define SET_NZ(clear_cv) if(!bb_flags_dead) { \
 	JIT_COMMENT("SET_NZ"); \
 	GpVar x = c.newGpVar(kX86VarTypeGpz); \
 	GpVar y = c.newGpVar(kX86VarTypeGpz); \
@@ -394,7 +633,7 @@ static GpVar bb_profiler_entry;
 	JIT_COMMENT("end SET_NZ"); \
 }
 
-#define SET_N { \
+#define SET_N if(!bb_flags_dead) { \
 	JIT_COMMENT("SET_N"); \
 	GpVar x = c.newGpVar(kX86VarTypeGpz); \
 	GpVar y = c.newGpVar(kX86VarTypeGpz); \
@@ -407,7 +646,7 @@ static GpVar bb_profiler_entry;
 	JIT_COMMENT("end SET_N"); \
 }
 
-#define SET_Z { \
+#define SET_Z if(!bb_flags_dead) { \
 	JIT_COMMENT("SET_Z"); \
 	GpVar x = c.newGpVar(kX86VarTypeGpz); \
 	GpVar y = c.newGpVar(kX86VarTypeGpz); \
@@ -1552,6 +1791,242 @@ static u32 classify_adr(u32 adr, bool store)
 		return MEMTYPE_GENERIC;
 }
 
+// Loads and stores to main memory, DTCM and ITCM are also emitted inline, guarded by a check that
+// the address is still in the region the first execution saw; anything else falls back to the
+// helper function. Main memory and ITCM cost depends on the cache and sequential access state
+// when advanced timing is on, so those fast paths are only taken with it off. DTCM always costs
+// one cycle. Lua memory hooks, the gdb stub and debug events need every access to go through the MMU.
+enum {
+	FASTMEM_NONE = 0,
+	FASTMEM_MAIN = 1,
+	FASTMEM_DTCM = 2,
+	FASTMEM_ITCM = 3,
+};
+
+static u32 classify_fastmem(u32 adr)
+{
+#if defined(HAVE_LUA) || defined(GDB_STUB) || defined(DEVELOPER)
+	return FASTMEM_NONE;
+#else
+	if(PROCNUM==ARMCPU_ARM9 && (adr & ~0x3FFF) == MMU.DTCMRegion)
+		return FASTMEM_DTCM;
+	else if((adr & 0x0F000000) == 0x02000000)
+		return FASTMEM_MAIN;
+	else if(PROCNUM==ARMCPU_ARM9 && (adr & 0x0E000000) == 0)
+		return FASTMEM_ITCM;
+	else
+		return FASTMEM_NONE;
+#endif
+}
+
+// what MMU_aluMemAccessCycles would return for adr with advanced timing off (or, for DTCM, on)
+static u32 fastmem_cycles(u32 alu, u32 adr, int bits, bool timing)
+{
+	u32 mem;
+	if(timing)
+		mem = 1;
+	else if(PROCNUM==ARMCPU_ARM9)
+		mem = (bits == 32) ? _MMU_accesstime<0,MMU_AT_DATA,32,MMU_AD_READ,false>(adr,true)
+			: _MMU_accesstime<0,MMU_AT_DATA,16,MMU_AD_READ,false>(adr,true);
+	else
+		mem = (bits == 32) ? _MMU_accesstime<1,MMU_AT_DATA,32,MMU_AD_READ,false>(adr,true)
+			: _MMU_accesstime<1,MMU_AT_DATA,16,MMU_AD_READ,false>(adr,true);
+
+	if(PROCNUM==ARMCPU_ARM9)
+		return std::max(alu, mem);
+	else
+		return alu + mem;
+}
+
+// emits the guarded inline access, leaving the code position at 'slow' for the caller to emit the
+// helper call and bind 'done' after it. returns false, emitting nothing, if adr_first has no fast path.
+// bits is negative for sign extending loads
+static bool emit_fastmem(u32 adr_first, bool store, int bits, const GpVar &adr, const GpVar &reg, Label &slow, Label &done)
+{
+	const u32 region = classify_fastmem(adr_first);
+	if(region == FASTMEM_NONE)
+		return false;
+
+	const bool sign = (bits < 0);
+	if(sign) bits = -bits;
+	const u32 bytes = bits >> 3;
+
+#ifndef ASMJIT_X64
+	// not every x86 register has a byte form
+	if(store && bytes == 1)
+		return false;
+#endif
+	const u32 alu = store ? 2 : 3;
+
+	slow = c.newLabel();
+	done = c.newLabel();
+
+	GpVar x = c.newGpVar(kX86VarTypeGpz);
+	GpVar t = c.newGpVar(kX86VarTypeGpd);
+	JIT_COMMENT("fastmem guard");
+
+	if(region != FASTMEM_DTCM)
+	{
+		c.mov(x, (uintptr_t)&CommonSettings.advanced_timing);
+		c.cmp(byte_ptr(x), 0);
+		c.jne(slow);
+	}
+
+	if(region == FASTMEM_MAIN)
+	{
+		c.mov(t, adr);
+		c.and_(t, 0x0F000000);
+		c.cmp(t, 0x02000000);
+		c.jne(slow);
+	}
+	else if(region == FASTMEM_ITCM)
+	{
+		c.test(adr, 0x0E000000);
+		c.jnz(slow);
+	}
+
+	if(PROCNUM==ARMCPU_ARM9)
+	{
+		// DTCM is checked first by the MMU, and it may sit in the middle of main memory
+		c.mov(x, (uintptr_t)&MMU.DTCMRegion);
+		c.mov(t, adr);
+		c.and_(t, ~0x3FFF);
+		c.cmp(t, dword_ptr(x));
+		if(region == FASTMEM_DTCM)
+		{
+			// with advanced timing off the cycle count depends on where DTCM was mapped when compiling
+			c.jne(slow);
+			c.cmp(t, MMU.DTCMRegion);
+			c.jne(slow);
+		}
+		else
+			c.je(slow);
+	}
+
+	// word loads from unaligned addresses are rotated
+	if(!store && bytes == 4)
+	{
+		c.test(adr, 3);
+		c.jnz(slow);
+	}
+
+	JIT_COMMENT("fastmem access");
+	GpVar ofs = c.newGpVar(kX86VarTypeGpz);
+	GpVar host = c.newGpVar(kX86VarTypeGpz);
+	c.mov(ofs.r32(), adr);
+	switch(region)
+	{
+		case FASTMEM_MAIN:
+		{
+			u32 *mask = (bytes == 4) ? &_MMU_MAIN_MEM_MASK32 : (bytes == 2) ? &_MMU_MAIN_MEM_MASK16 : &_MMU_MAIN_MEM_MASK;
+			c.mov(x, (uintptr_t)mask);
+			c.and_(ofs.r32(), dword_ptr(x));
+			c.mov(host, (uintptr_t)MMU.MAIN_MEM);
+			break;
+		}
+		case FASTMEM_DTCM:
+			c.and_(ofs.r32(), 0x3FFF & ~(bytes-1));
+			c.mov(host, (uintptr_t)MMU.ARM9_DTCM);
+			break;
+		case FASTMEM_ITCM:
+			c.and_(ofs.r32(), 0x7FFF & ~(bytes-1));
+			c.mov(host, (uintptr_t)MMU.ARM9_ITCM);
+			break;
+	}
+
+	if(store)
+	{
+		switch(bytes)
+		{
+			case 1: c.mov(byte_ptr(host, ofs), reg.r8()); break;
+			case 2: c.mov(word_ptr(host, ofs), reg.r16()); break;
+			case 4: c.mov(dword_ptr(host, ofs), reg); break;
+		}
+
+		// drop the blocks compiled from the overwritten code, as the MMU would (see JIT_INVALIDATE)
+		if(region != FASTMEM_DTCM)
+		{
+			Label clean = c.newLabel();
+			GpVar page = c.newGpVar(kX86VarTypeGpz);
+#ifdef MAPPED_JIT_FUNCS
+			c.mov(page, ofs);
+			c.shr(page.r32(), 1 + JIT_PAGE_SHIFT);
+			c.add(page.r32(), JIT_PAGE_OF(*((region == FASTMEM_MAIN) ? JIT.MAIN_MEM : JIT.ARM9_ITCM)));
+#else
+			c.mov(page.r32(), adr);
+			c.and_(page.r32(), 0x07FFFFFE);
+			c.shr(page.r32(), 1 + JIT_PAGE_SHIFT);
+#endif
+			c.mov(x, (uintptr_t)arm_jit_code_pages);
+			c.cmp(byte_ptr(x, page), 0);
+			c.je(clean);
+			GpVar arg = c.newGpVar(kX86VarTypeGpd);
+			c.mov(arg, page.r32());
+			X86CompilerFuncCall *ctx = c.call((void*)arm_jit_invalidate_page);
+			ctx->setPrototype(ASMJIT_CALL_CONV, FuncBuilder1<Void, u32>());
+			ctx->setArgument(0, arg);
+			c.bind(clean);
+		}
+	}
+	else
+	{
+		GpVar val = c.newGpVar(kX86VarTypeGpd);
+		switch(bytes)
+		{
+			case 1: sign ? c.movsx(val, byte_ptr(host, ofs)) : c.movzx(val, byte_ptr(host, ofs)); break;
+			case 2: sign ? c.movsx(val, word_ptr(host, ofs)) : c.movzx(val, word_ptr(host, ofs)); break;
+			case 4: c.mov(val, dword_ptr(host, ofs)); break;
+		}
+		c.mov(dword_ptr(reg), val);
+	}
+
+#ifdef ACCOUNT_FOR_NON_SEQUENTIAL_ACCESS
+	c.mov(x, (uintptr_t)((PROCNUM==ARMCPU_ARM9) ? MMU_timing.armDataFetch<0>().lastAddressPtr() : MMU_timing.armDataFetch<1>().lastAddressPtr()));
+	c.mov(t, adr);
+	c.and_(t, ~(bytes-1));
+	c.mov(dword_ptr(x), t);
+#endif
+
+	const u32 cycles = fastmem_cycles(alu, adr_first, bits, false);
+	c.mov(bb_cycles, cycles);
+	if(region == FASTMEM_DTCM)
+	{
+		const u32 timed = fastmem_cycles(alu, adr_first, bits, true);
+		if(timed != cycles)
+		{
+			Label untimed = c.newLabel();
+			c.mov(x, (uintptr_t)&CommonSettings.advanced_timing);
+			c.cmp(byte_ptr(x), 0);
+			c.je(untimed);
+			c.mov(bb_cycles, timed);
+			c.bind(untimed);
+		}
+	}
+	c.jmp(done);
+
+	c.bind(slow);
+	return true;
+}
+
+// an access through the helper for the region of adr_first, with an inline fast path in front if there is one
+static void emit_mem_access(u32 adr_first, bool store, int bits, void *func, const GpVar &adr, const GpVar &reg)
+{
+	Label slow, done;
+	bool fast = emit_fastmem(adr_first, store, bits, adr, reg, slow, done);
+
+	X86CompilerFuncCall *ctx = c.call(func);
+	if(store)
+		ctx->setPrototype(ASMJIT_CALL_CONV, FuncBuilder2<u32, u32, u32>());
+	else
+		ctx->setPrototype(ASMJIT_CALL_CONV, FuncBuilder2<u32, u32, u32*>());
+	ctx->setArgument(0, adr);
+	ctx->setArgument(1, reg);
+	ctx->setReturn(bb_cycles);
+
+	if(fast)
+		c.bind(done);
+}
+
 template<int PROCNUM, int memtype>
 static u32 FASTCALL OP_LDR(u32 adr, u32 *dstreg)
 {
@@ -1590,6 +2065,12 @@ static u32 FASTCALL OP_LDRSB(u32 adr, u32 *dstreg)
 	return MMU_aluMemAccessCycles<PROCNUM,8,MMU_AD_READ>(3,adr);
 }
 
+// access width of each helper for the inline fast paths, negative if the load sign extends
+enum {
+	LDR_bits = 32, LDRH_bits = 16, LDRSH_bits = -16, LDRB_bits = 8, LDRSB_bits = -8,
+	STR_bits = 32, STRH_bits = 16, STRB_bits = 8,
+};
+
 #define T(op) op<0,0>, op<0,1>, op<0,2>, NULL, NULL, op<1,0>, op<1,1>, NULL, op<1,3>, op<1,4>
 static const OpLDR LDR_tab[2][5]   = { T(OP_LDR) };
 static const OpLDR LDRH_tab[2][5]  = { T(OP_LDRH) };
@@ -1625,11 +2106,7 @@ static u32 sub(u32 lhs, u32 rhs) { return lhs - rhs; }
 		} \
 	} \
 	u32 adr_first = sign_op(cpu->R[REG_POS(i,16)], rhs_first); \
-	X86CompilerFuncCall *ctx = c.call((void*)mem_op##_tab[PROCNUM][classify_adr(adr_first,0)]); \
-	ctx->setPrototype(ASMJIT_CALL_CONV, FuncBuilder2<u32, u32, u32*>()); \
-	ctx->setArgument(0, adr); \
-	ctx->setArgument(1, dst); \
-	ctx->setReturn(bb_cycles); \
+	emit_mem_access(adr_first, false, mem_op##_bits, (void*)mem_op##_tab[PROCNUM][classify_adr(adr_first,0)], adr, dst); \
 	if(REG_POS(i,12)==15) \
 	{ \
 		GpVar tmp = c.newGpVar(kX86VarTypeGpd); \
@@ -1817,11 +2294,7 @@ static const OpSTR STRB_tab[2][3]  = { T(OP_STRB) };
 		} \
 	} \
 	u32 adr_first = sign_op(cpu->R[REG_POS(i,16)], rhs_first); \
-	X86CompilerFuncCall *ctx = c.call((void*)mem_op##_tab[PROCNUM][classify_adr(adr_first,1)]); \
-	ctx->setPrototype(ASMJIT_CALL_CONV, FuncBuilder2<u32, u32, u32>()); \
-	ctx->setArgument(0, adr); \
-	ctx->setArgument(1, data); \
-	ctx->setReturn(bb_cycles); \
+	emit_mem_access(adr_first, true, mem_op##_bits, (void*)mem_op##_tab[PROCNUM][classify_adr(adr_first,1)], adr, data); \
 	return 1;
 
 static int OP_STR_P_IMM_OFF(const u32 i) { OP_STR_(STR, IMM_OFF_12, add, 0); }
@@ -2150,10 +2623,7 @@ static FORCEINLINE FASTCALL u32 OP_LDM_STM_main(u32 adr, u64 regs, int n, u8 *pt
 #define OP(j) { \
 	/* no need to zero functions in DTCM, since we can't execute from it */ \
 	if(null_compiled && store) \
-	{ \
-		*func = 0; \
-		*(func+1) = 0; \
-	} \
+		JIT_INVALIDATE(*func); \
 	int Rd = ((uintptr_t)regs >> (j*4)) & 0xF; \
 	if(store) *(u32*)ptr = cpu->R[Rd]; \
 	else cpu->R[Rd] = *(u32*)ptr; \
@@ -3507,11 +3977,7 @@ static int OP_TST(const u32 i)
 		adr_first += cpu->R[_REG_NUM(i, 6)]; \
 	} \
 	c.mov(data, reg_pos_thumb(0)); \
-	X86CompilerFuncCall *ctx = c.call((void*)mem_op##_tab[PROCNUM][classify_adr(adr_first,1)]); \
-	ctx->setPrototype(ASMJIT_CALL_CONV, FuncBuilder2<Void, u32, u32>()); \
-	ctx->setArgument(0, addr); \
-	ctx->setArgument(1, data); \
-	ctx->setReturn(bb_cycles); \
+	emit_mem_access(adr_first, true, mem_op##_bits, (void*)mem_op##_tab[PROCNUM][classify_adr(adr_first,1)], addr, data); \
 	return 1;
 
 #define LDR_THUMB(mem_op, offset) \
@@ -3534,11 +4000,7 @@ static int OP_TST(const u32 i)
 		adr_first += cpu->R[_REG_NUM(i, 6)]; \
 	} \
 	c.lea(data, reg_pos_thumb(0)); \
-	X86CompilerFuncCall *ctx = c.call((void*)mem_op##_tab[PROCNUM][classify_adr(adr_first,0)]); \
-	ctx->setPrototype(ASMJIT_CALL_CONV, FuncBuilder2<Void, u32, u32*>()); \
-	ctx->setArgument(0, addr); \
-	ctx->setArgument(1, data); \
-	ctx->setReturn(bb_cycles); \
+	emit_mem_access(adr_first, false, mem_op##_bits, (void*)mem_op##_tab[PROCNUM][classify_adr(adr_first,0)], addr, data); \
 	return 1;
 
 static int OP_STRB_IMM_OFF(const u32 i) { STR_THUMB(STRB, ((i>>6)&0x1F)); }
@@ -3568,11 +4030,7 @@ static int OP_STR_SPREL(const u32 i)
 	if (imm) c.add(addr, imm);
 	GpVar data = c.newGpVar(kX86VarTypeGpd);
 	c.mov(data, reg_pos_thumb(8));
-	X86CompilerFuncCall *ctx = c.call((void*)STR_tab[PROCNUM][classify_adr(adr_first,1)]);
-	ctx->setPrototype(ASMJIT_CALL_CONV, FuncBuilder2<Void, u32, u32>());
-	ctx->setArgument(0, addr);
-	ctx->setArgument(1, data);
-	ctx->setReturn(bb_cycles);
+	emit_mem_access(adr_first, true, STR_bits, (void*)STR_tab[PROCNUM][classify_adr(adr_first,1)], addr, data);
 	return 1;
 }
 
@@ -3586,11 +4044,7 @@ static int OP_LDR_SPREL(const u32 i)
 	if (imm) c.add(addr, imm);
 	GpVar data = c.newGpVar(kX86VarTypeGpz);
 	c.lea(data, reg_pos_thumb(8));
-	X86CompilerFuncCall *ctx = c.call((void*)LDR_tab[PROCNUM][classify_adr(adr_first,0)]);
-	ctx->setPrototype(ASMJIT_CALL_CONV, FuncBuilder2<Void, u32, u32*>());
-	ctx->setArgument(0, addr);
-	ctx->setArgument(1, data);
-	ctx->setReturn(bb_cycles);
+	emit_mem_access(adr_first, false, LDR_bits, (void*)LDR_tab[PROCNUM][classify_adr(adr_first,0)], addr, data);
 	return 1;
 }
 
@@ -3602,11 +4056,7 @@ static int OP_LDR_PCREL(const u32 i)
 	GpVar data = c.newGpVar(kX86VarTypeGpz);
 	c.mov(addr, adr_first);
 	c.lea(data, reg_pos_thumb(8));
-	X86CompilerFuncCall *ctx = c.call((void*)LDR_tab[PROCNUM][classify_adr(adr_first,0)]);
-	ctx->setPrototype(ASMJIT_CALL_CONV, FuncBuilder2<Void, u32, u32*>());
-	ctx->setArgument(0, addr);
-	ctx->setArgument(1, data);
-	ctx->setReturn(bb_cycles);
+	emit_mem_access(adr_first, false, LDR_bits, (void*)LDR_tab[PROCNUM][classify_adr(adr_first,0)], addr, data);
 	return 1;
 }
 
@@ -3996,13 +4446,19 @@ static void emit_branch(int cond, Label to)
 	static const u8 cond_bit[] = {0x40, 0x40, 0x20, 0x20, 0x80, 0x80, 0x10, 0x10};
 	if(cond < 8)
 	{
-		c.test(flags_ptr, cond_bit[cond]);
+		if(bb_nzcv_cached)
+			c.test(bb_nzcv, cond_bit[cond]);
+		else
+			c.test(flags_ptr, cond_bit[cond]);
 		(cond & 1)?c.jnz(to):c.jz(to);
 	}
 	else
 	{
 		GpVar x = c.newGpVar(kX86VarTypeGpz);
-		c.movzx(x, flags_ptr);
+		if(bb_nzcv_cached)
+			c.mov(x, bb_nzcv);
+		else
+			c.movzx(x, flags_ptr);
 		c.and_(x, 0xF0);
 #if defined(_M_X64) || defined(__x86_64__)
 		c.add(x, offsetof(armcpu_t,cond_table) + cond);
@@ -4055,6 +4511,807 @@ static void _armlog(u8 proc, u32 addr, u32 opcode)
 #endif
 }
 
+//-----------------------------------------------------------------------------
+//   Flag liveness
+//-----------------------------------------------------------------------------
+
+// Most flag-setting instructions have their NZCV overwritten by a later one in the same block before
+// anything looks at them (think of a cmp/bne loop tail, or a run of movs). Before compiling a block
+// its instructions are scanned backwards to find those, and the SET_N* macros skip storing flags
+// nobody will read. Flags are always stored for the last flag writer of the block, since the next
+// block, an irq or the interpreter may read them.
+
+#define FLAG_N 8
+#define FLAG_Z 4
+#define FLAG_C 2
+#define FLAG_V 1
+#define FLAG_NZ   (FLAG_N|FLAG_Z)
+#define FLAG_NZCV (FLAG_N|FLAG_Z|FLAG_C|FLAG_V)
+
+struct FLAG_USAGE
+{
+	u8 read;	// flags the instruction may read
+	u8 kill;	// flags the instruction always overwrites
+	u8 write;	// flags the instruction may write (generously); 0 keeps its flag stores no matter what
+};
+
+static FLAG_USAGE instr_flag_usage(u32 opcode)
+{
+	// anything the jit doesn't know the behaviour of might read all the flags
+	FLAG_USAGE unknown = { FLAG_NZCV, 0, 0 };
+	FLAG_USAGE u = { 0, 0, 0 };
+
+	if(instr_attributes(opcode) & JIT_BYPASS)
+		return unknown;
+
+	if(bb_thumb)
+	{
+		if(!thumb_instruction_compilers[opcode>>6])
+			return unknown;
+
+		if(opcode < 0x1800)							// LSL/LSR/ASR imm
+			{ u.kill = FLAG_NZ; u.write = FLAG_NZCV; }
+		else if(opcode < 0x2000)					// ADD/SUB reg, imm3
+			{ u.kill = u.write = FLAG_NZCV; }
+		else if(opcode < 0x2800)					// MOV imm
+			{ u.kill = FLAG_NZ; u.write = FLAG_NZCV; }
+		else if(opcode < 0x4000)					// CMP/ADD/SUB imm
+			{ u.kill = u.write = FLAG_NZCV; }
+		else if(opcode < 0x4400)					// ALU
+		{
+			switch((opcode>>6) & 0xF)
+			{
+				case 0x5: case 0x6:					// ADC, SBC
+					u.read = FLAG_C;
+				case 0x9: case 0xA: case 0xB:		// NEG, CMP, CMN
+					u.kill = u.write = FLAG_NZCV;
+					break;
+				case 0xD:							// MUL
+					u.kill = FLAG_NZ; u.write = FLAG_NZCV;
+					break;
+				default:							// logic and register shifts
+					u.kill = FLAG_NZ; u.write = FLAG_NZCV;
+					break;
+			}
+		}
+		else if(opcode < 0x4800)					// hi register ADD/CMP/MOV, BX
+		{
+			if(((opcode>>8) & 3) == 1)
+				u.kill = u.write = FLAG_NZCV;
+		}
+		else if(opcode < 0xB000)					// loads, stores, ADD pc/sp
+			{ }
+		else if(opcode < 0xC000)					// ADD sp, PUSH/POP
+		{
+			if((opcode & 0x0F00) != 0x0000 && (opcode & 0x0600) != 0x0400)
+				return unknown;
+		}
+		else if(opcode < 0xD000)					// LDMIA/STMIA
+			{ }
+		else if(opcode < 0xE000)					// B cond, SWI
+			return unknown;
+
+		return u;
+	}
+
+	if(!arm_instruction_compilers[INSTRUCTION_INDEX(opcode)])
+		return unknown;
+
+	const u32 cond = CONDITION(opcode);
+	if(cond == 0xF)
+		return unknown;
+
+	bool dataproc = false;
+	switch((opcode>>25) & 7)
+	{
+		case 0:
+			if((opcode & 0x0F0000F0) == 0x00000090)				// MUL/MLA
+			{
+				if(BIT20(opcode)) { u.kill = FLAG_NZ; u.write = FLAG_NZCV; }
+			}
+			else if((opcode & 0x0F8000F0) == 0x00800090)		// long multiplies
+			{
+				if(BIT20(opcode)) { u.kill = FLAG_NZ; u.write = FLAG_NZCV; }
+			}
+			else if((opcode & 0x0FB00FF0) == 0x01000090)		// SWP
+				{ }
+			else if((opcode & 0x90) == 0x90)					// halfword and doubleword transfers
+			{
+				if(!(opcode & 0x60))
+					return unknown;
+			}
+			else if((opcode & 0x01900000) == 0x01000000)		// MRS, MSR, BX, CLZ, DSP...
+				return unknown;
+			else
+				dataproc = true;
+			break;
+
+		case 1:
+			if((opcode & 0x01900000) == 0x01000000)				// MSR imm
+				return unknown;
+			dataproc = true;
+			break;
+
+		case 2:													// LDR/STR imm
+			break;
+
+		case 3:													// LDR/STR reg
+			if(opcode & 0x10)
+				return unknown;
+			if(((opcode>>5) & 3) == 3 && ((opcode>>7) & 0x1F) == 0)	// RRX
+				u.read |= FLAG_C;
+			break;
+
+		case 4:													// LDM/STM
+			if(BIT22(opcode))
+				return unknown;
+			break;
+
+		case 5:													// B/BL
+			break;
+
+		default:												// coprocessor, SWI
+			return unknown;
+	}
+
+	if(dataproc)
+	{
+		const u32 op = (opcode>>21) & 0xF;
+		const bool logic = (op <= 1) || (op >= 8 && op != 0xA && op != 0xB);
+		const bool regform = !BIT25(opcode);
+
+		if(regform && !(opcode & 0x10) && ((opcode>>5) & 3) == 3 && ((opcode>>7) & 0x1F) == 0)	// RRX
+			u.read |= FLAG_C;
+		if(op >= 5 && op <= 7)									// ADC, SBC, RSC
+			u.read |= FLAG_C;
+
+		if(BIT20(opcode))
+		{
+			if(REG_POS(opcode,12) == 15 && (op < 8 || op > 0xB))
+				return unknown;										// CPSR = SPSR
+			if(logic)
+			{
+				// a zero register shift keeps the old carry, which the S_*_REG shifters read back
+				if(regform && (opcode & 0x10))
+					u.read |= FLAG_C;
+				u.kill = FLAG_NZ;
+				u.write = FLAG_NZCV;
+			}
+			else
+				u.kill = u.write = FLAG_NZCV;
+		}
+	}
+
+	if(cond != 0xE)
+	{
+		u.read = FLAG_NZCV;
+		u.kill = 0;
+	}
+
+	return u;
+}
+
+//-----------------------------------------------------------------------------
+//   Register cache
+//-----------------------------------------------------------------------------
+
+// The plain data processing ops (no register shifts, no carry in, no r15) are compiled here
+// instead of by their OP_* compilers. They keep the guest registers and the flags byte they use in
+// host registers from one to the next, so a run of them only touches armcpu_t to load what it
+// reads first and, at the next other instruction or the end of the block, to store what it changed.
+// Everything else still works on armcpu_t, so the cache is written back and forgotten before it.
+
+static bool instr_is_cacheable(u32 opcode)
+{
+	if(bb_thumb)
+	{
+		if(opcode < 0x0800)							// LSL imm
+			return true;
+		if(opcode < 0x1800)							// LSR/ASR imm; zero shifts by 32
+			return ((opcode>>6) & 0x1F) != 0;
+		if(opcode < 0x4000)							// ADD/SUB reg, imm3; MOV/CMP/ADD/SUB imm
+			return true;
+		if(opcode < 0x4400)							// ALU, but the shifts, carries and MUL
+		{
+			switch((opcode>>6) & 0xF)
+			{
+				case 0x0: case 0x1: case 0x8: case 0x9: case 0xA:
+				case 0xB: case 0xC: case 0xE: case 0xF:
+					return true;
+			}
+		}
+		return false;
+	}
+
+	if(CONDITION(opcode) == 0xF || ((opcode>>26) & 3))
+		return false;
+
+	const u32 op = (opcode>>21) & 0xF;
+	if(op >= 5 && op <= 7)							// ADC, SBC, RSC
+		return false;
+	if(op >= 8 && op <= 0xB && !BIT20(opcode))		// MRS, MSR, BX...
+		return false;
+	if(!BIT25(opcode))
+	{
+		if(opcode & 0x10)							// register shifts, multiplies, halfword transfers
+			return false;
+		if(((opcode>>5) & 3) && !((opcode>>7) & 0x1F))	// LSR/ASR #32, RRX
+			return false;
+		if(REG_POS(opcode,0) == 15)
+			return false;
+	}
+	if(REG_POS(opcode,12) == 15)
+		return false;
+	if(op != 0xD && op != 0xF && REG_POS(opcode,16) == 15)
+		return false;
+	return true;
+}
+
+static GpVar reg_cache_get(u32 r)
+{
+	if(!bb_reg_cached[r])
+	{
+		bb_reg[r] = c.newGpVar(kX86VarTypeGpd);
+		c.mov(bb_reg[r], reg_ptr(r));
+		bb_reg_cached[r] = true;
+		bb_reg_dirty[r] = false;
+	}
+	return bb_reg[r];
+}
+
+static void reg_cache_set(u32 r, GpVar x)
+{
+	// behind a condition the other path still holds the old value in the same variable
+	if(bb_in_cond)
+		c.mov(bb_reg[r], x);
+	else
+	{
+		if(bb_reg_cached[r])
+			c.unuse(bb_reg[r]);
+		bb_reg[r] = x;
+	}
+	bb_reg_cached[r] = true;
+	bb_reg_dirty[r] = true;
+}
+
+static GpVar flags_cache_get()
+{
+	if(!bb_nzcv_cached)
+	{
+		bb_nzcv = c.newGpVar(kX86VarTypeGpz);
+		c.movzx(bb_nzcv, flags_ptr);
+		bb_nzcv_cached = true;
+		bb_nzcv_dirty = false;
+	}
+	return bb_nzcv;
+}
+
+// N and Z from the x86 flags, C from x86 (inverted after a subtraction) and V from OF
+static void flags_cache_nzcv(bool sign)
+{
+	GpVar x = c.newGpVar(kX86VarTypeGpz);
+	GpVar y = c.newGpVar(kX86VarTypeGpz);
+	c.sets(x.r8Lo());
+	c.setz(y.r8Lo());
+	c.lea(x, ptr(y.r64(), x.r64(), kScale2Times));
+	if (sign) { c.setnc(y.r8Lo()); } else { c.setc(y.r8Lo()); }
+	c.lea(x, ptr(y.r64(), x.r64(), kScale2Times));
+	c.seto(y.r8Lo());
+	c.lea(x, ptr(y.r64(), x.r64(), kScale2Times));
+	GpVar f = flags_cache_get();
+	c.shl(x, 4);
+	c.and_(f, 0xF);
+	c.or_(f, x);
+	c.unuse(x);
+	c.unuse(y);
+	bb_nzcv_dirty = true;
+}
+
+// N and Z from the x86 flags; carry is -1 to keep C, 0 or 1, or 2 to take it from rcf
+static void flags_cache_nzc(int carry, GpVar rcf)
+{
+	GpVar x = c.newGpVar(kX86VarTypeGpz);
+	GpVar y = c.newGpVar(kX86VarTypeGpz);
+	c.sets(x.r8Lo());
+	c.setz(y.r8Lo());
+	c.lea(x, ptr(y.r64(), x.r64(), kScale2Times));
+	GpVar f = flags_cache_get();
+	if(carry == 2)
+	{
+		c.lea(x, ptr(rcf.r64(), x.r64(), kScale2Times));
+		c.unuse(rcf);
+		c.shl(x, 5);
+		c.and_(f, 0x1F);
+	}
+	else
+	{
+		c.shl(x, 6);
+		c.and_(f, (carry < 0) ? 0x3F : 0x1F);
+		if(carry == 1) c.or_(f, 0x20);
+	}
+	c.or_(f, x);
+	c.unuse(x);
+	c.unuse(y);
+	bb_nzcv_dirty = true;
+}
+
+// a conditional op must not bring anything new into the cache, as the path skipping it wouldn't
+static void reg_cache_preload(u32 opcode)
+{
+	const u32 op = (opcode>>21) & 0xF;
+	flags_cache_get();
+	if(op != 0xD && op != 0xF) reg_cache_get(REG_POS(opcode,16));
+	if(!BIT25(opcode)) reg_cache_get(REG_POS(opcode,0));
+	if(op < 8 || op > 0xB) reg_cache_get(REG_POS(opcode,12));
+}
+
+static void reg_cache_flush()
+{
+	for(int r = 0; r < 16; r++)
+	{
+		if(!bb_reg_cached[r]) continue;
+		if(bb_reg_dirty[r])
+		{
+			JIT_COMMENT("reg_cache_flush: R%d", r);
+			c.mov(reg_ptr(r), bb_reg[r]);
+		}
+		c.unuse(bb_reg[r]);
+		bb_reg_cached[r] = bb_reg_dirty[r] = false;
+	}
+	if(bb_nzcv_cached)
+	{
+		if(bb_nzcv_dirty)
+		{
+			JIT_COMMENT("reg_cache_flush: NZCV");
+			c.mov(flags_ptr, bb_nzcv.r8Lo());
+		}
+		c.unuse(bb_nzcv);
+		bb_nzcv_cached = bb_nzcv_dirty = false;
+	}
+}
+
+// dst op= rhs (or the immediate), leaving the x86 flags for flags_cache_nzcv/nzc
+static void emit_cached_alu(u32 op, GpVar dst, bool rhs_is_imm, GpVar rhs, u32 imm)
+{
+	switch(op)
+	{
+		case 0x0: case 0x8: case 0xE:
+			if(rhs_is_imm) c.and_(dst, imm); else c.and_(dst, rhs);
+			break;
+		case 0x1: case 0x9:
+			if(rhs_is_imm) c.xor_(dst, imm); else c.xor_(dst, rhs);
+			break;
+		case 0x2: case 0xA:
+			if(rhs_is_imm) c.sub(dst, imm); else c.sub(dst, rhs);
+			break;
+		case 0x4: case 0xB:
+			if(rhs_is_imm) c.add(dst, imm); else c.add(dst, rhs);
+			break;
+		case 0xC:
+			if(rhs_is_imm) c.or_(dst, imm); else c.or_(dst, rhs);
+			break;
+	}
+}
+
+// the variable to build Rd = Rn op x in: Rd's own when it is Rn, otherwise a copy of Rn
+static GpVar reg_cache_dst(u32 rd, u32 rn, bool &in_place)
+{
+	in_place = (rd == rn);
+	if(in_place)
+		return reg_cache_get(rd);
+	GpVar x = c.newGpVar(kX86VarTypeGpd);
+	c.mov(x, reg_cache_get(rn));
+	return x;
+}
+
+static void emit_cached_armop(const u32 i)
+{
+	const u32 op = (i>>21) & 0xF;
+	const u32 rd = REG_POS(i,12);
+	const u32 rn = REG_POS(i,16);
+	const bool logic = (op <= 1) || (op >= 8 && op != 0xA && op != 0xB);
+	const bool s = BIT20(i) && !bb_flags_dead;
+	const bool store = (op < 8 || op > 0xB);
+	const bool rhs_is_imm = BIT25(i);
+	u32 imm = 0;
+	int carry = -1;
+	GpVar rhs, rcf;
+
+	if(!store && !s)								// a compare nobody looks at
+		return;
+
+	if(rhs_is_imm)
+	{
+		imm = ROR((i&0xFF), (i>>7)&0x1E);
+		if((i>>8)&0xF) carry = BIT31(imm);
+		if(op == 0xE) imm = ~imm;
+	}
+	else
+	{
+		const u32 shift = (i>>7)&0x1F;
+		// MOV and MVN hand rhs over as the new Rd, and BIC inverts it
+		if(!shift && op != 0xD && op != 0xF && op != 0xE)
+			rhs = reg_cache_get(REG_POS(i,0));
+		else
+		{
+			rhs = c.newGpVar(kX86VarTypeGpd);
+			c.mov(rhs, reg_cache_get(REG_POS(i,0)));
+		}
+		if(shift)
+		{
+			switch((i>>5)&3)
+			{
+				case 0: c.shl(rhs, shift); break;
+				case 1: c.shr(rhs, shift); break;
+				case 2: c.sar(rhs, shift); break;
+				case 3: c.ror(rhs, shift); break;
+			}
+			if(s && logic)
+			{
+				rcf = c.newGpVar(kX86VarTypeGpd);
+				c.setc(rcf.r8Lo());
+				carry = 2;
+			}
+		}
+		if(op == 0xE) c.not_(rhs);
+	}
+
+	GpVar res;
+	bool in_place = false;
+	if(op == 0xD || op == 0xF)						// MOV, MVN
+	{
+		if(rhs_is_imm)
+		{
+			res = c.newGpVar(kX86VarTypeGpd);
+			c.mov(res, (op == 0xF) ? ~imm : imm);
+		}
+		else
+		{
+			res = rhs;
+			if(op == 0xF) c.not_(res);
+		}
+		if(s) c.test(res, res);
+	}
+	else if(op == 0x3)								// RSB
+	{
+		res = c.newGpVar(kX86VarTypeGpd);
+		if(rhs_is_imm) c.mov(res, imm); else c.mov(res, rhs);
+		c.sub(res, reg_cache_get(rn));
+	}
+	else if(op == 0x8 || op == 0xA)					// TST, CMP
+	{
+		if(op == 0x8)
+			rhs_is_imm ? c.test(reg_cache_get(rn), imm) : c.test(reg_cache_get(rn), rhs);
+		else
+			rhs_is_imm ? c.cmp(reg_cache_get(rn), imm) : c.cmp(reg_cache_get(rn), rhs);
+	}
+	else
+	{
+		if(store)
+			res = reg_cache_dst(rd, rn, in_place);
+		else										// TEQ, CMN
+		{
+			res = c.newGpVar(kX86VarTypeGpd);
+			c.mov(res, reg_cache_get(rn));
+		}
+		emit_cached_alu(op, res, rhs_is_imm, rhs, imm);
+	}
+
+	if(s)
+	{
+		if(logic)
+			flags_cache_nzc(carry, rcf);
+		else
+			flags_cache_nzcv(op == 0x2 || op == 0x3 || op == 0xA);
+	}
+	if(in_place)
+		bb_reg_dirty[rd] = true;
+	else if(store)
+		reg_cache_set(rd, res);
+}
+
+static void emit_cached_thumbop(const u32 i)
+{
+	GpVar res, rcf;
+	u32 rd = _REG_NUM(i, 0);
+	bool store = true, in_place = false, nzcv = false, sign = false;
+	int carry = -1;
+
+	if(i < 0x1800)									// LSL/LSR/ASR imm
+	{
+		const u32 shift = (i>>6) & 0x1F;
+		res = reg_cache_dst(rd, _REG_NUM(i, 3), in_place);
+		if(shift)
+		{
+			switch(i>>11)
+			{
+				case 0: c.shl(res, shift); break;
+				case 1: c.shr(res, shift); break;
+				case 2: c.sar(res, shift); break;
+			}
+			if(!bb_flags_dead)
+			{
+				rcf = c.newGpVar(kX86VarTypeGpd);
+				c.setc(rcf.r8Lo());
+				carry = 2;
+			}
+		}
+		if(!bb_flags_dead) c.test(res, res);
+	}
+	else if(i < 0x2000)								// ADD/SUB reg, imm3
+	{
+		const u32 x = (i>>6) & 7;
+		GpVar rm = BIT10(i) ? GpVar() : reg_cache_get(x);
+		res = reg_cache_dst(rd, _REG_NUM(i, 3), in_place);
+		emit_cached_alu(BIT9(i) ? 0x2 : 0x4, res, BIT10(i), rm, x);
+		nzcv = true;
+		sign = BIT9(i);
+	}
+	else if(i < 0x4000)								// MOV/CMP/ADD/SUB imm
+	{
+		const u32 imm = i & 0xFF;
+		rd = _REG_NUM(i, 8);
+		switch((i>>11) & 3)
+		{
+			case 0: res = c.newGpVar(kX86VarTypeGpd); c.mov(res, imm); c.test(res, res); break;
+			case 1: c.cmp(reg_cache_get(rd), imm); store = false; nzcv = sign = true; break;
+			case 2: res = reg_cache_dst(rd, rd, in_place); c.add(res, imm); nzcv = true; break;
+			case 3: res = reg_cache_dst(rd, rd, in_place); c.sub(res, imm); nzcv = sign = true; break;
+		}
+	}
+	else											// ALU
+	{
+		GpVar rm = reg_cache_get(_REG_NUM(i, 3));
+		switch((i>>6) & 0xF)
+		{
+			case 0x0: res = reg_cache_dst(rd, rd, in_place); c.and_(res, rm); break;
+			case 0x1: res = reg_cache_dst(rd, rd, in_place); c.xor_(res, rm); break;
+			case 0x8: c.test(reg_cache_get(rd), rm); store = false; break;
+			case 0x9: res = c.newGpVar(kX86VarTypeGpd); c.mov(res, rm); c.neg(res); nzcv = sign = true; break;
+			case 0xA: c.cmp(reg_cache_get(rd), rm); store = false; nzcv = sign = true; break;
+			case 0xB:
+				res = c.newGpVar(kX86VarTypeGpd);
+				c.mov(res, reg_cache_get(rd));
+				c.add(res, rm);
+				store = false;
+				nzcv = true;
+				break;
+			case 0xC: res = reg_cache_dst(rd, rd, in_place); c.or_(res, rm); break;
+			case 0xE:
+			{
+				GpVar tmp = c.newGpVar(kX86VarTypeGpd);
+				c.mov(tmp, rm);
+				c.not_(tmp);
+				res = reg_cache_dst(rd, rd, in_place);
+				c.and_(res, tmp);
+				c.unuse(tmp);
+				break;
+			}
+			case 0xF: res = c.newGpVar(kX86VarTypeGpd); c.mov(res, rm); c.not_(res); c.test(res, res); break;
+		}
+	}
+
+	if(!bb_flags_dead)
+		nzcv ? flags_cache_nzcv(sign) : flags_cache_nzc(carry, rcf);
+	if(in_place)
+		bb_reg_dirty[rd] = true;
+	else if(store)
+		reg_cache_set(rd, res);
+}
+
+//-----------------------------------------------------------------------------
+//   Block linking
+//-----------------------------------------------------------------------------
+
+// A block that ends in a jump to an already compiled block calls it directly, instead of returning
+// to armInnerLoop just to be dispatched again. Links go through the JIT_COMPILED_FUNC slot of the
+// successor, so invalidating a block (its slot is zeroed) unlinks it everywhere for free.
+// The chain is bounded by a per-cpu cycle budget: armInnerLoop hands armcpu_exec the cycles left
+// before the other cpu's turn or the next event, and NDS_Reschedule drains it whenever an event
+// wants the cpu back.
+s32 arm_jit_link_budget[2] = {0, 0};
+
+// a one-entry cache for the target of an indirect branch (bx, ldr pc, pop {pc}...)
+struct JIT_LINK_CACHE
+{
+	u32 adr;
+	uintptr_t *slot;
+};
+
+// the caches are referenced by compiled code, so they live until the code is flushed.
+// a deque never moves its elements when growing at the end
+static std::deque<JIT_LINK_CACHE> link_caches;
+
+// the caches of dropped blocks, for each cpu. a dropped block which is still running may yet fill its
+// cache in, but only ever with an address and the slot of that address, so the cache can be reused
+static std::vector<JIT_LINK_CACHE*> free_link_caches[2];
+
+// the cache of the block being compiled, if it has one
+static JIT_LINK_CACHE *bb_link_cache;
+
+static void release_link_cache(int proc, JIT_LINK_CACHE *cache)
+{
+	free_link_caches[proc].push_back(cache);
+}
+
+template<int PROCNUM>
+static JIT_LINK_CACHE* new_link_cache()
+{
+	JIT_LINK_CACHE *cache;
+	if(free_link_caches[PROCNUM].empty())
+	{
+		link_caches.push_back(JIT_LINK_CACHE());
+		cache = &link_caches.back();
+	}
+	else
+	{
+		cache = free_link_caches[PROCNUM].back();
+		free_link_caches[PROCNUM].pop_back();
+	}
+	cache->adr = 1; // never matches an aligned address
+	cache->slot = NULL;
+	return cache;
+}
+
+template<int PROCNUM>
+static uintptr_t FASTCALL arm_jit_link_lookup(JIT_LINK_CACHE *cache)
+{
+	u32 adr = ARMPROC.instruct_adr & (ARMPROC.CPSR.bits.T?0xFFFFFFFE:0xFFFFFFFC);
+	if(adr != ARMPROC.instruct_adr || !JIT_MAPPED(adr & 0x0FFFFFFF, PROCNUM))
+		return 0;
+
+	cache->adr = adr;
+	cache->slot = &JIT_COMPILED_FUNC(adr, PROCNUM);
+	return *cache->slot;
+}
+
+// the successors of a block which can be known when compiling it
+static u32 link_static_targets(u32 opcode, u32 adr, u32 *targets, bool *indirect)
+{
+	u32 count = 0;
+	*indirect = false;
+
+	if(!instr_is_branch(opcode))
+	{
+		// cut off by jit_max_block_size
+		targets[count++] = adr + bb_opcodesize;
+		return count;
+	}
+
+	if(bb_thumb)
+	{
+		if((opcode & 0xF000) == 0xD000 && ((opcode >> 8) & 0xF) < 0xE)
+		{
+			targets[count++] = adr + 4 + ((u32)(s8)(opcode & 0xFF) << 1);
+			targets[count++] = adr + 2;
+		}
+		else if((opcode & 0xF800) == 0xE000)
+			targets[count++] = adr + 4 + ((u32)((s32)(opcode << 21) >> 20));
+		else
+			*indirect = true;
+		return count;
+	}
+
+	if((opcode & 0x0E000000) == 0x0A000000 && CONDITION(opcode) != 0xF)
+		targets[count++] = adr + 8 + ((u32)((s32)(opcode << 8) >> 6));
+	else
+		*indirect = true;
+
+	if(instr_is_conditional(opcode))
+		targets[count++] = adr + 4;
+
+	return count;
+}
+
+template<int PROCNUM>
+static void emit_block_link(u32 opcode, u32 adr)
+{
+	u32 targets[2];
+	bool indirect;
+	u32 count = link_static_targets(opcode, adr, targets, &indirect);
+
+	Label done = c.newLabel();
+	Label call = c.newLabel();
+	GpVar x = c.newGpVar(kX86VarTypeGpz);
+	GpVar f = c.newGpVar(kX86VarTypeGpz);
+
+	JIT_COMMENT("link: stop when the budget is spent or the cpu has to stop");
+	c.mov(x, (uintptr_t)&arm_jit_link_budget[PROCNUM]);
+	c.sub(dword_ptr(x), bb_total_cycles.r32());
+	c.jle(done);
+	c.cmp(cpu_ptr(waitIRQ), 0);
+	c.jne(done);
+	c.mov(x, (uintptr_t)&nds.freezeBus);
+	c.cmp(dword_ptr(x), 0);
+	c.jne(done);
+
+	GpVar next = c.newGpVar(kX86VarTypeGpd);
+	c.mov(next, cpu_ptr(instruct_adr));
+
+	for(u32 n = 0; n < count; n++)
+	{
+		u32 target = targets[n];
+		if(!JIT_MAPPED(target & 0x0FFFFFFF, PROCNUM)) continue;
+
+		JIT_COMMENT("link: static successor %08X", target);
+		Label miss = c.newLabel();
+		c.cmp(next, target);
+		c.jne(miss);
+		c.mov(x, (uintptr_t)&JIT_COMPILED_FUNC(target, PROCNUM));
+		c.mov(f, sysint_ptr(x));
+		c.jmp(call);
+		c.bind(miss);
+	}
+
+	if(!indirect)
+		c.jmp(done);
+	else
+	{
+		JIT_LINK_CACHE *cache = new_link_cache<PROCNUM>();
+		bb_link_cache = cache;
+
+		JIT_COMMENT("link: indirect successor");
+		Label miss = c.newLabel();
+		c.mov(x, (uintptr_t)cache);
+		c.cmp(next, dword_ptr(x, offsetof(JIT_LINK_CACHE, adr)));
+		c.jne(miss);
+		c.mov(x, sysint_ptr(x, offsetof(JIT_LINK_CACHE, slot)));
+		c.mov(f, sysint_ptr(x));
+		c.jmp(call);
+		c.bind(miss);
+		X86CompilerFuncCall *ctx = c.call((void*)arm_jit_link_lookup<PROCNUM>);
+		ctx->setPrototype(ASMJIT_CALL_CONV, FuncBuilder1<uintptr_t, void*>());
+		ctx->setArgument(0, x);
+		ctx->setReturn(f);
+	}
+
+	c.bind(call);
+	c.test(f, f);
+	c.jz(done);
+	GpVar cycles = c.newGpVar(kX86VarTypeGpz);
+	X86CompilerFuncCall *ctx = c.call(f);
+	ctx->setPrototype(ASMJIT_CALL_CONV, FuncBuilder0<u32>());
+	ctx->setReturn(cycles);
+	c.add(bb_total_cycles, cycles);
+	c.bind(done);
+}
+
+//-----------------------------------------------------------------------------
+//   Busy waits
+//-----------------------------------------------------------------------------
+
+// A block which may be a busy wait (see idleloop.h) checks the memory it polled whenever it branches
+// back to its own start. If the cpu is idle, the block flags it and ends the chain of linked blocks,
+// so that armInnerLoop gets to skip ahead.
+template<int PROCNUM>
+static void FASTCALL arm_jit_idle_check(u32 head, u32 branch_adr)
+{
+	if(CommonSettings.skip_idle_loops && idleloop_check<PROCNUM>(head, branch_adr, ARMPROC.CPSR.bits.T != 0))
+	{
+		ARMPROC.idleLoop = TRUE;
+		arm_jit_link_budget[PROCNUM] = 0;
+	}
+}
+
+template<int PROCNUM>
+static void emit_idle_check(u32 head, u32 branch_adr)
+{
+	Label done = c.newLabel();
+	GpVar x = c.newGpVar(kX86VarTypeGpd);
+	GpVar y = c.newGpVar(kX86VarTypeGpd);
+
+	JIT_COMMENT("idle: branched back to %08X", head);
+	c.cmp(cpu_ptr(instruct_adr), head);
+	c.jne(done);
+	c.mov(x, head);
+	c.mov(y, branch_adr);
+	X86CompilerFuncCall *ctx = c.call((void*)arm_jit_idle_check<PROCNUM>);
+	ctx->setPrototype(ASMJIT_CALL_CONV, FuncBuilder2<Void, u32, u32>());
+	ctx->setArgument(0, x);
+	ctx->setArgument(1, y);
+	c.bind(done);
+}
+
 template<int PROCNUM>
 static u32 compile_basicblock()
 {
@@ -4067,6 +5324,7 @@ static u32 compile_basicblock()
 	
 	bb_thumb = cpu->CPSR.bits.T;
 	bb_opcodesize = bb_thumb ? 2 : 4;
+	bb_link_cache = NULL;
 
 	if (!JIT_MAPPED(start_adr & 0x0FFFFFFF, PROCNUM))
 	{
@@ -4075,6 +5333,32 @@ static u32 compile_basicblock()
 		return 1;
 	}
 
+	// look at the whole block first, to find the flag stores which can be skipped
+	static std::vector<u32> scan_opcodes;
+	static std::vector<bool> scan_flags_dead;
+	scan_opcodes.clear();
+	for(u32 i=0, bEndBlock = 0; bEndBlock == 0; i++)
+	{
+		u32 adr = start_adr + (i * bb_opcodesize);
+		opcode = bb_thumb ? _MMU_read16<PROCNUM, MMU_AT_CODE>(adr) : _MMU_read32<PROCNUM, MMU_AT_CODE>(adr);
+		scan_opcodes.push_back(opcode);
+		bEndBlock = instr_is_branch(opcode) || (i >= (CommonSettings.jit_max_block_size - 1));
+	}
+	scan_flags_dead.resize(scan_opcodes.size());
+	u32 live_flags = FLAG_NZCV;
+	for(int i=(int)scan_opcodes.size()-1; i>=0; i--)
+	{
+		FLAG_USAGE usage = instr_flag_usage(scan_opcodes[i]);
+		scan_flags_dead[i] = usage.write && !(usage.write & live_flags);
+		live_flags = (live_flags & ~usage.kill) | usage.read;
+	}
+	bool code_changed = false;
+
+	// compiling runs the block through the interpreter, which may store into the code already compiled
+	const u32 end_adr = start_adr + ((u32)scan_opcodes.size()-1) * bb_opcodesize;
+	flag_pages<PROCNUM>(start_adr, end_adr, ~0U);
+	const u32 stores_before = page_stores;
+
 #if LOG_JIT
 	fprintf(stderr, "adr %08Xh %s%c\n", start_adr, ARMPROC.CPSR.bits.T ? "THUMB":"ARM", PROCNUM?'7':'9');
 #endif
@@ -4099,6 +5383,9 @@ static u32 compile_basicblock()
 #endif
 
 	bb_constant_cycles = 0;
+	memset(bb_reg_cached, 0, sizeof(bb_reg_cached));
+	bb_nzcv_cached = false;
+	bb_in_cond = false;
 	for(u32 i=0, bEndBlock = 0; bEndBlock == 0; i++)
 	{
 		bb_adr = start_adr + (i * bb_opcodesize);
@@ -4119,6 +5406,15 @@ static u32 compile_basicblock()
 		u32 cycles = instr_cycles(opcode);
 
 		bEndBlock = instr_is_branch(opcode) || (i >= (CommonSettings.jit_max_block_size - 1));
+
+		// an earlier instruction of this block rewrote this one, so the liveness scan doesn't hold
+		if(i >= scan_opcodes.size() || opcode != scan_opcodes[i])
+			code_changed = true;
+		bb_flags_dead = !code_changed && scan_flags_dead[i];
+
+		const bool cacheable = instr_is_cacheable(opcode);
+		if(!cacheable)
+			reg_cache_flush();
 		
 #if LOG_JIT
 		if (instr_is_conditional(opcode) && (cycles > 1) || (cycles == 0))
@@ -4143,10 +5439,16 @@ static u32 compile_basicblock()
 			// another with the same condition, but merging them into a
 			// single branch has negligible effect on speed.
 			if(bEndBlock) sync_r15(opcode, 1, 1);
+			if(cacheable) reg_cache_preload(opcode);
 			Label skip = c.newLabel();
 			emit_branch(CONDITION(opcode), skip);
 			if(!bEndBlock) sync_r15(opcode, 0, 0);
-			emit_armop_call(opcode);
+			bb_in_cond = true;
+			if(cacheable)
+				emit_cached_armop(opcode);
+			else
+				emit_armop_call(opcode);
+			bb_in_cond = false;
 			
 			if(cycles == 0)
 			{
@@ -4164,7 +5466,12 @@ static u32 compile_basicblock()
 		else
 		{
 			sync_r15(opcode, bEndBlock, 0);
-			emit_armop_call(opcode);
+			if(!cacheable)
+				emit_armop_call(opcode);
+			else if(bb_thumb)
+				emit_cached_thumbop(opcode);
+			else
+				emit_cached_armop(opcode);
 			if(cycles == 0)
 			{
 				JIT_COMMENT("variable cycles");
@@ -4173,6 +5480,8 @@ static u32 compile_basicblock()
 		}
 		interpreted_cycles += op_decode[PROCNUM][bb_thumb]();
 	}
+	bb_flags_dead = false;
+	reg_cache_flush();
 	
 	if(!instr_does_prefetch(opcode))
 	{
@@ -4199,17 +5508,27 @@ static u32 compile_basicblock()
 	profiler_entry[PROCNUM][padr].addr = start_adr;
 #endif
 
+	if(instr_is_branch(opcode) && idleloop_candidate<PROCNUM>(start_adr, bb_adr, bb_thumb))
+		emit_idle_check<PROCNUM>(start_adr, bb_adr);
+
+	emit_block_link<PROCNUM>(opcode, bb_adr);
+
 	c.ret(bb_total_cycles);
 #if LOG_JIT
 	fprintf(stderr, "cycles %d%s\n", bb_constant_cycles, has_variable_cycles ? " + variable" : "");
 #endif
 	c.endFunc();
 
+	if(page_stores != stores_before)
+		code_changed = true;
+
 	ArmOpCompiled f = (ArmOpCompiled)c.make();
+	bool compiled = true;
 	if(c.getError())
 	{
 		fprintf(stderr, "JIT error at %s%c-%08X: %s\n", bb_thumb?"THUMB":"ARM", PROCNUM?'7':'9', start_adr, getErrorString(c.getError()));
 		f = op_decode[PROCNUM][bb_thumb];
+		compiled = false;
 	}
 #if LOG_JIT
 	uintptr_t baddr = (uintptr_t)f;
@@ -4217,7 +5536,22 @@ static u32 compile_basicblock()
 	fflush(stderr);
 #endif
 	
-	JIT_COMPILED_FUNC(start_adr, PROCNUM) = (uintptr_t)f;
+	// leave a block compiled from self-modified code to be compiled again next time
+	if(!compiled)
+	{
+		if(!code_changed)
+			JIT_COMPILED_FUNC(start_adr, PROCNUM) = (uintptr_t)f;
+		if(bb_link_cache)
+			release_link_cache(PROCNUM, bb_link_cache);
+	}
+	else if(!code_changed)
+		add_block<PROCNUM>(start_adr, bb_adr, (uintptr_t)f, bb_link_cache);
+	else
+	{
+		discard_code((void*)f);
+		if(bb_link_cache)
+			release_link_cache(PROCNUM, bb_link_cache);
+	}
 	return interpreted_cycles;
 }
 
@@ -4225,17 +5559,13 @@ template<int PROCNUM> u32 arm_jit_compile()
 {
 	*PROCNUM_ptr = PROCNUM;
 
-	// prevent endless recompilation of self-modifying code, which would be a memleak since we only free code all at once.
-	// also allows us to clear compiled_funcs[] while leaving it sparsely allocated, if the OS does memory overcommit.
+	// no compiled code is running now, so the code of dropped blocks can go
+	free_stale_code();
+
+	// code which keeps rewriting itself is interpreted for a while, rather than compiled again after every store
 	u32 adr = cpu->instruct_adr;
-	u32 mask_adr = (adr & 0x07FFFFFE) >> 4;
-	if(((recompile_counts[mask_adr >> 1] >> 4*(mask_adr & 1)) & 0xF) > 8)
-	{
-		ArmOpCompiled f = op_decode[PROCNUM][cpu->CPSR.bits.T];
-		JIT_COMPILED_FUNC(adr, PROCNUM) = (uintptr_t)f;
-		return f();
-	}
-	recompile_counts[mask_adr >> 1] += 1 << 4*(mask_adr & 1);
+	if(JIT_MAPPED(adr & 0x0FFFFFFF, PROCNUM) && page_is_hot<PROCNUM>(adr))
+		return op_decode[PROCNUM][cpu->CPSR.bits.T]();
 
 	return compile_basicblock<PROCNUM>();
 }
@@ -4248,9 +5578,6 @@ void arm_jit_reset(bool enable, bool suppress_msg)
 #if LOG_JIT
 	c.setLogger(&logger);
 	freopen("desmume_jit.log", "w", stderr);
-#endif
-#ifdef HAVE_STATIC_CODE_BUFFER
-	scratchptr = scratchpad;
 #endif
 	if (!suppress_msg)
 		printf("CPU mode: %s\n", enable?"JIT":"Interpreter");
@@ -4260,33 +5587,22 @@ void arm_jit_reset(bool enable, bool suppress_msg)
 	{
 		printf("JIT: max block size %d instruction(s)\n", CommonSettings.jit_max_block_size);
 
+		// zeroes the slots of every compiled block, leaving compiled_funcs[] sparsely allocated
+		// if the OS does memory overcommit, and frees the code asmjit allocated
+		clear_blocks();
 #ifdef MAPPED_JIT_FUNCS
-
-		//these pointers are allocated by asmjit and need freeing
-		#define JITFREE(x)  for(int iii=0;iii<ARRAY_SIZE(x);iii++) if(x[iii]) AsmJit::MemoryManager::getGlobal()->free((void*)x[iii]);  memset(x,0,sizeof(x));
-			JITFREE(JIT.MAIN_MEM);
-			JITFREE(JIT.SWIRAM);
-			JITFREE(JIT.ARM9_ITCM);
-			JITFREE(JIT.ARM9_LCDC);
-			JITFREE(JIT.ARM9_BIOS);
-			JITFREE(JIT.ARM7_BIOS);
-			JITFREE(JIT.ARM7_ERAM);
-			JITFREE(JIT.ARM7_WIRAM);
-			JITFREE(JIT.ARM7_WRAM);
-		#undef JITFREE
-
-		memset(recompile_counts, 0, sizeof(recompile_counts));
+		// slots which run the interpreter after a compile error aren't listed anywhere
+		memset(&JIT, 0, sizeof(JIT));
 		init_jit_mem();
-#else
-		for(int i=0; i<sizeof(recompile_counts)/8; i++)
-			if(((u64*)recompile_counts)[i])
-			{
-				((u64*)recompile_counts)[i] = 0;
-				memset(compiled_funcs+128*i, 0, 128*sizeof(*compiled_funcs));
-			}
 #endif
+		link_caches.clear();
+		free_link_caches[0].clear();
+		free_link_caches[1].clear();
 	}
 
+	// compiled stores don't drop entries of the interpreter's opcode cache
+	opcache_reset();
+
 	c.clear();
 
 #if (PROFILER_JIT_LEVEL > 0)
@@ -31,6 +31,9 @@ void arm_jit_close();
 void arm_jit_sync();
 template<int PROCNUM> u32 arm_jit_compile();
 
+// cycles a chain of linked blocks may still run before returning to the dispatcher
+extern s32 arm_jit_link_budget[2];
+
 #if defined(HOST_WINDOWS) || defined(DESMUME_COCOA)
 #define MAPPED_JIT_FUNCS
 #endif
@@ -65,6 +68,27 @@ extern uintptr_t compiled_funcs[];
 #define JIT_MAPPED(adr, PROCNUM) true
 #endif
 
+// Compiled blocks are also listed by the pages of guest code they were compiled from, so that a store
+// throws away every block covering the bytes it changed, not only one starting at the stored address.
+// Pages are numbered by their JIT_COMPILED_FUNC slots, so mirrors sharing slots share pages too.
+#define JIT_PAGE_SHIFT 7 // 128 slots, 256 bytes of code
+#ifdef MAPPED_JIT_FUNCS
+#define JIT_SLOTS ((uintptr_t*)&JIT)
+#define JIT_SLOT_COUNT (sizeof(JIT_struct)/sizeof(uintptr_t))
+#else
+#define JIT_SLOTS compiled_funcs
+#define JIT_SLOT_COUNT (1<<26)
+#endif
+#define JIT_PAGE_COUNT (JIT_SLOT_COUNT >> JIT_PAGE_SHIFT)
+#define JIT_PAGE_OF(slot) ((u32)(&(slot) - JIT_SLOTS) >> JIT_PAGE_SHIFT)
+
+// nonzero for the pages which have compiled blocks in them
+extern u8 arm_jit_code_pages[];
+void FASTCALL arm_jit_invalidate_page(u32 page);
+
+// for every store into memory code can run from, given the slot of the stored address
+#define JIT_INVALIDATE(slot) { const u32 jit_page = JIT_PAGE_OF(slot); if(arm_jit_code_pages[jit_page]) arm_jit_invalidate_page(jit_page); }
+
 extern u32 saveBlockSizeJIT;
 
 #endif
@@ -30,6 +30,9 @@
 #include "Disassembler.h"
 #include "NDSSystem.h"
 #include "MMU_timing.h"
+#include "idleloop.h"
+#include "armprofiler.h"
+#include "opcache.h"
 #ifdef HAVE_LUA
 #include "lua-engine.h"
 #endif
@@ -237,6 +240,7 @@ void armcpu_init(armcpu_t *armcpu, u32 adr)
 	armcpu->intVector = 0xFFFF0000 * (armcpu->proc_ID==0);
 	armcpu->waitIRQ = FALSE;
 	armcpu->halt_IE_and_IF = FALSE;
+	armcpu->idleLoop = FALSE;
 	armcpu->intrWaitARM_state = 0;
 
 //#ifdef GDB_STUB
@@ -273,6 +277,16 @@ void armcpu_init(armcpu_t *armcpu, u32 adr)
 //#endif
 }
 
+//for when 'instruction' was set other than by fetching it, as by loading a savestate
+void armcpu_redecode(armcpu_t *armcpu)
+{
+	const int PROCNUM = armcpu->proc_ID;
+	if(armcpu->CPSR.bits.T)
+		armcpu->decoded = thumb_instructions_set[PROCNUM][armcpu->instruction>>6];
+	else
+		armcpu->decoded = arm_instructions_set[PROCNUM][INSTRUCTION_INDEX(armcpu->instruction)];
+}
+
 u32 armcpu_switchMode(armcpu_t *armcpu, u8 mode)
 {
 	u32 oldmode = armcpu->CPSR.bits.mode;
@@ -418,7 +432,17 @@ FORCEINLINE static u32 armcpu_prefetch()
 		armcpu->instruct_adr = curInstruction;
 		armcpu->next_instruction = curInstruction + 4;
 		armcpu->R[15] = curInstruction + 8;
-		armcpu->instruction = _MMU_read32<PROCNUM, MMU_AT_CODE>(curInstruction);
+		if(CommonSettings.use_opcache && !debugFlag)
+		{
+			const OpCacheEntry &op = opcache_fetch<PROCNUM,false>(curInstruction);
+			armcpu->instruction = op.opcode;
+			armcpu->decoded = op.handler;
+		}
+		else
+		{
+			armcpu->instruction = _MMU_read32<PROCNUM, MMU_AT_CODE>(curInstruction);
+			armcpu->decoded = arm_instructions_set[PROCNUM][INSTRUCTION_INDEX(armcpu->instruction)];
+		}
 //#endif
 
 		return MMU_codeFetchCycles<PROCNUM,32>(curInstruction);
@@ -442,7 +466,17 @@ FORCEINLINE static u32 armcpu_prefetch()
 	armcpu->instruct_adr = curInstruction;
 	armcpu->next_instruction = curInstruction + 2;
 	armcpu->R[15] = curInstruction + 4;
-	armcpu->instruction = _MMU_read16<PROCNUM, MMU_AT_CODE>(curInstruction);
+	if(CommonSettings.use_opcache && !debugFlag)
+	{
+		const OpCacheEntry &op = opcache_fetch<PROCNUM,true>(curInstruction);
+		armcpu->instruction = op.opcode;
+		armcpu->decoded = op.handler;
+	}
+	else
+	{
+		armcpu->instruction = _MMU_read16<PROCNUM, MMU_AT_CODE>(curInstruction);
+		armcpu->decoded = thumb_instructions_set[PROCNUM][armcpu->instruction>>6];
+	}
 //#endif
 
 	if(PROCNUM==0)
@@ -597,6 +631,14 @@ u32 TRAPUNDEF(armcpu_t* cpu)
 //  return TRUE;
 //}
 
+//a short jump backwards closes a loop, which may be a busy wait
+template<int PROCNUM>
+static FORCEINLINE void armcpu_checkIdleLoop(u32 adr, bool thumb)
+{
+	if((u32)(adr - ARMPROC.instruct_adr) < IDLELOOP_MAX_INSTRUCTIONS*4 && CommonSettings.skip_idle_loops)
+		ARMPROC.idleLoop = idleloop_check<PROCNUM>(ARMPROC.instruct_adr, adr, thumb);
+}
+
 template<int PROCNUM>
 u32 armcpu_exec()
 {
@@ -605,6 +647,7 @@ u32 armcpu_exec()
 	// the variables below, and returns appropriate cycle count.
 	u32 cFetch = 0;
 	u32 cExecute = 0;
+	const u32 adr = ARMPROC.instruct_adr;
 
 	//this assert is annoying. but sometimes it is handy.
 	//assert(ARMPROC.instruct_adr!=0x00000000);
@@ -681,7 +724,7 @@ u32 armcpu_exec()
 			#ifdef DEVELOPER
 			DEBUG_statistics.instructionHits[PROCNUM].arm[INSTRUCTION_INDEX(ARMPROC.instruction)]++;
 			#endif
-			cExecute = arm_instructions_set[PROCNUM][INSTRUCTION_INDEX(ARMPROC.instruction)](ARMPROC.instruction);
+			cExecute = ARMPROC.decoded(ARMPROC.instruction);
 		}
 		else
 			cExecute = 1; // If condition=false: 1S cycle
@@ -693,7 +736,11 @@ u32 armcpu_exec()
 		ARMPROC.mem_if->prefetch32( ARMPROC.mem_if->data, ARMPROC.next_instruction);
 #endif
 		cFetch = armcpu_prefetch<PROCNUM>();
-		return MMU_fetchExecuteCycles<PROCNUM>(cExecute, cFetch);
+		armcpu_checkIdleLoop<PROCNUM>(adr, false);
+		const u32 cycles = MMU_fetchExecuteCycles<PROCNUM>(cExecute, cFetch);
+		if(arm_profiler.enabled)
+			arm_profiler.account(PROCNUM, adr, false, false, cycles);
+		return cycles;
 	}
 
 #ifdef HAVE_LUA
@@ -702,7 +749,7 @@ u32 armcpu_exec()
 	#ifdef DEVELOPER
 	DEBUG_statistics.instructionHits[PROCNUM].thumb[ARMPROC.instruction>>6]++;
 	#endif
-	cExecute = thumb_instructions_set[PROCNUM][ARMPROC.instruction>>6](ARMPROC.instruction);
+	cExecute = ARMPROC.decoded(ARMPROC.instruction);
 
 #ifdef GDB_STUB
 	if ( ARMPROC.post_ex_fn != NULL) {
@@ -712,7 +759,11 @@ u32 armcpu_exec()
 	ARMPROC.mem_if->prefetch32( ARMPROC.mem_if->data, ARMPROC.next_instruction);
 #endif
 	cFetch = armcpu_prefetch<PROCNUM>();
-	return MMU_fetchExecuteCycles<PROCNUM>(cExecute, cFetch);
+	armcpu_checkIdleLoop<PROCNUM>(adr, true);
+	const u32 cycles = MMU_fetchExecuteCycles<PROCNUM>(cExecute, cFetch);
+	if(arm_profiler.enabled)
+		arm_profiler.account(PROCNUM, adr, true, false, cycles);
+	return cycles;
 }
 
 //these templates needed to be instantiated manually
@@ -728,23 +779,36 @@ void arm_jit_sync()
 	armcpu_prefetch<1>();
 }
 
+//budget: how many of its cycles the cpu may run through linked jit blocks before it has to come back
 template<int PROCNUM, bool jit>
-u32 armcpu_exec()
+u32 armcpu_exec(s32 budget)
 {
 	if (jit)
 	{
 		ARMPROC.instruct_adr &= ARMPROC.CPSR.bits.T?0xFFFFFFFE:0xFFFFFFFC;
 		ArmOpCompiled f = (ArmOpCompiled)JIT_COMPILED_FUNC(ARMPROC.instruct_adr, PROCNUM);
+		// each link is a nested call, so a chain is also kept to about as long as four blocks of the maximum size
+		arm_jit_link_budget[PROCNUM] = std::min(budget, (s32)CommonSettings.jit_max_block_size * 4);
+		if(arm_profiler.enabled)
+		{
+			// one block per call, so that the samples of a chain don't all go to its first block
+			const u32 adr = ARMPROC.instruct_adr;
+			const bool thumb = ARMPROC.CPSR.bits.T;
+			arm_jit_link_budget[PROCNUM] = 0;
+			const u32 cycles = f ? f() : arm_jit_compile<PROCNUM>();
+			arm_profiler.account(PROCNUM, adr, thumb, f != NULL, cycles);
+			return cycles;
+		}
 		return f ? f() : arm_jit_compile<PROCNUM>();
 	}
 
 	return armcpu_exec<PROCNUM>();
 }
 
-template u32 armcpu_exec<0,false>();
-template u32 armcpu_exec<0,true>();
-template u32 armcpu_exec<1,false>();
-template u32 armcpu_exec<1,true>();
+template u32 armcpu_exec<0,false>(s32 budget);
+template u32 armcpu_exec<0,true>(s32 budget);
+template u32 armcpu_exec<1,false>(s32 budget);
+template u32 armcpu_exec<1,true>(s32 budget);
 #endif
 
 void setIF(int PROCNUM, u32 flag)
@@ -291,6 +291,8 @@ struct armcpu_t
 	u8 LDTBit;  //1 : ARMv5 style 0 : non ARMv5 (earlier)
 	BOOL waitIRQ;
 	BOOL halt_IE_and_IF; //the cpu is halted, waiting for IE&IF to signal something
+	BOOL idleLoop; //the cpu just went around a busy wait loop (see idleloop.h)
+	u32 (FASTCALL *decoded)(const u32 i); //the handler of 'instruction', looked up when it was fetched
 	u8 intrWaitARM_state;
 
 	BOOL BIOS_loaded;
@@ -324,6 +326,7 @@ struct armcpu_t
 int armcpu_new( armcpu_t *armcpu, u32 id);
 void armcpu_init(armcpu_t *armcpu, u32 adr);
 u32 armcpu_switchMode(armcpu_t *armcpu, u8 mode);
+void armcpu_redecode(armcpu_t *armcpu);
 
 
 BOOL armcpu_irqException(armcpu_t *armcpu);
@@ -338,7 +341,7 @@ extern const armcpu_ctrl_iface arm_default_ctrl_iface;
 
 template<int PROCNUM> u32 armcpu_exec();
 #ifdef HAVE_JIT
-template<int PROCNUM, bool jit> u32 armcpu_exec();
+template<int PROCNUM, bool jit> u32 armcpu_exec(s32 budget);
 #endif
 
 void setIF(int PROCNUM, u32 flag);
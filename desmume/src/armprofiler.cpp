@@ -0,0 +1,147 @@
+/*
+	Copyright (C) 2015 DeSmuME team
+
+	This file is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This file is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with the this software.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "armprofiler.h"
+#include "armcpu.h"
+#include "MMU.h"
+#include "Disassembler.h"
+
+ArmProfiler arm_profiler;
+
+ArmProfiler::ArmProfiler()
+	: enabled(false)
+	, period(1024)
+{
+	reset();
+}
+
+void ArmProfiler::reset()
+{
+	countdown[0] = countdown[1] = (s32)period;
+	sites[0].clear();
+	sites[1].clear();
+}
+
+void ArmProfiler::sample(int proc, u32 adr, bool thumb, bool compiled)
+{
+	//a long run of code may span several periods
+	u64 samples = 0;
+	while(countdown[proc] <= 0)
+	{
+		countdown[proc] += (s32)period;
+		samples++;
+	}
+
+	const armcpu_t &cpu = proc ? NDS_ARM7 : NDS_ARM9;
+	const u32 code = (adr & ~1) | (thumb ? 1 : 0);
+	Site &site = sites[proc][((u64)code << 32) | (cpu.R[14] & ~1)];
+	site.samples += samples;
+	if(compiled)
+		site.compiled += samples;
+}
+
+//the first instruction at the address, as the disassembler puts it.
+//the code is read when reporting, so it may have been replaced since it was sampled
+static std::string describe(int proc, u32 code)
+{
+	const u32 adr = code & ~1;
+	char dasm[256] = {0};
+	if(code & 1)
+	{
+		const u16 op = proc ? _MMU_read16<ARMCPU_ARM7, MMU_AT_DEBUG>(adr) : _MMU_read16<ARMCPU_ARM9, MMU_AT_DEBUG>(adr);
+		des_thumb_instructions_set[op>>6](adr, op, dasm);
+	}
+	else
+	{
+		const u32 op = proc ? _MMU_read32<ARMCPU_ARM7, MMU_AT_DEBUG>(adr) : _MMU_read32<ARMCPU_ARM9, MMU_AT_DEBUG>(adr);
+		des_arm_instructions_set[INSTRUCTION_INDEX(op)](adr, op, dasm);
+	}
+
+	return dasm;
+}
+
+struct FlatSite
+{
+	int proc;
+	u32 code;
+	u64 samples;
+	u64 compiled;
+
+	bool operator<(const FlatSite &other) const { return samples > other.samples; }
+};
+
+void ArmProfiler::writeFlat(FILE *fp)
+{
+	std::vector<FlatSite> flat;
+	u64 total = 0;
+
+	for(int proc = 0; proc < 2; proc++)
+	{
+		//the sites of one address are next to each other, as it is the upper half of the key
+		for(std::map<u64, Site>::const_iterator it = sites[proc].begin(); it != sites[proc].end(); ++it)
+		{
+			const u32 code = (u32)(it->first >> 32);
+			if(flat.empty() || flat.back().proc != proc || flat.back().code != code)
+			{
+				FlatSite site = { proc, code, 0, 0 };
+				flat.push_back(site);
+			}
+			flat.back().samples += it->second.samples;
+			flat.back().compiled += it->second.compiled;
+			total += it->second.samples;
+		}
+	}
+
+	std::stable_sort(flat.begin(), flat.end());
+
+	fprintf(fp, "# cpu address mode samples share first-instruction (one sample per %u cycles)\n", period);
+	for(size_t i = 0; i < flat.size(); i++)
+	{
+		const FlatSite &site = flat[i];
+		const char *mode = (site.compiled == site.samples) ? "jit" : (site.compiled == 0) ? "interp" : "mixed";
+		fprintf(fp, "ARM%c %08X %s/%s %llu %.2f%% %s\n",
+			site.proc ? '7' : '9', site.code & ~1, (site.code & 1) ? "thumb" : "arm", mode,
+			(unsigned long long)site.samples, total ? 100.0 * site.samples / total : 0.0,
+			describe(site.proc, site.code).c_str());
+	}
+}
+
+//flame graph tools split frames on ';'
+static std::string frameName(const std::string &name)
+{
+	std::string ret = name;
+	std::replace(ret.begin(), ret.end(), ';', ',');
+	return ret;
+}
+
+void ArmProfiler::writeCollapsed(FILE *fp)
+{
+	for(int proc = 0; proc < 2; proc++)
+	{
+		for(std::map<u64, Site>::const_iterator it = sites[proc].begin(); it != sites[proc].end(); ++it)
+		{
+			const u32 code = (u32)(it->first >> 32);
+			const u32 lr = (u32)it->first;
+			fprintf(fp, "ARM%c;lr %08X;%08X %s %llu\n", proc ? '7' : '9', lr, code & ~1,
+				frameName(describe(proc, code)).c_str(), (unsigned long long)it->second.samples);
+		}
+	}
+}
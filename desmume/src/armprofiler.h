@@ -0,0 +1,74 @@
+/*
+	Copyright (C) 2015 DeSmuME team
+
+	This file is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This file is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with the this software.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _ARMPROFILER_H_
+#define _ARMPROFILER_H_
+
+#include <stdio.h>
+#include <map>
+
+#include "types.h"
+
+//Where the emulated cpus spend their cycles, by guest code address, to find the game code which makes a workload slow.
+//While enabled, each cpu is sampled once every 'period' of its cycles: the sample goes to the compiled block it was
+//running, or to the instruction being interpreted, together with the link register at that moment as a guess at the caller.
+//Compiled blocks don't chain into each other while profiling, so that every block gets its own samples.
+class ArmProfiler
+{
+public:
+	ArmProfiler();
+
+	bool enabled;
+
+	//cycles between two samples of one cpu
+	u32 period;
+
+	void reset();
+
+	//the cpu ran the code at adr for this many cycles
+	FORCEINLINE void account(int proc, u32 adr, bool thumb, bool compiled, u32 cycles)
+	{
+		countdown[proc] -= (s32)cycles;
+		if(countdown[proc] <= 0)
+			sample(proc, adr, thumb, compiled);
+	}
+
+	//one line per address, hottest first: cpu, address, mode, samples, share, and the first instruction there
+	void writeFlat(FILE *fp);
+
+	//the samples as collapsed stacks ("ARM9;caller;block count"), as taken by flame graph tools
+	void writeCollapsed(FILE *fp);
+
+private:
+	struct Site
+	{
+		Site() : samples(0), compiled(0) {}
+		u64 samples;
+		u64 compiled; //how many of the samples hit compiled code
+	};
+
+	void sample(int proc, u32 adr, bool thumb, bool compiled);
+
+	s32 countdown[2];
+
+	//keyed by the address (with bit 0 set for thumb code) in the upper half and the link register in the lower half
+	std::map<u64, Site> sites[2];
+};
+
+extern ArmProfiler arm_profiler;
+
+#endif
@@ -383,11 +383,12 @@ opengl_Draw( GLuint *texture, int software_convert) {
   if ( software_convert) {
     int i;
     u8 converted[256 * 384 * 3];
+    const u8 *bgra = (const u8 *)GPU_screen32;
 
     for ( i = 0; i < (256 * 384); i++) {
-      converted[(i * 3) + 0] = ((*((u16 *)&GPU_screen[(i<<1)]) >> 0) & 0x1f) << 3;
-      converted[(i * 3) + 1] = ((*((u16 *)&GPU_screen[(i<<1)]) >> 5) & 0x1f) << 3;
-      converted[(i * 3) + 2] = ((*((u16 *)&GPU_screen[(i<<1)]) >> 10) & 0x1f) << 3;
+      converted[(i * 3) + 0] = bgra[(i * 4) + 2];
+      converted[(i * 3) + 1] = bgra[(i * 4) + 1];
+      converted[(i * 3) + 2] = bgra[(i * 4) + 0];
     }
 
     glTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0, 256, 384,
@@ -397,9 +398,9 @@ opengl_Draw( GLuint *texture, int software_convert) {
   }
   else {
     glTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0, 256, 384,
-                     GL_RGBA,
-                     GL_UNSIGNED_SHORT_1_5_5_5_REV,
-                     &GPU_screen);
+                     GL_BGRA,
+                     GL_UNSIGNED_BYTE,
+                     GPU_screen32);
   }
 
   if ((errCode = glGetError()) != GL_NO_ERROR) {
@@ -445,7 +446,11 @@ static void
 Draw( void) {
   SDL_Surface *rawImage;
 
-  rawImage = SDL_CreateRGBSurfaceFrom((void*)&GPU_screen, 256, 384, 16, 512, 0x001F, 0x03E0, 0x7C00, 0);
+#ifdef WORDS_BIGENDIAN
+  rawImage = SDL_CreateRGBSurfaceFrom((void*)GPU_screen32, 256, 384, 32, 1024, 0x0000FF00, 0x00FF0000, 0xFF000000, 0);
+#else
+  rawImage = SDL_CreateRGBSurfaceFrom((void*)GPU_screen32, 256, 384, 32, 1024, 0x00FF0000, 0x0000FF00, 0x000000FF, 0);
+#endif
   if(rawImage == NULL) return;
 
   SDL_BlitSurface(rawImage, 0, surface, 0);
@@ -488,7 +493,7 @@ static void desmume_cycle(struct ctrls_event_config * cfg)
 }
 
 #ifdef HAVE_LIBAGG
-T_AGG_RGB555 agg_targetScreen_cli(GPU_screen, 256, 384, 512);
+T_AGG_RGBA agg_targetScreen_cli((u8*)GPU_screen32, 256, 384, 1024);
 #endif
 
 int main(int argc, char ** argv) {
@@ -520,6 +525,9 @@ int main(int argc, char ** argv) {
 
   NDS_Init();
 
+  /* the screen is displayed (and the hud drawn) in the gpu's 32bit output */
+  GPU_SetOutputFormat(GPU_OUTPUT_BGRA8888);
+
   /* default the firmware settings, they may get changed later */
   NDS_FillDefaultFirmwareConfigData( &fw_config);
 
@@ -742,9 +750,7 @@ int main(int argc, char ** argv) {
 #ifdef HAVE_LIBAGG
   Desmume_InitOnce();
   Hud.reset();
-  // Now that gtk port draws to RGBA buffer directly, the other one
-  // has to use ugly ways to make HUD rendering work again.
-  // desmume gtk: Sorry desmume-cli :(
+  // the hud is drawn over the gpu's 32bit output, which is what gets displayed
   aggDraw.hud = &agg_targetScreen_cli;
   aggDraw.hud->setFont("verdana18_bold");
 #endif
@@ -22,6 +22,7 @@
 #include "../NDSSystem.h"
 #include "../GPU.h"
 #include "../rasterize.h"
+#include "../utils/jobpool.h"
 
 #ifdef MAC_OS_X_VERSION_10_7
 #include "../OGLRender_3_2.h"
@@ -271,7 +272,7 @@ GPU3DInterface *core3DList[] = {
 	
 	pthread_rwlock_wrlock(self.rwlockProducer);
 	
-	CommonSettings.num_cores = numberCores;
+	JobPool_SetWorkerCount(numberCores);
 	
 	if (renderingEngineID == CORE3DLIST_SWRASTERIZE || renderingEngineID == CORE3DLIST_OPENGL)
 	{
@@ -284,7 +285,7 @@ GPU3DInterface *core3DList[] = {
 - (NSUInteger) render3DThreads
 {
 	pthread_rwlock_rdlock(self.rwlockProducer);
-	const NSUInteger numberThreads = isCPUCoreCountAuto ? 0 : (NSUInteger)CommonSettings.num_cores;
+	const NSUInteger numberThreads = isCPUCoreCountAuto ? 0 : (NSUInteger)JobPool_GetWorkerCount();
 	pthread_rwlock_unlock(self.rwlockProducer);
 	
 	return numberThreads;
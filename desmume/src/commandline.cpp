@@ -27,6 +27,10 @@
 #include "slot2.h"
 #include "NDSSystem.h"
 #include "utils/xstring.h"
+#include "utils/jobpool.h"
+#include "texcache.h"
+#include "rewind.h"
+#include "gfx3d.h"
 
 int _scanline_filter_a = 0, _scanline_filter_b = 2, _scanline_filter_c = 2, _scanline_filter_d = 4;
 int _commandline_linux_nojoy = 0;
@@ -50,6 +54,11 @@ CommandLine::CommandLine()
 , _num_cores(-1)
 , _rigorous_timing(0)
 , _advanced_timing(-1)
+, _async_2d(-1)
+, _reuse_2d_lines(-1)
+, _3d_render_scale(-1)
+, _texcache_size(-1)
+, _rewind_size(-1)
 , _slot1(NULL)
 , _slot1_fat_dir(NULL)
 , _slot1_fat_dir_type(false)
@@ -99,13 +108,18 @@ void CommandLine::loadCommonOptions()
 		{ "spu-mode", 0, 0, G_OPTION_ARG_INT, &_spu_sync_mode, "Select SPU Synchronization Mode. 0 - Dual SPU Synch/Asynch (traditional), 1 - Synchronous (sometimes needed for streams) (default 0)", "SPU_MODE"},
 		{ "spu-method", 0, 0, G_OPTION_ARG_INT, &_spu_sync_method, "Select SPU Synchronizer Method. 0 - N, 1 - Z, 2 - P (default 0)", "SPU_SYNC_METHOD"},
 		{ "spu-advanced", 0, 0, G_OPTION_ARG_INT, &_spu_advanced, "Uses advanced SPU capture functions", "SPU_ADVANCED"},
-		{ "num-cores", 0, 0, G_OPTION_ARG_INT, &_num_cores, "Override numcores detection and use this many", "NUM_CORES"},
+		{ "num-cores", 0, 0, G_OPTION_ARG_INT, &_num_cores, "Override numcores detection and run this many worker threads, shared by everything that renders in parallel", "NUM_CORES"},
 		{ "scanline-filter-a", 0, 0, G_OPTION_ARG_INT, &_scanline_filter_a, "Intensity of fadeout for scanlines filter (topleft) (default 0)", "SCANLINE_FILTER_A"},
 		{ "scanline-filter-b", 0, 0, G_OPTION_ARG_INT, &_scanline_filter_b, "Intensity of fadeout for scanlines filter (topright) (default 2)", "SCANLINE_FILTER_B"},
 		{ "scanline-filter-c", 0, 0, G_OPTION_ARG_INT, &_scanline_filter_c, "Intensity of fadeout for scanlines filter (bottomleft) (default 2)", "SCANLINE_FILTER_C"},
 		{ "scanline-filter-d", 0, 0, G_OPTION_ARG_INT, &_scanline_filter_d, "Intensity of fadeout for scanlines filter (bottomright) (default 4)", "SCANLINE_FILTER_D"},
 		{ "rigorous-timing", 0, 0, G_OPTION_ARG_INT, &_rigorous_timing, "Use some rigorous timings instead of unrealistically generous (default 0)", "RIGOROUS_TIMING"},
 		{ "advanced-timing", 0, 0, G_OPTION_ARG_INT, &_advanced_timing, "Use advanced BUS-level timing (default 1)", "ADVANCED_TIMING"},
+		{ "async-2d", 0, 0, G_OPTION_ARG_INT, &_async_2d, "Render 2D scanlines on a worker thread when more than one core is available (default 0)", "ASYNC_2D"},
+		{ "reuse-2d-lines", 0, 0, G_OPTION_ARG_INT, &_reuse_2d_lines, "Copy 2D scanlines whose registers and graphics memory are unchanged since they were last rendered (default 0)", "REUSE_2D_LINES"},
+		{ "3d-render-scale", 0, 0, G_OPTION_ARG_INT, &_3d_render_scale, "Draw 3D with the SoftRasterizer at this many times the DS resolution, and put the screens out at that size too, 1 - 4 (default 1)", "3D_RENDER_SCALE"},
+		{ "texcache-size", 0, 0, G_OPTION_ARG_INT, &_texcache_size, "Megabytes of decoded textures to keep before evicting the least recently used (default 16)", "TEXCACHE_SIZE"},
+		{ "rewind-size", 0, 0, G_OPTION_ARG_INT, &_rewind_size, "Megabytes of rewind history to keep before dropping the oldest (default 64)", "REWIND_SIZE"},
 		{ "slot1", 0, 0, G_OPTION_ARG_STRING, &_slot1, "Device to mount in slot 1 (default retail)", "SLOT1"},
 		{ "slot1-fat-dir", 0, 0, G_OPTION_ARG_STRING, &_slot1_fat_dir, "Directory to scan for slot 1", "SLOT1_DIR"},
 		{ "depth-threshold", 0, 0, G_OPTION_ARG_INT, &depth_threshold, "Depth comparison threshold (default 0)", "DEPTHTHRESHOLD"},
@@ -160,9 +174,14 @@ bool CommandLine::parse(int argc,char **argv)
 	if(_cflash_path) cflash_path = _cflash_path;
 	if(_gbaslot_rom) gbaslot_rom = _gbaslot_rom;
 
-	if(_num_cores != -1) CommonSettings.num_cores = _num_cores;
+	if(_num_cores != -1) JobPool_SetWorkerCount(_num_cores);
 	if(_rigorous_timing) CommonSettings.rigorous_timing = true;
 	if(_advanced_timing != -1) CommonSettings.advanced_timing = _advanced_timing==1;
+	if(_async_2d != -1) CommonSettings.async_2d = _async_2d==1;
+	if(_reuse_2d_lines != -1) CommonSettings.reuse_2d_lines = _reuse_2d_lines==1;
+	if(_3d_render_scale != -1) CommonSettings.GFX3D_RenderScale = _3d_render_scale;
+	if(_texcache_size != -1) TexCache_SetBudget((u32)_texcache_size*1024*1024);
+	if(_rewind_size != -1) rewindStore.setBudget((u32)_rewind_size*1024*1024);
 #ifdef HAVE_JIT
 	if(_cpu_mode != -1) CommonSettings.use_jit = (_cpu_mode==1);
 	if(_jit_size != -1) 
@@ -236,6 +255,35 @@ bool CommandLine::validate()
 		return false;
 	}
 
+#ifdef X432R_CUSTOMRENDERER_ENABLED
+	//the X432R renderer draws its own lines, the memo only sits in the upstream one
+	if (_reuse_2d_lines == 1) {
+		g_printerr("reuse-2d-lines is not supported by the X432R renderer\n");
+		return false;
+	}
+
+	//it has its own magnification setting instead of the softrasterizer scale
+	if (_3d_render_scale > 1) {
+		g_printerr("3d-render-scale is not supported by the X432R renderer\n");
+		return false;
+	}
+#endif
+
+	if (_3d_render_scale != -1 && (_3d_render_scale < 1 || _3d_render_scale > GFX3D_MAX_RENDER_SCALE)) {
+		g_printerr("Invalid 3D render scale (1 - %d)\n", GFX3D_MAX_RENDER_SCALE);
+		return false;
+	}
+
+	if (_texcache_size < -1 || _texcache_size > 4095) {
+		g_printerr("Invalid texcache size (megabytes, 0 - 4095)\n");
+		return false;
+	}
+
+	if (_rewind_size < -1 || _rewind_size > 4095) {
+		g_printerr("Invalid rewind size (megabytes, 0 - 4095)\n");
+		return false;
+	}
+
 	if (load_slot < -1 || load_slot > 10) {
 		g_printerr("I only know how to load from slots 0-10; -1 means 'do not load savegame' and is default\n");
 		return false;
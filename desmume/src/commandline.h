@@ -94,6 +94,11 @@ private:
 	int _num_cores;
 	int _rigorous_timing;
 	int _advanced_timing;
+	int _async_2d;
+	int _reuse_2d_lines;
+	int _3d_render_scale;
+	int _texcache_size;
+	int _rewind_size;
 #ifdef HAVE_JIT
 	int _cpu_mode;
 	int _jit_size;
@@ -111,7 +111,7 @@ VideoFilter::VideoFilter(size_t srcWidth,
 	ThreadLockInit(&_lockAttributes);
 	ThreadCondInit(&_condRunning);
 	
-	// Create all threads
+	// Set up one image slice per thread
 	_vfThread.resize(threadCount);
 	
 	for (size_t i = 0; i < threadCount; i++)
@@ -119,9 +119,6 @@ VideoFilter::VideoFilter(size_t srcWidth,
 		_vfThread[i].param.srcSurface = _vfSrcSurface;
 		_vfThread[i].param.dstSurface = _vfDstSurface;
 		_vfThread[i].param.filterFunction = NULL;
-		
-		_vfThread[i].task = new Task;
-		_vfThread[i].task->start(false);
 	}
 	
 	_vfFunc = _vfAttributes.filterFunction;
@@ -133,15 +130,8 @@ VideoFilter::VideoFilter(size_t srcWidth,
  ********************************************************************************************/
 VideoFilter::~VideoFilter()
 {
-	// Destroy all threads first
-	for (size_t i = 0; i < _vfThread.size(); i++)
-	{
-		_vfThread[i].task->finish();
-		_vfThread[i].task->shutdown();
-		
-		delete _vfThread[i].task;
-	}
-	
+	// Wait for any slices still being filtered first
+	_vfJobs.wait();
 	_vfThread.clear();
 	
 	// Destroy everything else
@@ -482,13 +472,10 @@ uint32_t* VideoFilter::RunFilter()
 		{
 			for (size_t i = 0; i < threadCount; i++)
 			{
-				this->_vfThread[i].task->execute(&RunVideoFilterTask, &this->_vfThread[i].param);
+				this->_vfJobs.run(&RunVideoFilterTask, &this->_vfThread[i].param, (int)i);
 			}
 			
-			for (size_t i = 0; i < threadCount; i++)
-			{
-				this->_vfThread[i].task->finish();
-			}
+			this->_vfJobs.wait();
 		}
 		else
 		{
@@ -25,7 +25,7 @@
 
 #include "types.h"
 #include "filter.h"
-#include "../utils/task.h"
+#include "../utils/jobpool.h"
 
 #ifdef HOST_WINDOWS
 	typedef unsigned __int32 uint32_t;
@@ -117,9 +117,9 @@ typedef struct
 	VideoFilterFunc filterFunction;
 } VideoFilterThreadParam;
 
+// One slice of the image; each slice is filtered as a job on the shared JobPool
 typedef struct
 {
-	Task *task;
 	VideoFilterThreadParam param;
 } VideoFilterThread;
 
@@ -155,6 +155,7 @@ private:
 	uint32_t *_vfSrcSurfacePixBuffer;
 	VideoFilterFunc _vfFunc;
 	std::vector<VideoFilterThread> _vfThread;
+	JobGroup _vfJobs;
 	bool _useInternalDstBuffer;
 	
 	bool _isFilterRunning;
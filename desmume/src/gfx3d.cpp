@@ -309,6 +309,8 @@ static float normalTable[1024];
 #define fix10_2float(v) (((float)((s32)(v))) / (float)(1<<9))
 
 CACHE_ALIGN u8 gfx3d_convertedScreen[GFX3D_FRAMEBUFFER_WIDTH*GFX3D_FRAMEBUFFER_HEIGHT*4];
+u8 *gfx3d_highResScreen = gfx3d_convertedScreen;
+int gfx3d_highResScale = 1;
 
 // Matrix stack handling
 CACHE_ALIGN MatrixStack	mtxStack[4] = {
@@ -600,6 +602,8 @@ void gfx3d_reset()
 	viewport = 0xBFFF0000;
 
 	memset(gfx3d_convertedScreen,0,sizeof(gfx3d_convertedScreen));
+	gfx3d_highResScreen = gfx3d_convertedScreen;
+	gfx3d_highResScale = 1;
 
 	gfx3d.state.clearDepth = DS_DEPTH15TO24(0x7FFF);
 	
@@ -2233,10 +2237,17 @@ void gfx3d_VBlankEndSignal(bool skipFrame)
 
 	if(!CommonSettings.showGpu.main)
 	{
+		//the last frame may still be drawing into it
+		gpu3D->NDS_3D_RenderFinish();
 		memset(gfx3d_convertedScreen,0,sizeof(gfx3d_convertedScreen));
+		gfx3d_highResScreen = gfx3d_convertedScreen;
+		gfx3d_highResScale = 1;
 		return;
 	}
 	
+	NDS_ProfileScope profileScope(NDS_PROFILE_GPU3D);
+	gfx3d_highResScreen = gfx3d_convertedScreen;
+	gfx3d_highResScale = 1;
 	gpu3D->NDS_3D_Render();
 }
 
@@ -2348,7 +2359,10 @@ void gfx3d_glGetLightColor(unsigned int index, unsigned int* dest)
 
 void gfx3d_GetLineData(int line, u8** dst)
 {
-	gpu3D->NDS_3D_RenderFinish();
+	{
+		NDS_ProfileScope profileScope(NDS_PROFILE_GPU3D);
+		gpu3D->NDS_3D_RenderFinish();
+	}
 	*dst = gfx3d_convertedScreen+((line)<<(8+2));
 }
 
@@ -2498,6 +2512,10 @@ bool gfx3d_loadstate(EMUFILE* is, int size)
 	if(size==8) version = 0;
 
 
+	//the frame in gfx3d_convertedScreen is the one from the state
+	gfx3d_highResScreen = gfx3d_convertedScreen;
+	gfx3d_highResScale = 1;
+
 	gfx3d_glPolygonAttrib_cache();
 	gfx3d_glTexImage_cache();
 	gfx3d_glLightDirection_cache(0);
@@ -31,6 +31,9 @@ class EMUFILE;
 #define GFX3D_FRAMEBUFFER_WIDTH		256
 #define GFX3D_FRAMEBUFFER_HEIGHT	192
 
+// The largest multiple of that a renderer may draw at (see CommonSettings.GFX3D_RenderScale)
+#define GFX3D_MAX_RENDER_SCALE		4
+
 //geometry engine command numbers
 #define GFX3D_NOP 0x00
 #define GFX3D_MTX_MODE 0x10
@@ -730,6 +733,12 @@ extern CACHE_ALIGN const u8 material_3bit_to_8bit[8];
 extern CACHE_ALIGN u8 gfx3d_convertedScreen[GFX3D_FRAMEBUFFER_WIDTH*GFX3D_FRAMEBUFFER_HEIGHT*4];
 extern CACHE_ALIGN u8 gfx3d_convertedAlpha[GFX3D_FRAMEBUFFER_WIDTH*GFX3D_FRAMEBUFFER_HEIGHT*2]; //see cpp for explanation of illogical *2
 
+//the last frame at gfx3d_highResScale times the size of gfx3d_convertedScreen, in the same format.
+//a renderer which draws larger frames points these at its own in NDS_3D_Render; otherwise they are gfx3d_convertedScreen and 1.
+//like gfx3d_convertedScreen, read them only after gfx3d_GetLineData has waited for the frame
+extern u8 *gfx3d_highResScreen;
+extern int gfx3d_highResScale;
+
 extern BOOL isSwapBuffers;
 
 int _hack_getMatrixStackLevel(int);
@@ -1410,6 +1410,7 @@ static void Reset()
     NDS_Reset();
     // Clear the NDS screen
     memset(GPU_screen, 0xFF, sizeof(GPU_screen));
+    GPU_ConvertScreen();
     RedrawScreen();
     if (shouldBeRunning) {
         Launch();
@@ -1515,14 +1516,6 @@ static inline uint32_t RGB555ToRGBA8888(const uint16_t color16)
 			0xFF000000;
 }
 
-static inline uint32_t RGB555ToBGRA8888(const uint16_t color16)
-{
-	return	(bits5to8[((color16 >> 10) & 0x001F)] << 0) |
-			(bits5to8[((color16 >> 5) & 0x001F)] << 8) |
-			(bits5to8[((color16 >> 0) & 0x001F)] << 16) |
-			0xFF000000;
-}
-
 // Adapted from Cocoa port
 static inline void RGB555ToRGBA8888Buffer(const uint16_t *__restrict__ srcBuffer, uint32_t *__restrict__ destBuffer, size_t pixelCount)
 {
@@ -1534,16 +1527,6 @@ static inline void RGB555ToRGBA8888Buffer(const uint16_t *__restrict__ srcBuffer
 	}
 }
 
-static inline void RGB555ToBGRA8888Buffer(const uint16_t *__restrict__ srcBuffer, uint32_t *__restrict__ destBuffer, size_t pixelCount)
-{
-	const uint32_t *__restrict__ destBufferEnd = destBuffer + pixelCount;
-	
-	while (destBuffer < destBufferEnd)
-	{
-		*destBuffer++ = RGB555ToBGRA8888(*srcBuffer++);
-	}
-}
-
 static inline void gpu_screen_to_rgb(u32* dst)
 {
     RGB555ToRGBA8888Buffer((u16*)GPU_screen, dst, 256 * 384);
@@ -1671,7 +1654,7 @@ static gboolean ExposeDrawingArea (GtkWidget *widget, GdkEventExpose *event, gpo
 }
 
 static void RedrawScreen() {
-	RGB555ToBGRA8888Buffer((u16*)GPU_screen, video->GetSrcBufferPtr(), 256 * 384);
+	memcpy(video->GetSrcBufferPtr(), GPU_screen32, sizeof(GPU_screen32));
 #ifdef HAVE_LIBAGG
 	aggDraw.hud->attach((u8*)video->GetSrcBufferPtr(), 256, 384, 1024);
 	osd->update();
@@ -2969,8 +2952,10 @@ common_gtk_main( class configured_features *my_config)
     memset(&nds_screen, 0, sizeof(nds_screen));
     nds_screen.orientation = ORIENT_VERTICAL;
 
-    g_printerr("Using %d threads for video filter.\n", CommonSettings.num_cores);
-    video = new VideoFilter(256, 384, VideoFilterTypeID_None, CommonSettings.num_cores);
+    g_printerr("Using %d threads for video filter.\n", JobPool_GetWorkerCount());
+    video = new VideoFilter(256, 384, VideoFilterTypeID_None, JobPool_GetWorkerCount());
+    //the filters take the screen as it is in memory
+    GPU_SetOutputFormat(GPU_OUTPUT_BGRA8888);
 
     /* Create the window */
     pWindow = gtk_window_new(GTK_WINDOW_TOPLEVEL);
@@ -0,0 +1,298 @@
+/* main.cpp - this file is part of DeSmuME
+ *
+ * Copyright (C) 2015 DeSmuME Team
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+//A frontend with no window, no sound output and no frame limiter.
+//It runs a rom (optionally replaying a movie) for a fixed number of frames as fast as possible
+//and reports where the time went, so that runs can be compared across builds and machines.
+//With --capture it also keeps the last frame, at the 3d render scale, for reviewing the rendering.
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <glib.h>
+#include <zlib.h>
+
+#include "../NDSSystem.h"
+#include "../common.h"
+#include "../driver.h"
+#include "../GPU.h"
+#include "../SPU.h"
+#include "../render3D.h"
+#include "../rasterize.h"
+#include "../saves.h"
+#include "../movie.h"
+#include "../mc.h"
+#include "../commandline.h"
+#include "../slot2.h"
+#include "../texcache.h"
+#include "../utils/perftimer.h"
+#include "../armprofiler.h"
+
+volatile bool execute = false;
+
+SoundInterface_struct *SNDCoreList[] = {
+  &SNDDummy,
+  NULL
+};
+
+GPU3DInterface *core3DList[] = {
+  &gpu3DNull,
+  &gpu3DRasterize,
+  NULL
+};
+
+class HeadlessDriver : public BaseDriver
+{
+public:
+  virtual void USR_InfoMessage(const char *message)
+  {
+    fprintf(stderr, "%s\n", message);
+  }
+};
+
+class configured_features : public CommandLine
+{
+public:
+  int frames;
+  int engine_3d;
+  int savetype;
+  int frame_hash;
+  char *_report_file;
+  std::string report_file;
+  char *_cpu_profile_file;
+  std::string cpu_profile_file;
+  char *_cpu_stacks_file;
+  std::string cpu_stacks_file;
+  int cpu_profile_period;
+  char *_capture_file;
+  std::string capture_file;
+};
+
+static void
+init_config(configured_features *config)
+{
+  config->frames = 600;
+  config->engine_3d = 1;
+  config->savetype = 0;
+  config->frame_hash = 0;
+  config->_report_file = NULL;
+  config->_cpu_profile_file = NULL;
+  config->_cpu_stacks_file = NULL;
+  config->cpu_profile_period = 1024;
+  config->_capture_file = NULL;
+}
+
+static int
+fill_config(configured_features *config, int argc, char **argv)
+{
+  GOptionEntry options[] = {
+    { "frames", 0, 0, G_OPTION_ARG_INT, &config->frames, "Number of frames to emulate (default 600)", "FRAMES"},
+    { "3d-engine", 0, 0, G_OPTION_ARG_INT, &config->engine_3d, "Select 3d rendering engine. Available engines:\n"
+        "\t\t\t\t\t\t  0 = 3d disabled\n"
+        "\t\t\t\t\t\t  1 = internal rasterizer (default)\n"
+        ,"ENGINE"},
+    { "save-type", 0, 0, G_OPTION_ARG_INT, &config->savetype, "Select savetype (see desmume-cli --help, default 0 = autodetect)", "SAVETYPE"},
+    { "frame-hash", 0, 0, G_OPTION_ARG_NONE, &config->frame_hash, "Report a crc32 of both screens after every frame", NULL},
+    { "report", 0, 0, G_OPTION_ARG_FILENAME, &config->_report_file, "Write the report to this file instead of stdout", "PATH"},
+    { "cpu-profile", 0, 0, G_OPTION_ARG_FILENAME, &config->_cpu_profile_file, "Sample both cpus and write where they spent their cycles to this file", "PATH"},
+    { "cpu-profile-stacks", 0, 0, G_OPTION_ARG_FILENAME, &config->_cpu_stacks_file, "Sample both cpus and write the samples as collapsed stacks to this file", "PATH"},
+    { "cpu-profile-period", 0, 0, G_OPTION_ARG_INT, &config->cpu_profile_period, "Cycles between two cpu profile samples (default 1024)", "CYCLES"},
+    { "capture", 0, 0, G_OPTION_ARG_FILENAME, &config->_capture_file, "Write both screens of the last frame to this bmp file, at the size set by --3d-render-scale", "PATH"},
+    { NULL }
+  };
+
+  config->loadCommonOptions();
+  g_option_context_add_main_entries(config->ctx, options, "options");
+  if(!config->parse(argc, argv))
+    goto error;
+
+  if(config->_report_file)
+    config->report_file = config->_report_file;
+  if(config->_cpu_profile_file)
+    config->cpu_profile_file = config->_cpu_profile_file;
+  if(config->_cpu_stacks_file)
+    config->cpu_stacks_file = config->_cpu_stacks_file;
+  if(config->_capture_file)
+    config->capture_file = config->_capture_file;
+
+  if(!config->validate())
+    goto error;
+
+  if(config->frames <= 0) {
+    g_printerr("Frames must be > 0.\n");
+    goto error;
+  }
+
+  if(config->engine_3d != 0 && config->engine_3d != 1) {
+    g_printerr("Currently available engines: 0, 1.\n");
+    goto error;
+  }
+
+  if(config->cpu_profile_period <= 0) {
+    g_printerr("The cpu profile period must be > 0.\n");
+    goto error;
+  }
+
+  if(config->savetype < 0 || config->savetype > 6) {
+    g_printerr("Accepted savetypes are from 0 to 6.\n");
+    goto error;
+  }
+
+  if(config->nds_file == "") {
+    g_printerr("Need to specify file to load.\n");
+    goto error;
+  }
+
+  return 1;
+
+error:
+  config->errorHelp(argv[0]);
+  return 0;
+}
+
+static const char *profile_names[NDS_PROFILE_COUNT] = {
+  "other", "cpu", "gpu2d", "gpu3d", "spu"
+};
+
+static void
+write_cpu_profile(const std::string &path, void (ArmProfiler::*write)(FILE *))
+{
+  FILE *fp = fopen(path.c_str(), "w");
+  if(!fp) {
+    fprintf(stderr, "could not open %s for writing\n", path.c_str());
+    return;
+  }
+  (arm_profiler.*write)(fp);
+  fclose(fp);
+}
+
+static void
+write_capture(const std::string &path)
+{
+  const u32 scale = GPU_GetHighResScale();
+  const u32 *screen = scale > 1 ? GPU_GetHighResScreen() : GPU_screen32;
+  if(!NDS_WriteBMP_32bppBuffer(256 * scale, 384 * scale, screen, path.c_str()))
+    fprintf(stderr, "could not open %s for writing\n", path.c_str());
+}
+
+int main(int argc, char **argv)
+{
+  configured_features my_config;
+  FILE *report = stdout;
+
+  NDS_Init();
+
+  init_config(&my_config);
+  if(!fill_config(&my_config, argc, argv))
+    exit(1);
+
+  my_config.process_addonCommands();
+  slot2_Init();
+  slot2_Change(my_config.is_cflash_configured ? NDS_SLOT2_CFLASH : NDS_SLOT2_AUTO);
+
+  if(my_config.report_file != "") {
+    report = fopen(my_config.report_file.c_str(), "w");
+    if(!report) {
+      fprintf(stderr, "could not open %s for writing\n", my_config.report_file.c_str());
+      exit(1);
+    }
+  }
+
+  driver = new HeadlessDriver();
+
+  SPU_ChangeSoundCore(SNDCORE_DUMMY, 0);
+  NDS_3D_ChangeCore(my_config.engine_3d);
+  backup_setManualBackupType(my_config.savetype);
+
+  //the bmp writer takes the bytes in rgba order
+  if(my_config.capture_file != "")
+    GPU_SetOutputFormat(GPU_OUTPUT_RGBA8888);
+
+  if(NDS_LoadROM(my_config.nds_file.c_str()) < 0) {
+    fprintf(stderr, "error while loading %s\n", my_config.nds_file.c_str());
+    exit(-1);
+  }
+
+  if(my_config.load_slot != -1)
+    loadstate_slot(my_config.load_slot);
+
+  my_config.process_movieCommands();
+
+  execute = true;
+
+  const u64 freq = getPerfTicksPerSecond();
+  nds_profile.reset();
+  nds_profile.enabled = true;
+
+  arm_profiler.period = my_config.cpu_profile_period;
+  arm_profiler.reset();
+  arm_profiler.enabled = my_config.cpu_profile_file != "" || my_config.cpu_stacks_file != "";
+
+  TexCache_ResetStats();
+
+  const u64 start = getPerfTicks();
+  int frame;
+  for(frame = 0; frame < my_config.frames && execute; frame++) {
+    FCEUMOV_AddInputState();
+    NDS_exec<false>();
+
+    if(my_config.frame_hash) {
+      const u32 crc = crc32(0, GPU_screen, sizeof(GPU_screen));
+      fprintf(report, "frame %d %08X\n", frame, crc);
+    }
+  }
+  const u64 elapsed = getPerfTicks() - start;
+
+  nds_profile.enabled = false;
+  arm_profiler.enabled = false;
+
+  const double seconds = (double)elapsed / (double)freq;
+  fprintf(report, "frames %d\n", frame);
+  fprintf(report, "seconds %.3f\n", seconds);
+  fprintf(report, "fps %.2f\n", seconds > 0 ? frame / seconds : 0.0);
+
+  for(int i = 0; i < NDS_PROFILE_COUNT; i++) {
+    const double subsystem_seconds = (double)nds_profile.ticks[i] / (double)freq;
+    fprintf(report, "time_%s %.3f (%.1f%%)\n", profile_names[i], subsystem_seconds,
+            seconds > 0 ? 100.0 * subsystem_seconds / seconds : 0.0);
+  }
+
+  const TexCacheStats texcache = TexCache_GetTotalStats();
+  const u32 lookups = texcache.hits + texcache.decodes;
+  fprintf(report, "texcache_hits %u (%.1f%%)\n", texcache.hits, lookups ? 100.0 * texcache.hits / lookups : 0.0);
+  fprintf(report, "texcache_misses %u\n", texcache.misses);
+  fprintf(report, "texcache_decodes %u (%.1f MB)\n", texcache.decodes, texcache.bytesDecoded / (1024.0 * 1024.0));
+  fprintf(report, "texcache_evictions %u\n", texcache.evictions);
+  fprintf(report, "texcache_size %u items, %.1f MB\n", texcache.items, texcache.bytes / (1024.0 * 1024.0));
+
+  if(my_config.cpu_profile_file != "")
+    write_cpu_profile(my_config.cpu_profile_file, &ArmProfiler::writeFlat);
+  if(my_config.cpu_stacks_file != "")
+    write_cpu_profile(my_config.cpu_stacks_file, &ArmProfiler::writeCollapsed);
+  if(my_config.capture_file != "")
+    write_capture(my_config.capture_file);
+
+  if(report != stdout)
+    fclose(report);
+
+  NDS_DeInit();
+
+  return 0;
+}
@@ -0,0 +1,400 @@
+/*
+	Copyright (C) 2015 DeSmuME team
+
+	This file is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This file is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with the this software.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "idleloop.h"
+#include "bits.h"
+#include "armcpu.h"
+#include "MMU.h"
+
+//marks a load without a base or an index register
+#define REG_NONE 0xFF
+
+//the address of a load is (base register or base_value) plus or minus (index register << shift, or offset)
+struct IdleLoad
+{
+	u8 base;
+	u8 index;
+	u8 shift;
+	u8 subtract;
+	u32 base_value;
+	u32 offset;
+};
+
+struct IdleLoop
+{
+	u32 head;
+	u32 branch_adr;
+	u32 opcodes[IDLELOOP_MAX_INSTRUCTIONS];
+	u8 count; //0 for an unused entry
+	u8 thumb;
+	u8 idle;
+	u8 loadCount;
+	IdleLoad loads[IDLELOOP_MAX_INSTRUCTIONS];
+};
+
+//the verdicts for the loops seen lately, indexed by the address of the branch back.
+//a loop whose first or last instruction was rewritten misses, and one found idle has all its code compared again
+#define IDLELOOP_CACHE_SIZE 64
+static IdleLoop cache[2][IDLELOOP_CACHE_SIZE];
+
+template<int PROCNUM>
+static FORCEINLINE u32 readOpcode(u32 adr, bool thumb)
+{
+	return thumb ? _MMU_read16<PROCNUM, MMU_AT_CODE>(adr) : _MMU_read32<PROCNUM, MMU_AT_CODE>(adr);
+}
+
+static void addLoad(IdleLoop &loop, u32 base, u32 base_value, u32 index, u32 shift, u32 offset, bool subtract)
+{
+	IdleLoad &load = loop.loads[loop.loadCount++];
+	load.base = (u8)base;
+	load.base_value = base_value;
+	load.index = (u8)index;
+	load.shift = (u8)shift;
+	load.offset = offset;
+	load.subtract = subtract ? 1 : 0;
+}
+
+//works out which registers an arm instruction of the loop body reads and writes;
+//false for anything which may have a side effect or depend on the carry of the previous pass
+static bool decodeArm(IdleLoop &loop, u32 opcode, u32 adr, u32 &read, u32 &write)
+{
+	if(CONDITION(opcode) != 0xE) return false;
+
+	const u32 rn = REG_POS(opcode,16);
+	const u32 rd = REG_POS(opcode,12);
+	const u32 rm = REG_POS(opcode,0);
+
+	if((opcode & 0x0E000090) == 0x00000090)
+	{
+		//ldrh, ldrsh, ldrsb with offset addressing; everything else here is a store, a multiply or a swap
+		if(!(opcode & 0x60) || !BIT20(opcode) || !BIT24(opcode) || BIT21(opcode) || rd == 15) return false;
+		if(!BIT22(opcode) && rm == 15) return false;
+
+		const u32 base = (rn == 15) ? REG_NONE : rn;
+		if(BIT22(opcode))
+			addLoad(loop, base, adr + 8, REG_NONE, 0, ((opcode >> 4) & 0xF0) | (opcode & 0xF), !BIT23(opcode));
+		else
+		{
+			addLoad(loop, base, adr + 8, rm, 0, 0, !BIT23(opcode));
+			read |= 1 << rm;
+		}
+		read |= 1 << rn;
+		write = 1 << rd;
+		return true;
+	}
+
+	if((opcode & 0x0C000000) == 0x00000000)
+	{
+		const u32 alu = (opcode >> 21) & 0xF;
+		if(alu >= 0x8 && alu <= 0xB && !BIT20(opcode)) return false; //mrs, msr, bx and friends
+		if(alu >= 0x5 && alu <= 0x7) return false; //adc, sbc and rsc read the carry
+
+		if(!BIT25(opcode))
+		{
+			if(BIT4(opcode)) return false; //shifts by a register
+			if(((opcode >> 5) & 3) == 3 && ((opcode >> 7) & 0x1F) == 0) return false; //rrx reads the carry
+			read |= 1 << rm;
+		}
+		if(alu != 0xD && alu != 0xF)
+			read |= 1 << rn;
+		if(alu < 0x8 || alu > 0xB)
+		{
+			if(rd == 15) return false;
+			write = 1 << rd;
+		}
+		return true;
+	}
+
+	if((opcode & 0x0C000000) == 0x04000000)
+	{
+		//ldr, ldrb with offset addressing
+		if(!BIT20(opcode) || !BIT24(opcode) || BIT21(opcode) || rd == 15) return false;
+
+		const u32 base = (rn == 15) ? REG_NONE : rn;
+		if(BIT25(opcode))
+		{
+			//only index registers shifted to the left
+			if(BIT4(opcode) || ((opcode >> 5) & 3) != 0 || rm == 15) return false;
+			addLoad(loop, base, adr + 8, rm, (opcode >> 7) & 0x1F, 0, !BIT23(opcode));
+			read |= 1 << rm;
+		}
+		else
+			addLoad(loop, base, adr + 8, REG_NONE, 0, opcode & 0xFFF, !BIT23(opcode));
+		read |= 1 << rn;
+		write = 1 << rd;
+		return true;
+	}
+
+	return false;
+}
+
+static bool decodeThumb(IdleLoop &loop, u32 opcode, u32 adr, u32 &read, u32 &write)
+{
+	const u32 rd = opcode & 7;
+	const u32 rs = (opcode >> 3) & 7;
+	const u32 rh = (opcode >> 8) & 7;
+
+	switch(opcode >> 11)
+	{
+		case 0x00: case 0x01: case 0x02: //lsl, lsr, asr #imm
+			read = 1 << rs;
+			write = 1 << rd;
+			return true;
+
+		case 0x03: //add, sub with a register or a 3 bit immediate
+			read = 1 << rs;
+			if(!BIT10(opcode)) read |= 1 << ((opcode >> 6) & 7);
+			write = 1 << rd;
+			return true;
+
+		case 0x04: //mov #imm
+			write = 1 << rh;
+			return true;
+
+		case 0x05: //cmp #imm
+			read = 1 << rh;
+			return true;
+
+		case 0x06: case 0x07: //add, sub #imm
+			read = write = 1 << rh;
+			return true;
+
+		case 0x08:
+			if(!BIT10(opcode))
+			{
+				const u32 alu = (opcode >> 6) & 0xF;
+				if(alu == 0x5 || alu == 0x6) return false; //adc and sbc read the carry
+				read = 1 << rs;
+				if(alu != 0x9 && alu != 0xF) read |= 1 << rd; //neg and mvn only read rs
+				if(alu != 0x8 && alu != 0xA && alu != 0xB) write = 1 << rd; //tst, cmp and cmn only set flags
+				return true;
+			}
+			else
+			{
+				const u32 hd = rd | ((opcode >> 4) & 8);
+				const u32 hs = (opcode >> 3) & 0xF;
+				switch((opcode >> 8) & 3)
+				{
+					case 0: //add
+						if(hd == 15) return false;
+						read = (1 << hd) | (1 << hs);
+						write = 1 << hd;
+						return true;
+					case 1: //cmp
+						read = (1 << hd) | (1 << hs);
+						return true;
+					case 2: //mov
+						if(hd == 15) return false;
+						read = 1 << hs;
+						write = 1 << hd;
+						return true;
+					default: //bx, blx
+						return false;
+				}
+			}
+
+		case 0x09: //ldr rd, [pc, #imm]
+			addLoad(loop, REG_NONE, (adr + 4) & ~3, REG_NONE, 0, (opcode & 0xFF) << 2, false);
+			write = 1 << rh;
+			return true;
+
+		case 0x0A: case 0x0B: //loads and stores with a register offset
+			if(((opcode >> 9) & 7) < 3) return false; //str, strh, strb
+			addLoad(loop, rs, 0, (opcode >> 6) & 7, 0, 0, false);
+			read = (1 << rs) | (1 << ((opcode >> 6) & 7));
+			write = 1 << rd;
+			return true;
+
+		case 0x0D: //ldr rd, [rs, #imm]
+			addLoad(loop, rs, 0, REG_NONE, 0, ((opcode >> 6) & 0x1F) << 2, false);
+			read = 1 << rs;
+			write = 1 << rd;
+			return true;
+
+		case 0x0F: //ldrb rd, [rs, #imm]
+			addLoad(loop, rs, 0, REG_NONE, 0, (opcode >> 6) & 0x1F, false);
+			read = 1 << rs;
+			write = 1 << rd;
+			return true;
+
+		case 0x11: //ldrh rd, [rs, #imm]
+			addLoad(loop, rs, 0, REG_NONE, 0, ((opcode >> 6) & 0x1F) << 1, false);
+			read = 1 << rs;
+			write = 1 << rd;
+			return true;
+
+		case 0x13: //ldr rd, [sp, #imm]
+			addLoad(loop, 13, 0, REG_NONE, 0, (opcode & 0xFF) << 2, false);
+			read = 1 << 13;
+			write = 1 << rh;
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+//the target of a plain branch, or 0xFFFFFFFF for anything else
+static u32 branchTarget(u32 opcode, u32 adr, bool thumb)
+{
+	if(thumb)
+	{
+		if((opcode & 0xF000) == 0xD000 && ((opcode >> 8) & 0xF) < 0xE)
+			return adr + 4 + ((u32)(s8)(opcode & 0xFF) << 1);
+		if((opcode & 0xF800) == 0xE000)
+			return adr + 4 + ((u32)((s32)(opcode << 21) >> 20));
+		return 0xFFFFFFFF;
+	}
+
+	if((opcode & 0x0F000000) == 0x0A000000 && CONDITION(opcode) != 0xF)
+		return adr + 8 + ((u32)((s32)(opcode << 8) >> 6));
+	return 0xFFFFFFFF;
+}
+
+static void analyze(IdleLoop &loop)
+{
+	const u32 size = loop.thumb ? 2 : 4;
+
+	loop.idle = 0;
+	loop.loadCount = 0;
+
+	if(branchTarget(loop.opcodes[loop.count-1], loop.branch_adr, loop.thumb != 0) != loop.head)
+		return;
+
+	//every register has to be either left alone or written, once, before the loop reads it;
+	//otherwise something is carried from one pass to the next (a counter, a pointer) and the loop makes progress
+	u32 inputs = 0, written = 0;
+	for(u32 i = 0; i < (u32)loop.count-1; i++)
+	{
+		u32 read = 0, write = 0;
+		const u32 adr = loop.head + i*size;
+		if(!(loop.thumb ? decodeThumb(loop, loop.opcodes[i], adr, read, write) : decodeArm(loop, loop.opcodes[i], adr, read, write)))
+			return;
+		inputs |= read & ~written;
+		if(write & written) return;
+		written |= write;
+	}
+	if(inputs & written) return;
+
+	loop.idle = 1;
+}
+
+template<int PROCNUM>
+static const IdleLoop* lookup(u32 head, u32 branch_adr, bool thumb)
+{
+	const u32 size = thumb ? 2 : 4;
+	const u32 distance = branch_adr - head;
+	if(distance >= IDLELOOP_MAX_INSTRUCTIONS*size || (distance & (size-1)))
+		return NULL;
+
+	const u32 count = distance/size + 1;
+	IdleLoop &loop = cache[PROCNUM][(branch_adr/size) & (IDLELOOP_CACHE_SIZE-1)];
+
+	bool hit = loop.count == count && loop.head == head && loop.branch_adr == branch_adr && loop.thumb == (thumb ? 1 : 0)
+		&& loop.opcodes[count-1] == readOpcode<PROCNUM>(branch_adr, thumb)
+		&& loop.opcodes[0] == readOpcode<PROCNUM>(head, thumb);
+
+	//an overlay may have put other code between the same first and last instructions
+	if(hit && loop.idle)
+	{
+		for(u32 i = 1; i < count-1; i++)
+			if(loop.opcodes[i] != readOpcode<PROCNUM>(head + i*size, thumb))
+			{
+				hit = false;
+				break;
+			}
+	}
+
+	if(!hit)
+	{
+		loop.head = head;
+		loop.branch_adr = branch_adr;
+		loop.count = (u8)count;
+		loop.thumb = thumb ? 1 : 0;
+		for(u32 i = 0; i < count; i++)
+			loop.opcodes[i] = readOpcode<PROCNUM>(head + i*size, thumb);
+		analyze(loop);
+	}
+
+	return loop.idle ? &loop : NULL;
+}
+
+//whether reading this address neither has a side effect nor returns something which changes by itself.
+//memory and most registers only change when the other cpu, a dma or an event writes them,
+//but the timer counters run on their own and reading the ipc or gamecard fifo pops it
+template<int PROCNUM>
+static bool quietAddress(u32 adr)
+{
+	if(PROCNUM == ARMCPU_ARM9)
+	{
+		if((adr & ~0x3FFF) == MMU.DTCMRegion) return true;
+		if(adr < 0x02000000) return true; //itcm
+	}
+
+	switch(adr >> 24)
+	{
+		case 0x02: //main memory
+		case 0x03: //shared and arm7 wram
+			return true;
+
+		case 0x04:
+			if(adr < 0x04000100) return true; //display status, vcount and dma
+			if(adr >= 0x04000130 && adr < 0x04000138) return true; //keypad
+			if(adr >= 0x04000180 && adr < 0x04000188) return true; //ipcsync, ipcfifocnt
+			if(adr >= 0x04000200 && adr < 0x04000220) return true; //ime, ie, if
+			if(PROCNUM == ARMCPU_ARM9)
+			{
+				if(adr >= 0x04000280 && adr < 0x040002C0) return true; //divider and square root
+				if(adr >= 0x04000600 && adr < 0x04000604) return true; //gxstat
+			}
+			return false;
+
+		default:
+			return false;
+	}
+}
+
+template<int PROCNUM>
+bool idleloop_candidate(u32 head, u32 branch_adr, bool thumb)
+{
+	return lookup<PROCNUM>(head, branch_adr, thumb) != NULL;
+}
+
+template<int PROCNUM>
+bool idleloop_check(u32 head, u32 branch_adr, bool thumb)
+{
+	const IdleLoop *loop = lookup<PROCNUM>(head, branch_adr, thumb);
+	if(!loop) return false;
+
+	//a register used to address a load is either never written in the loop or written before the load,
+	//so its value after the pass is the one the load used
+	for(u32 i = 0; i < loop->loadCount; i++)
+	{
+		const IdleLoad &load = loop->loads[i];
+		const u32 base = (load.base == REG_NONE) ? load.base_value : ARMPROC.R[load.base];
+		const u32 offset = (load.index == REG_NONE) ? load.offset : (ARMPROC.R[load.index] << load.shift);
+		if(!quietAddress<PROCNUM>(load.subtract ? base - offset : base + offset))
+			return false;
+	}
+
+	return true;
+}
+
+template bool idleloop_candidate<0>(u32 head, u32 branch_adr, bool thumb);
+template bool idleloop_candidate<1>(u32 head, u32 branch_adr, bool thumb);
+template bool idleloop_check<0>(u32 head, u32 branch_adr, bool thumb);
+template bool idleloop_check<1>(u32 head, u32 branch_adr, bool thumb);
@@ -0,0 +1,39 @@
+/*
+	Copyright (C) 2015 DeSmuME team
+
+	This file is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This file is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with the this software.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _IDLELOOP_H_
+#define _IDLELOOP_H_
+
+#include "types.h"
+
+//Busy waits are short loops which only load from memory, compute on what they loaded and branch back,
+//such as polling VCOUNT, IF or a flag the other cpu sets in main memory.
+//Nothing is carried from one pass of such a loop to the next except the memory it loads, so until an event,
+//a dma or the other cpu writes that memory every further pass does exactly what the last one did,
+//and the cpu may as well skip ahead (see armInnerLoop).
+
+//the longest loop considered, counting the branch back
+#define IDLELOOP_MAX_INSTRUCTIONS 8
+
+//whether the loop from 'head' to the branch at 'branch_adr' could be a busy wait, judging by its code alone
+template<int PROCNUM> bool idleloop_candidate(u32 head, u32 branch_adr, bool thumb);
+
+//whether the cpu, having just branched from 'branch_adr' back to 'head', is in a busy wait:
+//the loop is a candidate and all it loads is memory which neither changes on its own nor minds being read
+template<int PROCNUM> bool idleloop_check(u32 head, u32 branch_adr, bool thumb);
+
+#endif
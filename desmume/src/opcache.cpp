@@ -0,0 +1,86 @@
+/*
+	Copyright (C) 2015 DeSmuME team
+
+	This file is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This file is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with the this software.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include "opcache.h"
+#include "armcpu.h"
+#include "MMU.h"
+
+OpCacheEntry opcache[2][OPCACHE_SIZE];
+u8 opcache_pages[OPCACHE_PAGE_COUNT];
+
+//nonzero for the 16MB regions which have pages in the cache
+static u8 opcache_regions[16];
+
+template<int PROCNUM, bool thumb>
+void FASTCALL opcache_fill(OpCacheEntry &entry, u32 adr)
+{
+	if(thumb)
+	{
+		entry.opcode = _MMU_read16<PROCNUM, MMU_AT_CODE>(adr);
+		entry.handler = thumb_instructions_set[PROCNUM][entry.opcode>>6];
+	}
+	else
+	{
+		entry.opcode = _MMU_read32<PROCNUM, MMU_AT_CODE>(adr);
+		entry.handler = arm_instructions_set[PROCNUM][INSTRUCTION_INDEX(entry.opcode)];
+	}
+	entry.key = OPCACHE_KEY(adr, thumb);
+
+	const u32 page = opcache_page(adr);
+	opcache_pages[page] = 1;
+	opcache_regions[page >> (24 - OPCACHE_PAGE_SHIFT)] = 1;
+}
+
+template void FASTCALL opcache_fill<0,false>(OpCacheEntry &entry, u32 adr);
+template void FASTCALL opcache_fill<0,true>(OpCacheEntry &entry, u32 adr);
+template void FASTCALL opcache_fill<1,false>(OpCacheEntry &entry, u32 adr);
+template void FASTCALL opcache_fill<1,true>(OpCacheEntry &entry, u32 adr);
+
+void FASTCALL opcache_invalidate_page(u32 page)
+{
+	//the entries of a page are next to each other, along with those of the pages which alias it
+	const u32 first = ((page << OPCACHE_PAGE_SHIFT) >> 1) & (OPCACHE_SIZE-1);
+	for(int proc = 0; proc < 2; proc++)
+	{
+		OpCacheEntry *entry = &opcache[proc][first];
+		for(u32 i = 0; i < (1 << (OPCACHE_PAGE_SHIFT-1)); i++, entry++)
+			if(entry->key != OPCACHE_EMPTY && opcache_page(~entry->key & ~1) == page)
+				entry->key = OPCACHE_EMPTY;
+	}
+	opcache_pages[page] = 0;
+}
+
+void opcache_invalidate_region(u32 region)
+{
+	if(!opcache_regions[region])
+		return;
+
+	const u32 pages = 1 << (24 - OPCACHE_PAGE_SHIFT);
+	for(u32 page = region * pages; page < (region + 1) * pages; page++)
+		if(opcache_pages[page])
+			opcache_invalidate_page(page);
+	opcache_regions[region] = 0;
+}
+
+void opcache_reset()
+{
+	memset(opcache, 0, sizeof(opcache));
+	memset(opcache_pages, 0, sizeof(opcache_pages));
+	memset(opcache_regions, 0, sizeof(opcache_regions));
+}
@@ -0,0 +1,86 @@
+/*
+	Copyright (C) 2015 DeSmuME team
+
+	This file is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This file is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with the this software.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _OPCACHE_H_
+#define _OPCACHE_H_
+
+#include "types.h"
+#include "instructions.h"
+
+//The interpreter fetches every instruction through the memory map and looks its handler up in the opcode tables.
+//The opcode cache keeps the opcode and the handler of the instructions last run at each address,
+//so that after the first pass through a loop each fetch is a single lookup (see armcpu_prefetch).
+//Like compiled JIT blocks, entries are dropped by page when the memory under them is written or remapped.
+
+//entries per cpu, directly mapped by address; they span 32KB, so that mirrors of itcm and main memory share entries
+#define OPCACHE_SIZE 0x4000
+
+#define OPCACHE_PAGE_SHIFT 8 // 256 bytes of code
+#define OPCACHE_PAGE_COUNT (0x10000000 >> OPCACHE_PAGE_SHIFT)
+
+//keys are inverted so that zeroed entries are empty; an empty key would be thumb code at 0xFFFFFFFE, which nothing runs
+#define OPCACHE_KEY(adr, thumb) (~((adr) | ((thumb) ? 1 : 0)))
+#define OPCACHE_EMPTY 0
+
+struct OpCacheEntry
+{
+	u32 key; //OPCACHE_KEY of the address
+	u32 opcode;
+	OpFunc handler;
+};
+
+extern OpCacheEntry opcache[2][OPCACHE_SIZE];
+
+//nonzero for the pages which have entries in the cache
+extern u8 opcache_pages[OPCACHE_PAGE_COUNT];
+
+//the page of an address. the mirrors of main memory and of itcm share pages, so that a store through
+//any of them drops what was cached through the others; other mirrors are told apart, as by the JIT
+FORCEINLINE u32 opcache_page(u32 adr)
+{
+	if((adr & 0x0F000000) == 0x02000000)
+		adr &= 0x023FFFFF; //main memory is at least 4MB, its mirrors repeat at a multiple of that
+	else if(adr < 0x02000000)
+		adr &= 0x7FFF;
+	else
+		adr &= 0x0FFFFFFF;
+	return adr >> OPCACHE_PAGE_SHIFT;
+}
+
+void FASTCALL opcache_invalidate_page(u32 page);
+
+//for every store into memory code can run from
+#define OPCACHE_INVALIDATE(adr) { const u32 opcache_pg = opcache_page(adr); if(opcache_pages[opcache_pg]) opcache_invalidate_page(opcache_pg); }
+
+//drops the entries of a 16MB region of the address space whose mapping changed
+void opcache_invalidate_region(u32 region);
+
+//drops everything
+void opcache_reset();
+
+template<int PROCNUM, bool thumb> void FASTCALL opcache_fill(OpCacheEntry &entry, u32 adr);
+
+template<int PROCNUM, bool thumb>
+FORCEINLINE const OpCacheEntry& opcache_fetch(u32 adr)
+{
+	OpCacheEntry &entry = opcache[PROCNUM][(adr >> 1) & (OPCACHE_SIZE-1)];
+	if(entry.key != OPCACHE_KEY(adr, thumb))
+		opcache_fill<PROCNUM,thumb>(entry, adr);
+	return entry;
+}
+
+#endif
@@ -37,7 +37,9 @@
 
 
 //---CUSTOM--->
+#ifdef HOST_WINDOWS
 #include "X432R_BuildSwitch.h"
+#endif
 
 #if defined(X432R_FILEPATHMOD_ENABLED) && defined(HOST_WINDOWS)
 #include <shlwapi.h>
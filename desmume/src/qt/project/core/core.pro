@@ -102,6 +102,7 @@ INCLUDEPATH += userconfig/ defaultconfig/ ../../../../src
 
 SOURCES += \
     ../../../armcpu.cpp \
+    ../../../armprofiler.cpp \
     ../../../arm_instructions.cpp \
     ../../../agg2d.inl \
     ../../../bios.cpp \
@@ -116,12 +117,14 @@ SOURCES += \
     ../../../firmware.cpp \
     ../../../GPU.cpp \
     ../../../GPU_osd.cpp \
+    ../../../idleloop.cpp \
     ../../../matrix.cpp \
     ../../../mc.cpp \
     ../../../MMU.cpp \
     ../../../NDSSystem.cpp \
     ../../../ROMReader.cpp \
     ../../../render3D.cpp \
+    ../../../rewind.cpp \
     ../../../rtc.cpp \
     ../../../saves.cpp \
     ../../../slot1.cpp \
@@ -135,9 +138,11 @@ SOURCES += \
     ../../../utils/guid.cpp \
     ../../../utils/emufat.cpp \
     ../../../utils/fsnitro.cpp \
+    ../../../utils/jobpool.cpp \
     ../../../utils/md5.cpp \
     ../../../utils/xstring.cpp \
     ../../../utils/vfat.cpp \
+    ../../../utils/perftimer.cpp \
     ../../../utils/task.cpp \
     ../../../utils/dlditool.cpp \
     ../../../utils/ConvertUTF.c \
@@ -227,6 +232,7 @@ SOURCES += \
     ../../../arm_jit.cpp \
     ../../../readwrite.cpp \
     ../../../driver.cpp \
+    ../../../opcache.cpp \
     ../../../path.cpp \
     ../../../OGLRender.cpp \
     ../../../metaspu/SoundTouch/AAFilter.cpp \
@@ -243,6 +249,7 @@ SOURCES += \
 
 HEADERS += \
     ../../../armcpu.h \
+    ../../../armprofiler.h \
     ../../../agg2d.h \
     ../../../bios.h \
     ../../../bits.h \
@@ -260,6 +267,7 @@ HEADERS += \
     ../../../GPU.h \
     ../../../GPU_osd.h \
     ../../../instructions.h \
+    ../../../idleloop.h \
     ../../../matrix.h \
     ../../../mem.h \
     ../../../mc.h \
@@ -270,6 +278,7 @@ HEADERS += \
     ../../../OGLRender.h \
     ../../../ROMReader.h \
     ../../../render3D.h \
+    ../../../rewind.h \
     ../../../rtc.h \
     ../../../saves.h \
     ../../../slot1.h \
@@ -288,10 +297,12 @@ HEADERS += \
     ../../../utils/emufat.h \
     ../../../utils/emufat_types.h \
     ../../../utils/fsnitro.h \
+    ../../../utils/jobpool.h \
     ../../../utils/md5.h \
     ../../../utils/valuearray.h \
     ../../../utils/xstring.h \
     ../../../utils/vfat.h \
+    ../../../utils/perftimer.h \
     ../../../utils/task.h \
     ../../../utils/decrypt/crc.h \
     ../../../utils/decrypt/decrypt.h \
@@ -374,6 +385,7 @@ HEADERS += \
     ../../../instruction_attributes.h \
     ../../../readwrite.h \
     ../../../driver.h \
+    ../../../opcache.h \
     ../../../path.h \
     ../../../metaspu/SoundTouch/AAFilter.h \
     ../../../metaspu/SoundTouch/BPMDetect.h \
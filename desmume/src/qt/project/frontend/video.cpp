@@ -22,69 +22,16 @@
 
 #include <QDebug>
 
-#ifdef HOST_WINDOWS
-	typedef unsigned __int8 uint8_t;
-	typedef unsigned __int16 uint16_t;
-#	ifdef _MSC_VER
-#	define __restrict__ __restrict
-#	endif
-#endif
+#include <string.h>
 
 namespace desmume {
 namespace qt {
 
-namespace {
-
-// These conevrsion functions are adapted from Cocoa port.
-static const uint8_t bits5to8[] = {
-	0x00, 0x08, 0x10, 0x19, 0x21, 0x29, 0x31, 0x3A,
-	0x42, 0x4A, 0x52, 0x5A, 0x63, 0x6B, 0x73, 0x7B,
-	0x84, 0x8C, 0x94, 0x9C, 0xA5, 0xAD, 0xB5, 0xBD,
-	0xC5, 0xCE, 0xD6, 0xDE, 0xE6, 0xEF, 0xF7, 0xFF
-};
-
-static inline uint32_t RGB555ToRGBA8888(const uint16_t color16)
-{
-	return	(bits5to8[((color16 >> 0) & 0x001F)] << 0) |
-			(bits5to8[((color16 >> 5) & 0x001F)] << 8) |
-			(bits5to8[((color16 >> 10) & 0x001F)] << 16) |
-			0xFF000000;
-}
-
-static inline uint32_t RGB555ToBGRA8888(const uint16_t color16)
-{
-	return	(bits5to8[((color16 >> 10) & 0x001F)] << 0) |
-			(bits5to8[((color16 >> 5) & 0x001F)] << 8) |
-			(bits5to8[((color16 >> 0) & 0x001F)] << 16) |
-			0xFF000000;
-}
-
-static inline void RGB555ToRGBA8888Buffer(const uint16_t *__restrict__ srcBuffer, uint32_t *__restrict__ destBuffer, size_t pixelCount)
-{
-	const uint32_t *__restrict__ destBufferEnd = destBuffer + pixelCount;
-
-	while (destBuffer < destBufferEnd)
-	{
-		*destBuffer++ = RGB555ToRGBA8888(*srcBuffer++);
-	}
-}
-
-static inline void RGB555ToBGRA8888Buffer(const uint16_t *__restrict__ srcBuffer, uint32_t *__restrict__ destBuffer, size_t pixelCount)
-{
-	const uint32_t *__restrict__ destBufferEnd = destBuffer + pixelCount;
-
-	while (destBuffer < destBufferEnd)
-	{
-		*destBuffer++ = RGB555ToBGRA8888(*srcBuffer++);
-	}
-}
-
-} /* namespace */
-
 Video::Video(int numThreads, QObject* parent)
 	: QObject(parent)
 	, mFilter(256, 384, VideoFilterTypeID_None, numThreads)
 {
+	GPU_SetOutputFormat(GPU_OUTPUT_RGBA8888);
 }
 
 bool Video::setFilter(VideoFilterTypeID filterID) {
@@ -106,7 +53,7 @@ bool Video::setFilter(VideoFilterTypeID filterID) {
 }
 
 unsigned int* Video::runFilter() {
-	RGB555ToRGBA8888Buffer((u16*)GPU_screen, this->mFilter.GetSrcBufferPtr(), 256 * 384);
+	memcpy(this->mFilter.GetSrcBufferPtr(), GPU_screen32, sizeof(GPU_screen32));
 	unsigned int* buf = this->mFilter.RunFilter();
 	this->screenBufferUpdated(buf, this->getDstSize(), this->getDstScale());
 	return buf;
@@ -53,7 +53,7 @@
 #include "texcache.h"
 #include "MMU.h"
 #include "NDSSystem.h"
-#include "utils/task.h"
+#include "utils/jobpool.h"
 
 //#undef FORCEINLINE
 //#define FORCEINLINE
@@ -124,13 +124,9 @@ static FORCEINLINE int fastFloor(float f)
 //	verts[vert_index] = &rawvert;
 //}
 
-#ifndef X432R_CUSTOMRENDERER_ENABLED
-static Fragment _screen[GFX3D_FRAMEBUFFER_WIDTH*GFX3D_FRAMEBUFFER_HEIGHT];
-static FragmentColor _screenColor[GFX3D_FRAMEBUFFER_WIDTH*GFX3D_FRAMEBUFFER_HEIGHT];
-#else
-static Fragment _screen[1024 * 768];
-static FragmentColor _screenColor[1024 * 768];
-#endif
+//big enough for a frame at the largest render scale
+static Fragment _screen[GFX3D_FRAMEBUFFER_WIDTH*GFX3D_FRAMEBUFFER_HEIGHT*GFX3D_MAX_RENDER_SCALE*GFX3D_MAX_RENDER_SCALE];
+static FragmentColor _screenColor[GFX3D_FRAMEBUFFER_WIDTH*GFX3D_FRAMEBUFFER_HEIGHT*GFX3D_MAX_RENDER_SCALE*GFX3D_MAX_RENDER_SCALE];
 
 static FORCEINLINE int iround(float f) {
 	return (int)f; //lol
@@ -204,6 +200,7 @@ struct edge_fx_fl {
 	edge_fx_fl() {}
 	edge_fx_fl(int Top, int Bottom, VERT** verts, bool& failure);
 	FORCEINLINE int Step();
+	FORCEINLINE void Skip(int lines);
 
 	VERT** verts;
 	long X, XStep, Numerator, Denominator;			// DDA info for x
@@ -312,11 +309,21 @@ FORCEINLINE int edge_fx_fl::Step() {
 	return Height;
 }	
 
+//moves the edge down several lines at once, to where that many Step()s would have left it
+FORCEINLINE void edge_fx_fl::Skip(int lines) {
+	const long errorSum = ErrorTerm + Numerator*lines;
+	const long extra = errorSum / Denominator;
+	X += XStep*lines + extra; Y += lines; Height -= lines;
+	ErrorTerm = errorSum - extra*Denominator;
+	for(int i=0;i<NUM_INTERPOLANTS;i++)
+		interpolants[i].curr += lines*interpolants[i].step + extra*interpolants[i].stepExtra;
+}
+
 
 
-static FORCEINLINE void alphaBlend(FragmentColor & dst, const FragmentColor & src)
+static FORCEINLINE void alphaBlend(FragmentColor & dst, const FragmentColor & src, const bool enableAlphaBlending)
 {
-	if(gfx3d.renderState.enableAlphaBlending)
+	if(enableAlphaBlending)
 	{
 		if(src.a == 31 || dst.a == 0)
 		{
@@ -399,7 +406,10 @@ class RasterizerUnit
 {
 public:
 
-	int SLI_MASK, SLI_VALUE;
+	//the screen lines [tileYBegin, tileYEnd) this unit is currently rasterizing (only when TILED)
+	int tileYBegin, tileYEnd;
+	//set when the poly being drawn has been walked past the bottom of the tile
+	bool polyDone;
 	bool _debug_thisPoly;
 
 	RasterizerUnit()
@@ -425,7 +435,7 @@ public:
 		int wrap;
 		int wshift;
 		int texFormat;
-		void setup(u32 texParam)
+		void setup(u32 texParam, bool enableTexturing)
 		{
 			texFormat = (texParam>>26)&7;
 			wshift = ((texParam>>20)&0x07) + 3;
@@ -434,7 +444,7 @@ public:
 			wmask = width-1;
 			hmask = height-1;
 			wrap = (texParam>>16)&0xF;
-			enabled = gfx3d.renderState.enableTexturing && (texFormat!=0);
+			enabled = enableTexturing && (texFormat!=0);
 		}
 
 		FORCEINLINE void clamp(int &val, const int size, const int sizemask){
@@ -575,7 +585,7 @@ public:
 				texColor = sample(u,v);
 				FragmentColor toonColor = engine->toonTable[shader.materialColor.r>>1];
 			
-				if(gfx3d.renderState.shading == GFX3D_State::HIGHLIGHT)
+				if(engine->renderState.shading == GFX3D_State::HIGHLIGHT)
 				{
 					dst.r = modulate_table[texColor.r][shader.materialColor.r];
 					dst.g = modulate_table[texColor.g][shader.materialColor.r];
@@ -614,7 +624,7 @@ public:
 		FragmentColor &destFragmentColor = engine->screenColor[adr];
 
 		u32 depth;
-		if(gfx3d.renderState.wbuffer)
+		if(engine->renderState.wbuffer)
 		{
 			//not sure about this
 			//this value was chosen to make the skybox, castle window decals, and water level render correctly in SM64
@@ -703,9 +713,9 @@ public:
 		if(shaderOutput.a != 0)
 		{
 			//alpha test (don't have any test cases for this...? is it in the right place...?)
-			if(gfx3d.renderState.enableAlphaTest)
+			if(engine->renderState.enableAlphaTest)
 			{
-				if(shaderOutput.a < gfx3d.renderState.alphaTestRef)
+				if(shaderOutput.a < engine->renderState.alphaTestRef)
 					goto rejected_fragment;
 			}
 
@@ -730,7 +740,7 @@ public:
 				destFragment.polyid.translucent = polyAttr.polyid;
 
 				//alpha blending and write color
-				alphaBlend(destFragmentColor, shaderOutput);
+				alphaBlend(destFragmentColor, shaderOutput, engine->renderState.enableAlphaBlending);
 
 				destFragment.fogged &= polyAttr.fogged;
 			}
@@ -802,22 +812,10 @@ public:
 
 		//CONSIDER: in case some other math is wrong (shouldve been clipped OK), we might go out of bounds here.
 		//better check the Y value.
-		#ifndef X432R_CUSTOMRENDERER_ENABLED
-		if(RENDERER && (pLeft->Y<0 || pLeft->Y>191)) {
+		if(pLeft->Y<0 || pLeft->Y>=engine->height) {
 			printf("rasterizer rendering at y=%d! oops!\n",pLeft->Y);
 			return;
 		}
-		if(!RENDERER && (pLeft->Y<0 || pLeft->Y>=engine->height)) {
-			printf("rasterizer rendering at y=%d! oops!\n",pLeft->Y);
-			return;
-		}
-		#else
-		if( (pLeft->Y < 0) || (pLeft->Y >= engine->height) )
-		{
-			printf("rasterizer rendering at y=%d! oops!\n", pLeft->Y);
-			return;
-		}
-		#endif
 
 		int x = XStart;
 
@@ -839,28 +837,15 @@ public:
 			width -= -x;
 			x = 0;
 		}
-		#ifndef X432R_CUSTOMRENDERER_ENABLED
-		if(x+width > (RENDERER?GFX3D_FRAMEBUFFER_WIDTH:engine->width))
+		if(x+width > engine->width)
 		{
 			if(RENDERER && !lineHack)
 			{
 				printf("rasterizer rendering at x=%d! oops!\n",x+width-1);
 				return;
 			}
-			width = (RENDERER?GFX3D_FRAMEBUFFER_WIDTH:engine->width)-x;
-		}
-		#else
-		if( (x + width) > engine->width )
-		{
-			if(RENDERER && !lineHack)
-			{
-				printf("rasterizer rendering at x=%d! oops!\n", x + width - 1);
-				return;
-			}
-			
-			width = engine->width - x;
+			width = engine->width-x;
 		}
-		#endif
 
 		while(width-- > 0)
 		{
@@ -879,7 +864,7 @@ public:
 	}
 
 	//runs several scanlines, until an edge is finished
-	template<bool SLI>
+	template<bool TILED>
 	void runscanlines(edge_fx_fl *left, edge_fx_fl *right, bool horizontal, bool lineHack)
 	{
 		//oh lord, hack city for edge drawing
@@ -889,18 +874,29 @@ public:
 		bool first=true;
 
 		//HACK: special handling for horizontal line poly
-		#ifndef X432R_CUSTOMRENDERER_ENABLED
-		if (lineHack && left->Height == 0 && right->Height == 0 && left->Y<GFX3D_FRAMEBUFFER_HEIGHT && left->Y>=0)
-		#else
-		if( lineHack && (left->Height == 0) && (right->Height == 0) && (left->Y < engine->height) && (left->Y >= 0) )
-		#endif
+		if (lineHack && left->Height == 0 && right->Height == 0 && left->Y<engine->height && left->Y>=0)
 		{
-			bool draw = (!SLI || (left->Y & SLI_MASK) == SLI_VALUE);
+			bool draw = (!TILED || (left->Y >= tileYBegin && left->Y < tileYEnd));
 			if(draw) drawscanline(left,right,lineHack);
 		}
 
+		//the lines above the tile are not drawn, so jump the edges straight to its first line
+		if(TILED && left->Y < tileYBegin && Height > 0)
+		{
+			const int skip = min(tileYBegin - left->Y, Height);
+			left->Skip(skip);
+			right->Skip(skip);
+			Height -= skip;
+		}
+
 		while(Height--) {
-			bool draw = (!SLI || (left->Y & SLI_MASK) == SLI_VALUE);
+			//polys are walked top to bottom, so nothing more of this one lands in the tile
+			if(TILED && left->Y >= tileYEnd)
+			{
+				polyDone = true;
+				return;
+			}
+			bool draw = (!TILED || left->Y >= tileYBegin);
 			if(draw) drawscanline(left,right,lineHack);
 			const int xl = left->X;
 			const int xr = right->X;
@@ -1011,10 +1007,11 @@ public:
 	//verts must be clockwise.
 	//I didnt reference anything for this algorithm but it seems like I've seen it somewhere before.
 	//Maybe it is like crow's algorithm
-	template<bool SLI>
+	template<bool TILED>
 	void shape_engine(int type, bool backwards, bool lineHack)
 	{
 		bool failure = false;
+		polyDone = false;
 
 		switch(type) {
 			case 3: sort_verts<3>(backwards); break;
@@ -1050,7 +1047,9 @@ public:
 				return;
 
 			bool horizontal = left.Y == right.Y;
-			runscanlines<SLI>(&left,&right,horizontal, lineHack);
+			runscanlines<TILED>(&left,&right,horizontal, lineHack);
+			if(TILED && polyDone)
+				break;
 
 			//if we ran out of an edge, step to the next one
 			if(right.Height == 0) {
@@ -1070,57 +1069,86 @@ public:
 
 	SoftRasterizerEngine* engine;
 
-	template<bool SLI>
-	FORCEINLINE void mainLoop(SoftRasterizerEngine* const engine)
+	u32 lastPolyAttr;
+	u32 lastTextureFormat, lastTexturePalette;
+	bool firstPoly;
+
+	template<bool TILED>
+	FORCEINLINE void renderPoly(const int i)
 	{
-		this->engine = engine;
-		lastTexKey = NULL;
+		polynum = i;
 
-		u32 lastPolyAttr = 0;
-		u32 lastTextureFormat = 0, lastTexturePalette = 0;
+		GFX3D_Clipper::TClippedPoly &clippedPoly = engine->clippedPolys[i];
+		POLY *poly = clippedPoly.poly;
+		int type = clippedPoly.type;
 
-		//iterate over polys
-		bool first=true;
-		for(int i=0;i<engine->clippedPolyCounter;i++)
+		if(firstPoly || lastPolyAttr != poly->polyAttr)
 		{
-			if(!RENDERER) _debug_thisPoly = (i==engine->_debug_drawClippedUserPoly);
-			if(!engine->polyVisible[i]) continue;
-			polynum = i;
+			polyAttr.setup(poly->polyAttr);
+			polyAttr.translucent = poly->isTranslucent();
+			lastPolyAttr = poly->polyAttr;
+		}
 
-			GFX3D_Clipper::TClippedPoly &clippedPoly = engine->clippedPolys[i];
-			POLY *poly = clippedPoly.poly;
-			int type = clippedPoly.type;
 
-			if(first || lastPolyAttr != poly->polyAttr)
-			{
-				polyAttr.setup(poly->polyAttr);
-				polyAttr.translucent = poly->isTranslucent();
-				lastPolyAttr = poly->polyAttr;
-			}
+		if(firstPoly || lastTextureFormat != poly->texParam || lastTexturePalette != poly->texPalette)
+		{
+			sampler.setup(poly->texParam, engine->renderState.enableTexturing);
+			lastTextureFormat = poly->texParam;
+			lastTexturePalette = poly->texPalette;
+		}
 
+		firstPoly = false;
 
-			if(first || lastTextureFormat != poly->texParam || lastTexturePalette != poly->texPalette)
-			{
-				sampler.setup(poly->texParam);
-				lastTextureFormat = poly->texParam;
-				lastTexturePalette = poly->texPalette;
-			}
+		lastTexKey = engine->polyTexKeys[i];
+
+		//hmm... shader gets setup every time because it depends on sampler which may have just changed
+		setupShader(poly->polyAttr);
+
+		for(int j=0;j<type;j++)
+			this->verts[j] = &clippedPoly.clipVerts[j];
+		for(int j=type;j<MAX_CLIPPED_VERTS;j++)
+			this->verts[j] = NULL;
 
-			first = false;
+		polyAttr.backfacing = engine->polyBackfacing[i];
+
+		shape_engine<TILED>(type,!polyAttr.backfacing, (poly->vtxFormat & 4) && CommonSettings.GFX3D_LineHack);
+	}
+
+	//TILED: keep claiming tiles from the engine until there are none left, drawing only the polys binned to each.
+	//otherwise: draw every poly over the whole screen
+	template<bool TILED>
+	FORCEINLINE void mainLoop(SoftRasterizerEngine* const engine)
+	{
+		this->engine = engine;
+		lastTexKey = NULL;
 
-			lastTexKey = engine->polyTexKeys[i];
+		lastPolyAttr = 0;
+		lastTextureFormat = lastTexturePalette = 0;
+		firstPoly = true;
 
-			//hmm... shader gets setup every time because it depends on sampler which may have just changed
-			setupShader(poly->polyAttr);
+		if(TILED)
+		{
+			for(;;)
+			{
+				const int tile = JobPool_AtomicAdd(&engine->nextTile, 1) - 1;
+				if(tile >= engine->tileCount) break;
 
-			for(int j=0;j<type;j++)
-				this->verts[j] = &clippedPoly.clipVerts[j];
-			for(int j=type;j<MAX_CLIPPED_VERTS;j++)
-				this->verts[j] = NULL;
+				tileYBegin = tile * SoftRasterizerEngine::TILE_HEIGHT;
+				tileYEnd = min(tileYBegin + SoftRasterizerEngine::TILE_HEIGHT, engine->height);
 
-			polyAttr.backfacing = engine->polyBackfacing[i];
+				const std::vector<int> &polys = engine->tilePolys[tile];
+				for(size_t n=0;n<polys.size();n++)
+					renderPoly<true>(polys[n]);
+			}
+			return;
+		}
 
-			shape_engine<SLI>(type,!polyAttr.backfacing, (poly->vtxFormat & 4) && CommonSettings.GFX3D_LineHack);
+		//iterate over polys
+		for(int i=0;i<engine->clippedPolyCounter;i++)
+		{
+			if(!RENDERER) _debug_thisPoly = (i==engine->_debug_drawClippedUserPoly);
+			if(!engine->polyVisible[i]) continue;
+			renderPoly<false>(i);
 		}
 	}
 
@@ -1130,7 +1158,8 @@ public:
 static SoftRasterizerEngine mainSoftRasterizer;
 
 #define _MAX_CORES 16
-static Task rasterizerUnitTask[_MAX_CORES];
+static JobGroup rasterizerUnitJobs;
+static JobGroup softRastFrameJob;
 static RasterizerUnit<true> rasterizerUnit[_MAX_CORES];
 static RasterizerUnit<false> _HACK_viewer_rasterizerUnit;
 static unsigned int rasterizerCores = 0;
@@ -1155,30 +1184,12 @@ static char SoftRastInit(void)
 	{
 		rasterizerUnitTasksInited = true;
 
-		_HACK_viewer_rasterizerUnit.SLI_MASK = 1;
-		_HACK_viewer_rasterizerUnit.SLI_VALUE = 0;
-
-		rasterizerCores = CommonSettings.num_cores;
+		//one unit per pool worker; the units run as jobs on the shared pool
+		rasterizerCores = JobPool_GetWorkerCount();
 
 		if (rasterizerCores > _MAX_CORES) 
 			rasterizerCores = _MAX_CORES;
 
-		if(CommonSettings.num_cores == 1)
-		{
-			rasterizerCores = 1;
-			rasterizerUnit[0].SLI_MASK = 0;
-			rasterizerUnit[0].SLI_VALUE = 0;
-		}
-		else
-		{
-			for (u8 i = 0; i < rasterizerCores; i++)
-			{
-				rasterizerUnit[i].SLI_MASK = (rasterizerCores - 1);
-				rasterizerUnit[i].SLI_VALUE = i;
-				rasterizerUnitTask[i].start(false);
-			}
-		}
-
 	}
 
 	static bool tables_generated = false;
@@ -1219,13 +1230,7 @@ static char SoftRastInit(void)
 
 static void SoftRastReset()
 {
-	if (rasterizerCores > 1)
-	{
-		for(unsigned int i = 0; i < rasterizerCores; i++)
-		{
-			rasterizerUnitTask[i].finish();
-		}
-	}
+	softRastFrameJob.wait();
 	
 	softRastHasNewData = false;
 	
@@ -1234,14 +1239,7 @@ static void SoftRastReset()
 
 static void SoftRastClose()
 {
-	if (rasterizerCores > 1)
-	{
-		for(unsigned int i = 0; i < rasterizerCores; i++)
-		{
-			rasterizerUnitTask[i].finish();
-			rasterizerUnitTask[i].shutdown();
-		}
-	}
+	softRastFrameJob.wait();
 	
 	rasterizerUnitTasksInited = false;
 	softRastHasNewData = false;
@@ -1254,9 +1252,68 @@ static void SoftRastVramReconfigureSignal()
 	Default3D_VramReconfigureSignal();
 }
 
+//how many times the DS resolution the frame is drawn at
+static int softRastScale = 1;
+
+//box filters lines [first,last) of gfx3d_convertedScreen out of a larger frame
+static void SoftRastDownscaleLines(int first, int last)
+{
+	const int scale = softRastScale;
+	const int width = GFX3D_FRAMEBUFFER_WIDTH*scale;
+	const u32 samples = scale*scale;
+	FragmentColor *dst = (FragmentColor*)gfx3d_convertedScreen + first*GFX3D_FRAMEBUFFER_WIDTH;
+
+	for(int y=first;y<last;y++)
+	{
+		const FragmentColor *src = _screenColor + y*scale*width;
+		for(int x=0;x<GFX3D_FRAMEBUFFER_WIDTH;x++,src+=scale,dst++)
+		{
+			u32 r=0,g=0,b=0,a=0;
+			for(int sy=0;sy<scale;sy++)
+			{
+				for(int sx=0;sx<scale;sx++)
+				{
+					const FragmentColor c = src[sy*width+sx];
+					r += c.r; g += c.g; b += c.b; a += c.a;
+				}
+			}
+			dst->r = r/samples;
+			dst->g = g/samples;
+			dst->b = b/samples;
+			//rounded up, so that a pixel which anything was drawn over doesnt come out transparent
+			dst->a = (a+samples-1)/samples;
+		}
+	}
+}
+
+static void* execDownscaleUnit(void* arg)
+{
+	const int which = (int)(intptr_t)arg;
+	const int lines = (GFX3D_FRAMEBUFFER_HEIGHT + rasterizerCores - 1) / rasterizerCores;
+	const int first = min(which*lines, GFX3D_FRAMEBUFFER_HEIGHT);
+	SoftRastDownscaleLines(first, min(first+lines, GFX3D_FRAMEBUFFER_HEIGHT));
+	return 0;
+}
+
 static void SoftRastConvertFramebuffer()
 {
-	memcpy(gfx3d_convertedScreen, _screenColor, GFX3D_FRAMEBUFFER_WIDTH*GFX3D_FRAMEBUFFER_HEIGHT*4);
+	if(softRastScale == 1)
+	{
+		memcpy(gfx3d_convertedScreen, _screenColor, GFX3D_FRAMEBUFFER_WIDTH*GFX3D_FRAMEBUFFER_HEIGHT*4);
+		return;
+	}
+
+	//the larger frame stays in _screenColor for gfx3d_highResScreen; the usual one is filtered down from it
+	if (rasterizerCores > 1)
+	{
+		for(unsigned int i = 0; i < rasterizerCores; i++)
+			rasterizerUnitJobs.run(&execDownscaleUnit, (void *)(intptr_t)i, i);
+		rasterizerUnitJobs.wait();
+	}
+	else
+	{
+		SoftRastDownscaleLines(0, GFX3D_FRAMEBUFFER_HEIGHT);
+	}
 }
 
 void SoftRasterizerEngine::initFramebuffer(const int width, const int height, const bool clearImage)
@@ -1266,26 +1323,27 @@ void SoftRasterizerEngine::initFramebuffer(const int width, const int height, co
 	Fragment clearFragment;
 	FragmentColor clearFragmentColor;
 	clearFragment.isTranslucentPoly = 0;
-	clearFragmentColor.r = GFX3D_5TO6(gfx3d.renderState.clearColor&0x1F);
-	clearFragmentColor.g = GFX3D_5TO6((gfx3d.renderState.clearColor>>5)&0x1F);
-	clearFragmentColor.b = GFX3D_5TO6((gfx3d.renderState.clearColor>>10)&0x1F);
-	clearFragmentColor.a = ((gfx3d.renderState.clearColor>>16)&0x1F);
-	clearFragment.polyid.opaque = (gfx3d.renderState.clearColor>>24)&0x3F;
+	clearFragmentColor.r = GFX3D_5TO6(renderState.clearColor&0x1F);
+	clearFragmentColor.g = GFX3D_5TO6((renderState.clearColor>>5)&0x1F);
+	clearFragmentColor.b = GFX3D_5TO6((renderState.clearColor>>10)&0x1F);
+	clearFragmentColor.a = ((renderState.clearColor>>16)&0x1F);
+	clearFragment.polyid.opaque = (renderState.clearColor>>24)&0x3F;
 	//special value for uninitialized translucent polyid. without this, fires in spiderman2 dont display
 	//I am not sure whether it is right, though. previously this was cleared to 0, as a guess,
 	//but in spiderman2 some fires with polyid 0 try to render on top of the background
 	clearFragment.polyid.translucent = kUnsetTranslucentPolyID; 
-	clearFragment.depth = gfx3d.renderState.clearDepth;
+	clearFragment.depth = renderState.clearDepth;
 	clearFragment.stencil = 0;
 	clearFragment.isTranslucentPoly = 0;
-	clearFragment.fogged = BIT15(gfx3d.renderState.clearColor);
+	clearFragment.fogged = BIT15(renderState.clearColor);
 	for(int i=0;i<todo;i++)
 		screen[i] = clearFragment;
 
 	if(clearImage)
 	{
-		//need to handle this somehow..
-		assert(width==GFX3D_FRAMEBUFFER_WIDTH && height==GFX3D_FRAMEBUFFER_HEIGHT);
+		//a larger frame repeats each pixel of the clear image
+		const int scale = width/GFX3D_FRAMEBUFFER_WIDTH;
+		assert(width==GFX3D_FRAMEBUFFER_WIDTH*scale && height==GFX3D_FRAMEBUFFER_HEIGHT*scale);
 
 		u16* clearImage = (u16*)MMU.texInfo.textureSlotAddr[2];
 		u16* clearDepth = (u16*)MMU.texInfo.textureSlotAddr[3];
@@ -1299,10 +1357,10 @@ void SoftRasterizerEngine::initFramebuffer(const int width, const int height, co
 		FragmentColor *dstColor = screenColor;
 		Fragment *dst = screen;
 
-		for(int iy=0; iy<GFX3D_FRAMEBUFFER_HEIGHT; iy++) {
-			int y = ((iy + yscroll)&255)<<8;
-			for(int ix=0; ix<GFX3D_FRAMEBUFFER_WIDTH; ix++) {
-				int x = (ix + xscroll)&255;
+		for(int iy=0; iy<height; iy++) {
+			int y = ((iy/scale + yscroll)&255)<<8;
+			for(int ix=0; ix<width; ix++) {
+				int x = (ix/scale + xscroll)&255;
 				int adr = y + x;
 				
 				//this is tested by harry potter and the order of the phoenix.
@@ -1332,12 +1390,12 @@ void SoftRasterizerEngine::updateToonTable()
 	//convert the toon colors
 	for(int i=0;i<32;i++) {
 		#ifdef WORDS_BIGENDIAN
-			u32 u32temp = RGB15TO32_NOALPHA(gfx3d.renderState.u16ToonTable[i]);
+			u32 u32temp = RGB15TO32_NOALPHA(renderState.u16ToonTable[i]);
 			toonTable[i].r = (u32temp >> 2) & 0x3F;
 			toonTable[i].g = (u32temp >> 10) & 0x3F;
 			toonTable[i].b = (u32temp >> 18) & 0x3F;
 		#else
-			toonTable[i].color = (RGB15TO32_NOALPHA(gfx3d.renderState.u16ToonTable[i])>>2)&0x3F3F3F3F;
+			toonTable[i].color = (RGB15TO32_NOALPHA(renderState.u16ToonTable[i])>>2)&0x3F3F3F3F;
 		#endif
 		//printf("%d %d %d %d\n",toonTable[i].r,toonTable[i].g,toonTable[i].b,toonTable[i].a);
 	}
@@ -1345,18 +1403,17 @@ void SoftRasterizerEngine::updateToonTable()
 
 void SoftRasterizerEngine::updateFogTable()
 {
-	u8* fogDensity = MMU.MMU_MEM[ARMCPU_ARM9][0x40] + 0x360;
 #if 0
 	//TODO - this might be a little slow; 
 	//we might need to hash all the variables and only recompute this when something changes
-	const int increment = (0x400 >> gfx3d.renderState.fogShift);
+	const int increment = (0x400 >> renderState.fogShift);
 	for(u32 i=0;i<32768;i++) {
-		if(i<gfx3d.renderState.fogOffset) {
+		if(i<renderState.fogOffset) {
 			fogTable[i] = fogDensity[0];
 			continue;
 		}
 		for(int j=0;j<32;j++) {
-			u32 value = gfx3d.renderState.fogOffset + increment*(j+1);
+			u32 value = renderState.fogOffset + increment*(j+1);
 			if(i<=value) {
 				if(j==0) {
 					fogTable[i] = fogDensity[0];
@@ -1374,9 +1431,9 @@ void SoftRasterizerEngine::updateFogTable()
 	// this should behave exactly the same as the previous loop,
 	// except much faster. (because it's not a 2d loop and isn't so branchy either)
 	// maybe it's fast enough to not need to be cached, now.
-	const int increment = ((1 << 10) >> gfx3d.renderState.fogShift);
-	const int incrementDivShift = 10 - gfx3d.renderState.fogShift;
-	u32 fogOffset = min<u32>(max<u32>(gfx3d.renderState.fogOffset, 0), 32768);
+	const int increment = ((1 << 10) >> renderState.fogShift);
+	const int incrementDivShift = 10 - renderState.fogShift;
+	u32 fogOffset = min<u32>(max<u32>(renderState.fogOffset, 0), 32768);
 	u32 iMin = min<u32>(32768, (( 1 + 1) << incrementDivShift) + fogOffset + 1 - increment);
 	u32 iMax = min<u32>(32768, ((32 + 1) << incrementDivShift) + fogOffset + 1 - increment);
 	assert(iMin <= iMax);
@@ -1402,10 +1459,39 @@ void SoftRasterizerEngine::updateFloatColors()
 
 SoftRasterizerEngine::SoftRasterizerEngine()
 	: _debug_drawClippedUserPoly(-1)
+	, packetPolylist(NULL)
 {
 	this->clippedPolys = clipper.clippedPolys = new GFX3D_Clipper::TClippedPoly[POLYLIST_SIZE*2];
 }
 
+void SoftRasterizerEngine::captureFramePacket()
+{
+	renderState = gfx3d.renderState;
+
+	//the clipped polys point back at their POLY, so the rasterizer works from a copy of the list;
+	//the vertlist is only read before the frame is handed to the pool
+	if(!packetPolylist) packetPolylist = new POLYLIST();
+	packetPolylist->count = gfx3d.polylist->count;
+	memcpy(packetPolylist->list, gfx3d.polylist->list, sizeof(POLY)*gfx3d.polylist->count);
+
+	polylist = packetPolylist;
+	vertlist = gfx3d.vertlist;
+	indexlist = &gfx3d.indexlist;
+
+	memcpy(fogDensity, MMU.MMU_MEM[ARMCPU_ARM9][0x40] + 0x360, sizeof(fogDensity));
+
+	//TODO - need to test and find out whether these get grabbed at flush time, or at render time
+	//we can do this by rendering a 3d frame and then freezing the system, but only changing the edge mark colors
+	for(int i=0;i<8;i++)
+	{
+		u16 col = T1ReadWord(MMU.MMU_MEM[ARMCPU_ARM9][0x40], 0x330+i*2);
+		edgeMarkColors[i].color = RGB15TO5555(col,gfx3d.state.enableAntialiasing ? 0x0F : 0x1F);
+		edgeMarkColors[i].r = GFX3D_5TO6(edgeMarkColors[i].r);
+		edgeMarkColors[i].g = GFX3D_5TO6(edgeMarkColors[i].g);
+		edgeMarkColors[i].b = GFX3D_5TO6(edgeMarkColors[i].b);
+	}
+}
+
 void SoftRasterizerEngine::framebufferProcess()
 {
 	// this looks ok although it's still pretty much a hack,
@@ -1415,36 +1501,21 @@ void SoftRasterizerEngine::framebufferProcess()
 	// - the edges are completely sharp/opaque on the very brief title screen intro,
 	// - the level-start intro gets a pseudo-antialiasing effect around the silhouette,
 	// - the character edges in-level are clearly transparent, and also show well through shield powerups.
-	if(gfx3d.renderState.enableEdgeMarking)
+	if(renderState.enableEdgeMarking)
 	{ 
-		//TODO - need to test and find out whether these get grabbed at flush time, or at render time
-		//we can do this by rendering a 3d frame and then freezing the system, but only changing the edge mark colors
-		FragmentColor edgeMarkColors[8];
 		int edgeMarkDisabled[8];
 
 		for(int i=0;i<8;i++)
 		{
-			u16 col = T1ReadWord(MMU.MMU_MEM[ARMCPU_ARM9][0x40], 0x330+i*2);
-			edgeMarkColors[i].color = RGB15TO5555(col,gfx3d.state.enableAntialiasing ? 0x0F : 0x1F);
-			edgeMarkColors[i].r = GFX3D_5TO6(edgeMarkColors[i].r);
-			edgeMarkColors[i].g = GFX3D_5TO6(edgeMarkColors[i].g);
-			edgeMarkColors[i].b = GFX3D_5TO6(edgeMarkColors[i].b);
-
 			//zero 20-jun-2013 - this doesnt make any sense. at least, it should be related to the 0x8000 bit. if this is undocumented behaviour, lets write about which scenario proves it here, or which scenario is requiring this code.
 			//// this seems to be the only thing that selectively disables edge marking
 			//edgeMarkDisabled[i] = (col == 0x7FFF);
 			edgeMarkDisabled[i] = 0;
 		}
 
-		#ifndef X432R_CUSTOMRENDERER_ENABLED
-		for(int i=0,y=0; y<GFX3D_FRAMEBUFFER_HEIGHT; y++)
+		for(int i=0,y=0; y<height; y++)
 		{
-			for(int x=0; x<GFX3D_FRAMEBUFFER_WIDTH; x++,i++)
-		#else
-		for(int i = 0, y = 0; y < this->height; y++)
-			{
-			for(int x = 0; x < this->width; x++, i++)
-		#endif
+			for(int x=0; x<width; x++,i++)
 			{
 				Fragment destFragment = screen[i];
 				u8 self = destFragment.polyid.opaque;
@@ -1458,15 +1529,10 @@ void SoftRasterizerEngine::framebufferProcess()
 
 				FragmentColor edgeColor = edgeMarkColors[self>>3];
 
-#ifndef X432R_CUSTOMRENDERER_ENABLED
-#define PIXOFFSET(dx,dy) ((dx)+(GFX3D_FRAMEBUFFER_WIDTH*(dy)))
-#define ISEDGE(dx,dy) ((x+(dx)!=GFX3D_FRAMEBUFFER_WIDTH) && (x+(dx)!=-1) && (y+(dy)!=GFX3D_FRAMEBUFFER_HEIGHT) && (y+(dy)!=-1) && self > screen[i+PIXOFFSET(dx,dy)].polyid.opaque)
-#else
-#define PIXOFFSET(dx,dy)	( (dx) + ( this->width * (dy) ) )
-#define ISEDGE(dx,dy)		( (x + (dx) != this->width ) && ( x + (dx) != -1 ) && ( y + (dy) != this->height ) && ( y + (dy) != -1 ) && (self > screen[i + PIXOFFSET(dx, dy)].polyid.opaque) )
-#endif
+#define PIXOFFSET(dx,dy) ((dx)+(width*(dy)))
+#define ISEDGE(dx,dy) ((x+(dx)!=width) && (x+(dx)!=-1) && (y+(dy)!=height) && (y+(dy)!=-1) && self > screen[i+PIXOFFSET(dx,dy)].polyid.opaque)
 
-#define DRAWEDGE(dx,dy) alphaBlend(screenColor[i+PIXOFFSET(dx,dy)], edgeColor)
+#define DRAWEDGE(dx,dy) alphaBlend(screenColor[i+PIXOFFSET(dx,dy)], edgeColor, renderState.enableAlphaBlending)
 
 				bool upleft    = ISEDGE(-1,-1);
 				bool up        = ISEDGE( 0,-1);
@@ -1503,16 +1569,17 @@ void SoftRasterizerEngine::framebufferProcess()
 	}
 
 	#ifndef X432R_CUSTOMRENDERER_ENABLED
-	if(gfx3d.renderState.enableFog)
+	if(renderState.enableFog)
 	#else
-	if( gfx3d.renderState.enableFog && !X432R::IsHighResolutionRendererSelected() )
+	if( renderState.enableFog && !X432R::IsHighResolutionRendererSelected() )
 	#endif
 	{
-		u32 r = GFX3D_5TO6((gfx3d.renderState.fogColor)&0x1F);
-		u32 g = GFX3D_5TO6((gfx3d.renderState.fogColor>>5)&0x1F);
-		u32 b = GFX3D_5TO6((gfx3d.renderState.fogColor>>10)&0x1F);
-		u32 a = (gfx3d.renderState.fogColor>>16)&0x1F;
-		for(int i=0; i<GFX3D_FRAMEBUFFER_WIDTH*GFX3D_FRAMEBUFFER_HEIGHT; i++)
+		u32 r = GFX3D_5TO6((renderState.fogColor)&0x1F);
+		u32 g = GFX3D_5TO6((renderState.fogColor>>5)&0x1F);
+		u32 b = GFX3D_5TO6((renderState.fogColor>>10)&0x1F);
+		u32 a = (renderState.fogColor>>16)&0x1F;
+		const int todo = width*height;
+		for(int i=0; i<todo; i++)
 		{
 			Fragment &destFragment = screen[i];
 			if(!destFragment.fogged) continue;
@@ -1521,7 +1588,7 @@ void SoftRasterizerEngine::framebufferProcess()
 			assert(fogIndex<32768);
 			u8 fog = fogTable[fogIndex];
 			if(fog==127) fog=128;
-			if(!gfx3d.renderState.enableFogAlphaOnly)
+			if(!renderState.enableFogAlphaOnly)
 			{
 				destFragmentColor.r = ((128-fog)*destFragmentColor.r + r*fog)>>7;
 				destFragmentColor.g = ((128-fog)*destFragmentColor.g + g*fog)>>7;
@@ -1702,51 +1769,52 @@ void SoftRasterizerEngine::performBackfaceTests()
 	}
 }
 
-void _HACK_Viewer_ExecUnit(SoftRasterizerEngine* engine)
+void SoftRasterizerEngine::performTileBinning()
 {
-	_HACK_viewer_rasterizerUnit.mainLoop<false>(engine);
-}
+	tileCount = (height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+	for(int t=0;t<tileCount;t++)
+		tilePolys[t].clear();
 
-static void SoftRastRender()
-{
-	// Force threads to finish before rendering with new data
-	if (rasterizerCores > 1)
+	for(int i=0;i<clippedPolyCounter;i++)
 	{
-		for(unsigned int i = 0; i < rasterizerCores; i++)
+		if(!polyVisible[i]) continue;
+
+		const GFX3D_Clipper::TClippedPoly &clippedPoly = clippedPolys[i];
+		const VERT *verts = &clippedPoly.clipVerts[0];
+		float ymin = verts[0].y, ymax = verts[0].y;
+		for(int j=1;j<clippedPoly.type;j++)
 		{
-			rasterizerUnitTask[i].finish();
+			ymin = min(ymin, verts[j].y);
+			ymax = max(ymax, verts[j].y);
 		}
+
+		//the shape engine covers the lines from the top vert up to (not including) the bottom one,
+		//but the line hack can draw the top line of a poly with no height, so keep that one too
+		int top = Ceil28_4((fixed28_4)ymin);
+		int bottom = Ceil28_4((fixed28_4)ymax);
+		top = max(0, min(top, height-1));
+		bottom = max(top, min(bottom, height-1));
+
+		for(int t=top/TILE_HEIGHT;t<=bottom/TILE_HEIGHT;t++)
+			tilePolys[t].push_back(i);
 	}
-	
-	mainSoftRasterizer.polylist = gfx3d.polylist;
-	mainSoftRasterizer.vertlist = gfx3d.vertlist;
-	mainSoftRasterizer.indexlist = &gfx3d.indexlist;
-	mainSoftRasterizer.screen = _screen;
-	mainSoftRasterizer.screenColor = _screenColor;
-	mainSoftRasterizer.width = GFX3D_FRAMEBUFFER_WIDTH;
-	mainSoftRasterizer.height = GFX3D_FRAMEBUFFER_HEIGHT;
 
-	//setup fog variables (but only if fog is enabled)
-	if(gfx3d.renderState.enableFog)
-		mainSoftRasterizer.updateFogTable();
-	
-	mainSoftRasterizer.initFramebuffer(GFX3D_FRAMEBUFFER_WIDTH, GFX3D_FRAMEBUFFER_HEIGHT, gfx3d.renderState.enableClearImage?true:false);
-	mainSoftRasterizer.updateToonTable();
-	mainSoftRasterizer.updateFloatColors();
-	mainSoftRasterizer.performClipping(CommonSettings.GFX3D_HighResolutionInterpolateColor);
-	mainSoftRasterizer.performViewportTransforms<false>(GFX3D_FRAMEBUFFER_WIDTH, GFX3D_FRAMEBUFFER_HEIGHT);
-	mainSoftRasterizer.performBackfaceTests();
-	mainSoftRasterizer.performCoordAdjustment(true);
-	mainSoftRasterizer.setupTextures(true);
+	nextTile = 0;
+}
 
-	softRastHasNewData = true;
-	
+void _HACK_Viewer_ExecUnit(SoftRasterizerEngine* engine)
+{
+	_HACK_viewer_rasterizerUnit.mainLoop<false>(engine);
+}
+
+//runs on the pool once the frame is set up; the units claim tiles from the captured packet
+static void SoftRastRasterizeFrame()
+{
 	if (rasterizerCores > 1)
 	{
 		for(unsigned int i = 0; i < rasterizerCores; i++)
-		{
-			rasterizerUnitTask[i].execute(&execRasterizerUnit, (void *)i);
-		}
+			rasterizerUnitJobs.run(&execRasterizerUnit, (void *)(intptr_t)i, i);
+		rasterizerUnitJobs.wait();
 	}
 	else
 	{
@@ -1754,6 +1822,14 @@ static void SoftRastRender()
 	}
 }
 
+static void* execSoftRastFrame(void* arg)
+{
+	SoftRastRasterizeFrame();
+	mainSoftRasterizer.framebufferProcess();
+	SoftRastConvertFramebuffer();
+	return 0;
+}
+
 static void SoftRastRenderFinish()
 {
 	if (!softRastHasNewData)
@@ -1761,22 +1837,63 @@ static void SoftRastRenderFinish()
 		return;
 	}
 	
-	if (rasterizerCores > 1)
-	{
-		for(unsigned int i = 0; i < rasterizerCores; i++)
-		{
-			rasterizerUnitTask[i].finish();
-		}
-	}
+	softRastFrameJob.wait();
 	
+	//the texcache may only drop items once no frame is drawing with them
 	TexCache_EvictFrame();
 	
-	mainSoftRasterizer.framebufferProcess();
+	softRastHasNewData = false;
+}
+
+static void SoftRastRender()
+{
+	// Force the previous frame to finish before capturing new data
+	SoftRastRenderFinish();
 	
-	//	printf("rendered %d of %d polys after backface culling\n",gfx3d.polylist->count-culled,gfx3d.polylist->count);
-	SoftRastConvertFramebuffer();
+	//the X432R renderers draw their larger frames through their own interfaces
+#ifdef X432R_CUSTOMRENDERER_ENABLED
+	softRastScale = 1;
+#else
+	softRastScale = max(1, min((int)CommonSettings.GFX3D_RenderScale, GFX3D_MAX_RENDER_SCALE));
+#endif
+	const int width = GFX3D_FRAMEBUFFER_WIDTH*softRastScale;
+	const int height = GFX3D_FRAMEBUFFER_HEIGHT*softRastScale;
+
+	mainSoftRasterizer.captureFramePacket();
+	mainSoftRasterizer.screen = _screen;
+	mainSoftRasterizer.screenColor = _screenColor;
+	mainSoftRasterizer.width = width;
+	mainSoftRasterizer.height = height;
+
+	//setup fog variables (but only if fog is enabled)
+	if(mainSoftRasterizer.renderState.enableFog)
+		mainSoftRasterizer.updateFogTable();
 	
-	softRastHasNewData = false;
+	mainSoftRasterizer.initFramebuffer(width, height, mainSoftRasterizer.renderState.enableClearImage?true:false);
+	mainSoftRasterizer.updateToonTable();
+	mainSoftRasterizer.updateFloatColors();
+	mainSoftRasterizer.performClipping(CommonSettings.GFX3D_HighResolutionInterpolateColor);
+	if(softRastScale > 1)
+		mainSoftRasterizer.performViewportTransforms<true>(width, height);
+	else
+		mainSoftRasterizer.performViewportTransforms<false>(width, height);
+	mainSoftRasterizer.performBackfaceTests();
+	mainSoftRasterizer.performCoordAdjustment(true);
+	mainSoftRasterizer.setupTextures(true);
+	if (rasterizerCores > 1)
+		mainSoftRasterizer.performTileBinning();
+
+	softRastHasNewData = true;
+
+	if(softRastScale > 1)
+	{
+		gfx3d_highResScreen = (u8*)_screenColor;
+		gfx3d_highResScale = softRastScale;
+	}
+	
+	//from here on the frame reads only the packet, so the emulator carries on while it is drawn.
+	//the result is waited for when the first line of it is asked for
+	softRastFrameJob.run(&execSoftRastFrame, NULL);
 }
 
 GPU3DInterface gpu3DRasterize = {
@@ -1959,20 +2076,20 @@ void SoftRasterizerEngine::InitFramebuffer(const u32 width, const u32 height, co
 	FragmentColor clearFragmentColor;
 	
 	clearFragment.isTranslucentPoly = 0;
-	clearFragmentColor.r = GFX3D_5TO6(gfx3d.renderState.clearColor & 0x1F);
-	clearFragmentColor.g = GFX3D_5TO6( (gfx3d.renderState.clearColor >> 5) & 0x1F );
-	clearFragmentColor.b = GFX3D_5TO6( (gfx3d.renderState.clearColor >> 10) & 0x1F );
-	clearFragmentColor.a = ( (gfx3d.renderState.clearColor >> 16) & 0x1F );
-	clearFragment.polyid.opaque = (gfx3d.renderState.clearColor >> 24) & 0x3F;
+	clearFragmentColor.r = GFX3D_5TO6(renderState.clearColor & 0x1F);
+	clearFragmentColor.g = GFX3D_5TO6( (renderState.clearColor >> 5) & 0x1F );
+	clearFragmentColor.b = GFX3D_5TO6( (renderState.clearColor >> 10) & 0x1F );
+	clearFragmentColor.a = ( (renderState.clearColor >> 16) & 0x1F );
+	clearFragment.polyid.opaque = (renderState.clearColor >> 24) & 0x3F;
 	
 	//special value for uninitialized translucent polyid. without this, fires in spiderman2 dont display
 	//I am not sure whether it is right, though. previously this was cleared to 0, as a guess,
 	//but in spiderman2 some fires with polyid 0 try to render on top of the background
 	clearFragment.polyid.translucent = kUnsetTranslucentPolyID; 
-	clearFragment.depth = gfx3d.renderState.clearDepth;
+	clearFragment.depth = renderState.clearDepth;
 	clearFragment.stencil = 0;
 	clearFragment.isTranslucentPoly = 0;
-	clearFragment.fogged = BIT15(gfx3d.renderState.clearColor);
+	clearFragment.fogged = BIT15(renderState.clearColor);
 	
 	#ifdef X432R_CUSTOMRENDERER_CLEARIMAGE_ENABLED
 	if(clear_image)
@@ -2055,6 +2172,9 @@ namespace X432R
 		return ::SoftRastInit();
 	}
 	
+	template <u32 RENDER_MAGNIFICATION>
+	static void* execSoftRastFrame(void *arg);
+	
 	template <u32 RENDER_MAGNIFICATION>
 	static void SoftRastRender()
 	{
@@ -2064,18 +2184,10 @@ namespace X432R
 		AutoStopTimeCounter timecounter(timeCounter_3D);
 		#endif
 		
-		// Force threads to finish before rendering with new data
-		if(rasterizerCores > 1)
-		{
-			for(u32 i = 0; i < rasterizerCores; ++i)
-			{
-				rasterizerUnitTask[i].finish();
-			}
-		}
+		// Force the previous frame to finish before capturing new data
+		::SoftRastRenderFinish();
 		
-		mainSoftRasterizer.polylist = gfx3d.polylist;
-		mainSoftRasterizer.vertlist = gfx3d.vertlist;
-		mainSoftRasterizer.indexlist = &gfx3d.indexlist;
+		mainSoftRasterizer.captureFramePacket();
 		mainSoftRasterizer.screen = _screen;
 		mainSoftRasterizer.screenColor = _screenColor;
 		
@@ -2083,14 +2195,14 @@ namespace X432R
 		mainSoftRasterizer.height = 192 * RENDER_MAGNIFICATION;
 		
 		//setup fog variables (but only if fog is enabled)
-		if(gfx3d.renderState.enableFog)
+		if(mainSoftRasterizer.renderState.enableFog)
 			mainSoftRasterizer.updateFogTable();
 		
 		#ifndef X432R_CUSTOMSOFTRASTENGINE_ENABLED
-		mainSoftRasterizer.initFramebuffer(mainSoftRasterizer.width, mainSoftRasterizer.height, gfx3d.renderState.enableClearImage ? true : false);
+		mainSoftRasterizer.initFramebuffer(mainSoftRasterizer.width, mainSoftRasterizer.height, mainSoftRasterizer.renderState.enableClearImage ? true : false);
 		#else
-//		mainSoftRasterizer.InitFramebuffer<RENDER_MAGNIFICATION>(gfx3d.renderState.enableClearImage);
-		mainSoftRasterizer.InitFramebuffer<RENDER_MAGNIFICATION>(mainSoftRasterizer.width, mainSoftRasterizer.height, gfx3d.renderState.enableClearImage);
+//		mainSoftRasterizer.InitFramebuffer<RENDER_MAGNIFICATION>(mainSoftRasterizer.renderState.enableClearImage);
+		mainSoftRasterizer.InitFramebuffer<RENDER_MAGNIFICATION>(mainSoftRasterizer.width, mainSoftRasterizer.height, mainSoftRasterizer.renderState.enableClearImage);
 		#endif
 		
 		
@@ -2108,17 +2220,12 @@ namespace X432R
 		mainSoftRasterizer.ProcessClippedPolygons<true>(mainSoftRasterizer.width, mainSoftRasterizer.height);
 		#endif
 		
+		if(rasterizerCores > 1)
+			mainSoftRasterizer.performTileBinning();
+		
 		softRastHasNewData = true;
 		
-		if(rasterizerCores > 1)
-		{
-			for(u32 i = 0; i < rasterizerCores; ++i)
-			{
-				rasterizerUnitTask[i].execute( &execRasterizerUnit, (void *)i );
-			}
-		}
-		else
-			rasterizerUnit[0].mainLoop<false>(&mainSoftRasterizer);
+		softRastFrameJob.run(&execSoftRastFrame<RENDER_MAGNIFICATION>, NULL);
 	}
 	
 	
@@ -2352,42 +2459,25 @@ namespace X432R
 	#endif
 	
 	template <u32 RENDER_MAGNIFICATION>
-	static void SoftRastRenderFinish()
+	static void* execSoftRastFrame(void *arg)
 	{
-		X432R_STATIC_RENDER_MAGNIFICATION_CHECK();
-		
-		if( !softRastHasNewData ) return;
-		
-		
-		#ifdef X432R_PROCESSTIME_CHECK
-		AutoStopTimeCounter timecounter(timeCounter_3DFinish1);
-		#endif
-		
-		if(rasterizerCores > 1)
-		{
-			for(u32 i = 0; i < rasterizerCores; ++i)
-			{
-				rasterizerUnitTask[i].finish();
-			}
-		}
-		
-		TexCache_EvictFrame();
+		SoftRastRasterizeFrame();
 		
 		mainSoftRasterizer.framebufferProcess();
 		
 		
-		const u8 * const fogdensity_pointer = MMU.MMU_MEM[ARMCPU_ARM9][0x40] + 0x360;
+		const u8 * const fogdensity_pointer = mainSoftRasterizer.fogDensity;
 		
-		if( !gfx3d.renderState.enableFog || ( ( fogdensity_pointer[0] == 0 ) && ( fogdensity_pointer[31] == 0 ) ) )
+		if( !mainSoftRasterizer.renderState.enableFog || ( ( fogdensity_pointer[0] == 0 ) && ( fogdensity_pointer[31] == 0 ) ) )
 			SoftRast_DownscaleFramebuffer<RENDER_MAGNIFICATION, false, false>();
 		else
 		{
-			softRast_FogColorR = GFX3D_5TO6(gfx3d.renderState.fogColor & 0x1F);
-			softRast_FogColorG = GFX3D_5TO6( (gfx3d.renderState.fogColor >> 5) & 0x1F );
-			softRast_FogColorB = GFX3D_5TO6( (gfx3d.renderState.fogColor >> 10) & 0x1F );
-			softRast_FogColorA = (gfx3d.renderState.fogColor>>16) & 0x1F;
+			softRast_FogColorR = GFX3D_5TO6(mainSoftRasterizer.renderState.fogColor & 0x1F);
+			softRast_FogColorG = GFX3D_5TO6( (mainSoftRasterizer.renderState.fogColor >> 5) & 0x1F );
+			softRast_FogColorB = GFX3D_5TO6( (mainSoftRasterizer.renderState.fogColor >> 10) & 0x1F );
+			softRast_FogColorA = (mainSoftRasterizer.renderState.fogColor>>16) & 0x1F;
 			
-			if( !gfx3d.renderState.enableFogAlphaOnly )
+			if( !mainSoftRasterizer.renderState.enableFogAlphaOnly )
 				SoftRast_DownscaleFramebuffer<RENDER_MAGNIFICATION, true, false>();
 			else
 			{
@@ -2399,8 +2489,22 @@ namespace X432R
 			}
 		}
 		
+		return 0;
+	}
+	
+	template <u32 RENDER_MAGNIFICATION>
+	static void SoftRastRenderFinish()
+	{
+		X432R_STATIC_RENDER_MAGNIFICATION_CHECK();
+		
+		if( !softRastHasNewData ) return;
+		
+		
+		#ifdef X432R_PROCESSTIME_CHECK
+		AutoStopTimeCounter timecounter(timeCounter_3DFinish1);
+		#endif
 		
-		softRastHasNewData = false;
+		::SoftRastRenderFinish();
 	}
 	
 	
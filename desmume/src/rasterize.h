@@ -18,12 +18,16 @@
 #ifndef _RASTERIZE_H_
 #define _RASTERIZE_H_
 
+#include <vector>
+
 #include "render3D.h"
 #include "gfx3d.h"
 
 
 //---CUSTOM--->
+#ifdef HOST_WINDOWS
 #include "X432R_BuildSwitch.h"
+#endif
 //<---CUSTOM---
 
 
@@ -71,6 +75,7 @@ public:
 
 	SoftRasterizerEngine();
 	
+	void captureFramePacket();
 	void initFramebuffer(const int width, const int height, const bool clearImage);
 	void framebufferProcess();
 	void updateToonTable();
@@ -81,6 +86,7 @@ public:
 	void performCoordAdjustment(const bool skipBackfacing);
 	void performBackfaceTests();
 	void setupTextures(const bool skipBackfacing);
+	void performTileBinning();
 
 	FragmentColor toonTable[32];
 	u8 fogTable[32768];
@@ -96,6 +102,21 @@ public:
 	VERTLIST* vertlist;
 	INDEXLIST* indexlist;
 	int width, height;
+
+	//the frame packet: everything the rasterizer and the postprocess read from the 3d state, captured when
+	//the frame is submitted so the emulator can go on (and flush the next list) while the frame is drawn on the pool
+	GFX3D_State renderState;
+	POLYLIST* packetPolylist;
+	u8 fogDensity[32];
+	FragmentColor edgeMarkColors[8];
+
+	//for multithreaded rendering the screen is cut into bands of TILE_HEIGHT lines.
+	//each band lists the visible polys which touch it, in draw order, and the rasterizer units
+	//claim bands through nextTile until they run out
+	enum { TILE_HEIGHT = 8, MAX_TILES = 768 / TILE_HEIGHT };
+	std::vector<int> tilePolys[MAX_TILES];
+	int tileCount;
+	volatile long nextTile;
 	
 	
 	#ifdef X432R_CUSTOMSOFTRASTENGINE_ENABLED
@@ -0,0 +1,211 @@
+/*
+	Copyright (C) 2015 DeSmuME team
+
+	This file is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This file is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with the this software.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include "rewind.h"
+
+//a delta either lists the changed pages of a state which kept its size,
+//or, when the size changed (a chunk grew or shrank), holds the whole old state
+enum
+{
+	DELTA_PAGES = 0,
+	DELTA_FULL = 1,
+};
+
+RewindStore rewindStore;
+
+static FORCEINLINE u32 loadWord(const u8* page, const u32 len, const u32 word)
+{
+	u32 ret = 0;
+	const u32 ofs = word*4;
+	memcpy(&ret, page + ofs, (ofs+4 <= len) ? 4 : (len-ofs));
+	return ret;
+}
+
+static FORCEINLINE void xorWord(u8* page, const u32 len, const u32 word, const u32 val)
+{
+	const u32 ofs = word*4;
+	u32 temp = loadWord(page, len, word) ^ val;
+	memcpy(page + ofs, &temp, (ofs+4 <= len) ? 4 : (len-ofs));
+}
+
+static void append16(std::vector<u8> &out, u16 val)
+{
+	const size_t pos = out.size();
+	out.resize(pos+2);
+	memcpy(&out[pos], &val, 2);
+}
+
+static void append32(std::vector<u8> &out, u32 val)
+{
+	const size_t pos = out.size();
+	out.resize(pos+4);
+	memcpy(&out[pos], &val, 4);
+}
+
+static FORCEINLINE u16 read16(const u8* &p) { u16 ret; memcpy(&ret, p, 2); p += 2; return ret; }
+static FORCEINLINE u32 read32(const u8* &p) { u32 ret; memcpy(&ret, p, 4); p += 4; return ret; }
+
+//pages are coded as words: a count of unchanged words, a count of changed words, then the changed words
+//xored with their other version. the last word of a state whose size isn't a multiple of 4 is padded with zeroes
+static void encodePage(std::vector<u8> &out, const u8* oldPage, const u8* newPage, const u32 len)
+{
+	const u32 words = (len+3)/4;
+	u32 w = 0;
+	while(w < words)
+	{
+		u32 same = 0;
+		while(w+same < words && loadWord(oldPage,len,w+same) == loadWord(newPage,len,w+same))
+			same++;
+		w += same;
+
+		u32 changed = 0;
+		while(w+changed < words && loadWord(oldPage,len,w+changed) != loadWord(newPage,len,w+changed))
+			changed++;
+
+		append16(out, (u16)same);
+		append16(out, (u16)changed);
+		for(u32 i=0;i<changed;i++,w++)
+			append32(out, loadWord(oldPage,len,w) ^ loadWord(newPage,len,w));
+	}
+}
+
+RewindStore::RewindStore()
+	: deltaBytes(0)
+	, budget(64*1024*1024)
+	, maxCount(0)
+{
+}
+
+RewindStore::~RewindStore()
+{
+	clear();
+}
+
+void RewindStore::push(const u8* state, u32 size)
+{
+	if(current.empty())
+	{
+		current.assign(state, state+size);
+		return;
+	}
+
+	Delta* delta = new Delta();
+
+	if(size != current.size())
+	{
+		delta->reserve(current.size()+1);
+		delta->push_back(DELTA_FULL);
+		delta->insert(delta->end(), current.begin(), current.end());
+		current.assign(state, state+size);
+	}
+	else
+	{
+		delta->push_back(DELTA_PAGES);
+		for(u32 ofs=0; ofs<size; ofs+=PAGE_SIZE)
+		{
+			const u32 len = (size-ofs < (u32)PAGE_SIZE) ? (size-ofs) : (u32)PAGE_SIZE;
+			u8* oldPage = &current[ofs];
+			if(!memcmp(oldPage, state+ofs, len)) continue;
+
+			append32(*delta, ofs/PAGE_SIZE);
+			encodePage(*delta, oldPage, state+ofs, len);
+			memcpy(oldPage, state+ofs, len);
+		}
+
+		//don't let the slack from growing the vector count against the budget
+		Delta(*delta).swap(*delta);
+	}
+
+	deltas.push_back(delta);
+	deltaBytes += (u32)delta->size();
+	trim();
+}
+
+bool RewindStore::pop()
+{
+	if(deltas.empty())
+		return false;
+
+	Delta* delta = deltas.back();
+	deltas.pop_back();
+	deltaBytes -= (u32)delta->size();
+
+	const u8* p = &(*delta)[0];
+	const u8* const end = p + delta->size();
+
+	if(*p++ == DELTA_FULL)
+	{
+		current.assign(p, end);
+	}
+	else
+	{
+		const u32 size = (u32)current.size();
+		while(p < end)
+		{
+			const u32 ofs = read32(p) * PAGE_SIZE;
+			const u32 len = (size-ofs < (u32)PAGE_SIZE) ? (size-ofs) : (u32)PAGE_SIZE;
+			const u32 words = (len+3)/4;
+			u8* page = &current[ofs];
+
+			u32 w = 0;
+			while(w < words)
+			{
+				w += read16(p);
+				const u32 changed = read16(p);
+				for(u32 i=0;i<changed;i++,w++)
+					xorWord(page, len, w, read32(p));
+			}
+		}
+	}
+
+	delete delta;
+	return true;
+}
+
+void RewindStore::clear()
+{
+	for(size_t i=0;i<deltas.size();i++)
+		delete deltas[i];
+	deltas.clear();
+	deltaBytes = 0;
+	current.clear();
+}
+
+void RewindStore::setBudget(u32 bytes)
+{
+	budget = bytes;
+	trim();
+}
+
+void RewindStore::setMaxCount(u32 count)
+{
+	maxCount = count;
+	trim();
+}
+
+void RewindStore::trim()
+{
+	while(!deltas.empty() && (deltaBytes > budget || (maxCount != 0 && deltas.size()+1 > maxCount)))
+	{
+		Delta* delta = deltas.front();
+		deltas.pop_front();
+		deltaBytes -= (u32)delta->size();
+		delete delta;
+	}
+}
@@ -0,0 +1,82 @@
+/*
+	Copyright (C) 2015 DeSmuME team
+
+	This file is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This file is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with the this software.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _REWIND_H_
+#define _REWIND_H_
+
+#include <vector>
+#include <deque>
+#include <stddef.h>
+
+#include "types.h"
+
+//Keeps the rewind history as one full savestate (the newest) plus a chain of backward deltas.
+//Each delta holds only the pages of the serialized state which changed since the snapshot before it,
+//xored against their old contents and squeezed with a zero run length coding, so a frame that touched
+//a few pages of main ram costs a few kilobytes instead of a whole savestate.
+//Stepping back applies the newest delta to the full state, which costs the size of that delta no matter
+//how long the history is; when the history outgrows its budget the oldest deltas are simply dropped.
+class RewindStore
+{
+public:
+	RewindStore();
+	~RewindStore();
+
+	//the size of the pages the serialized state is compared in
+	enum { PAGE_SIZE = 4096 };
+
+	//records a newly serialized state as the newest snapshot
+	void push(const u8* state, u32 size);
+
+	//the newest snapshot, or NULL when there is none
+	const std::vector<u8>* top() const { return current.empty() ? NULL : &current; }
+
+	//drops the newest snapshot so that the one before it becomes top().
+	//returns false, keeping the snapshot, when it is the oldest one left
+	bool pop();
+
+	void clear();
+
+	//bytes the deltas may take up; the newest full snapshot is not counted
+	void setBudget(u32 bytes);
+	u32 getBudget() const { return budget; }
+
+	//the number of snapshots which can be stepped back to, 0 is unlimited
+	void setMaxCount(u32 count);
+
+	u32 count() const { return current.empty() ? 0 : (u32)deltas.size() + 1; }
+	u32 bytes() const { return deltaBytes; }
+
+private:
+	typedef std::vector<u8> Delta;
+
+	void trim();
+
+	//the newest snapshot
+	std::vector<u8> current;
+
+	//oldest first; applying the last one to current yields the snapshot before current
+	std::deque<Delta*> deltas;
+	u32 deltaBytes;
+
+	u32 budget;
+	u32 maxCount;
+};
+
+extern RewindStore rewindStore;
+
+#endif
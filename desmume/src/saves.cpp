@@ -52,6 +52,8 @@
 #include "slot2.h"
 #include "SPU.h"
 #include "wifi.h"
+#include "rewind.h"
+#include "utils/jobpool.h"
 
 #include "path.h"
 
@@ -952,87 +954,208 @@ static void savestate_WriteChunk(EMUFILE* os, int type, void (*saveproc)(EMUFILE
 
 static void writechunks(EMUFILE* os);
 
-bool savestate_save(EMUFILE* outstream, int compressionLevel)
+//the state is generated here before it is compressed; reused across saves
+static EMUFILE_MEMORY savestateScratch;
+
+#ifdef HAVE_LIBZ
+//compressed savestates are deflated in blocks on the job pool. every block is deflated on its own and ends on a byte boundary,
+//so the blocks laid end to end behind a zlib header, followed by the adler32 of the whole, are one ordinary zlib stream
+//which uncompress() reads back just like before
+struct SavestateBlock
 {
-#ifdef HAVE_JIT 
-	arm_jit_sync();
-#endif
-	#ifndef HAVE_LIBZ
-	compressionLevel = Z_NO_COMPRESSION;
-	#endif
+	const u8* src;
+	u32 len;
+	int level;
+	bool last;
+
+	std::vector<u8> out;
+	u32 outLen;
+	uLong adler;
+	int error;
+};
 
-	EMUFILE_MEMORY ms;
-	EMUFILE* os;
-	
-	if(compressionLevel != Z_NO_COMPRESSION)
+static const u32 kSavestateBlockSize = 256*1024;
+
+//kept from one save to the next so that a save doesn't have to allocate
+static std::vector<SavestateBlock> savestateBlocks;
+
+static void* execCompressSavestateBlock(void* arg)
+{
+	SavestateBlock &block = *(SavestateBlock*)arg;
+
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	block.error = deflateInit2(&zs, block.level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+	if(block.error != Z_OK)
+		return 0;
+
+	//the bound doesn't count the empty stored block a sync flush ends with
+	const u32 bound = (u32)deflateBound(&zs, block.len) + 16;
+	if(block.out.size() < bound)
+		block.out.resize(bound);
+
+	zs.next_in = (Bytef*)block.src;
+	zs.avail_in = block.len;
+	zs.next_out = &block.out[0];
+	zs.avail_out = (uInt)block.out.size();
+
+	const int ret = deflate(&zs, block.last ? Z_FINISH : Z_SYNC_FLUSH);
+	block.error = (ret == (block.last ? Z_STREAM_END : Z_OK) && zs.avail_in == 0) ? Z_OK : Z_BUF_ERROR;
+	block.outLen = (u32)zs.total_out;
+	deflateEnd(&zs);
+
+	block.adler = adler32(adler32(0, NULL, 0), block.src, block.len);
+
+	return 0;
+}
+
+static u32 compressSavestate(const u8* src, u32 len, int level)
+{
+	const u32 count = (len + kSavestateBlockSize - 1) / kSavestateBlockSize;
+	savestateBlocks.resize(count);
+
+	JobGroup jobs;
+	for(u32 i=0;i<count;i++)
 	{
-		//generate the savestate in memory first
-		os = (EMUFILE*)&ms;
-		writechunks(os);
+		SavestateBlock &block = savestateBlocks[i];
+		block.src = src + i*kSavestateBlockSize;
+		block.len = (i == count-1) ? (len - i*kSavestateBlockSize) : kSavestateBlockSize;
+		block.level = level;
+		block.last = (i == count-1);
+		jobs.run(&execCompressSavestateBlock, &block);
 	}
-	else
+	jobs.wait();
+
+	u32 comprlen = 2 + 4; //zlib header and adler32
+	for(u32 i=0;i<count;i++)
 	{
-		os = outstream;
-		os->fseek(32,SEEK_SET); //skip the header
-		writechunks(os);
+		if(savestateBlocks[i].error != Z_OK)
+			return 0;
+		comprlen += savestateBlocks[i].outLen;
 	}
 
-	//save the length of the file
-	u32 len = os->ftell();
+	return comprlen;
+}
+
+static void writeSavestateBlocks(EMUFILE* os)
+{
+	//deflate with the default 32K window
+	os->fputc(0x78);
+	os->fputc(0x9C);
+
+	uLong adler = adler32(0, NULL, 0);
+	for(size_t i=0;i<savestateBlocks.size();i++)
+	{
+		const SavestateBlock &block = savestateBlocks[i];
+		os->fwrite(&block.out[0], block.outLen);
+		adler = adler32_combine(adler, block.adler, block.len);
+	}
 
-	u32 comprlen = 0xFFFFFFFF;
-	u8* cbuf;
+	//the zlib trailer is big endian
+	os->fputc((adler>>24)&0xFF);
+	os->fputc((adler>>16)&0xFF);
+	os->fputc((adler>>8)&0xFF);
+	os->fputc(adler&0xFF);
+}
+#endif
 
-	//compress the data
-	int error = Z_OK;
+//generates the savestate in savestateScratch and compresses it, without touching the destination yet
+static bool prepareSavestate(int compressionLevel, u32 &len, u32 &comprlen)
+{
+	savestateScratch.fseek(0,SEEK_SET);
+	writechunks(&savestateScratch);
+	len = savestateScratch.ftell();
+
+	comprlen = 0xFFFFFFFF;
+#ifdef HAVE_LIBZ
 	if(compressionLevel != Z_NO_COMPRESSION)
 	{
-		cbuf = ms.buf();
-		uLongf comprlen2;
-		//worst case compression.
-		//zlib says "0.1% larger than sourceLen plus 12 bytes"
-		comprlen = (len>>9)+12 + len;
-		cbuf = new u8[comprlen];
-		// Workaround to make it compile under linux 64bit
-		comprlen2 = comprlen;
-		error = compress2(cbuf,&comprlen2,ms.buf(),len,compressionLevel);
-		comprlen = (u32)comprlen2;
+		comprlen = compressSavestate(savestateScratch.buf(),len,compressionLevel);
+		if(comprlen == 0)
+			return false;
 	}
+#endif
 
-	//dump the header
-	outstream->fseek(0,SEEK_SET);
-	outstream->fwrite(magic,16);
-	write32le(SAVESTATE_VERSION,outstream);
-	write32le(EMU_DESMUME_VERSION_NUMERIC(),outstream); //desmume version
-	write32le(len,outstream); //uncompressed length
-	write32le(comprlen,outstream); //compressed length (-1 if it is not compressed)
+	return true;
+}
+
+static void writeSavestateHeader(EMUFILE* os, u32 len, u32 comprlen)
+{
+	os->fseek(0,SEEK_SET);
+	os->fwrite(magic,16);
+	write32le(SAVESTATE_VERSION,os);
+	write32le(EMU_DESMUME_VERSION_NUMERIC(),os); //desmume version
+	write32le(len,os); //uncompressed length
+	write32le(comprlen,os); //compressed length (-1 if it is not compressed)
+}
+
+//writes what prepareSavestate left behind
+static void writeSavestate(EMUFILE* os, u32 len, u32 comprlen)
+{
+	writeSavestateHeader(os,len,comprlen);
+
+#ifdef HAVE_LIBZ
+	if(comprlen != 0xFFFFFFFF)
+	{
+		writeSavestateBlocks(os);
+		return;
+	}
+#endif
+	os->fwrite(savestateScratch.buf(),len);
+}
+
+bool savestate_save(EMUFILE* outstream, int compressionLevel)
+{
+#ifdef HAVE_JIT 
+	arm_jit_sync();
+#endif
+	#ifndef HAVE_LIBZ
+	compressionLevel = Z_NO_COMPRESSION;
+	#endif
+
+	u32 len, comprlen;
 
 	if(compressionLevel != Z_NO_COMPRESSION)
 	{
-		outstream->fwrite((char*)cbuf,comprlen==(u32)-1?len:comprlen);
-		delete[] cbuf;
+		if(!prepareSavestate(compressionLevel,len,comprlen))
+			return false;
+		writeSavestate(outstream,len,comprlen);
+	}
+	else
+	{
+		//generate the savestate straight into the stream, behind room for the header
+		outstream->fseek(32,SEEK_SET);
+		writechunks(outstream);
+		len = outstream->ftell();
+		writeSavestateHeader(outstream,len,0xFFFFFFFF);
 	}
 
-	return error == Z_OK;
+	return !outstream->fail();
 }
 
 bool savestate_save (const char *file_name)
 {
-	EMUFILE_MEMORY ms;
-	size_t elems_written;
+#ifdef HAVE_JIT 
+	arm_jit_sync();
+#endif
 #ifdef HAVE_LIBZ
-	if(!savestate_save(&ms, Z_DEFAULT_COMPRESSION))
+	const int compressionLevel = Z_DEFAULT_COMPRESSION;
 #else
-	if(!savestate_save(&ms, 0))
+	const int compressionLevel = 0;
 #endif
+
+	//the file is only opened (and so truncated) once the savestate is ready to go,
+	//so a save which fails leaves the previous one alone
+	u32 len, comprlen;
+	if(!prepareSavestate(compressionLevel,len,comprlen))
 		return false;
-	FILE* file = fopen(file_name,"wb");
-	if(file)
-	{
-		elems_written = fwrite(ms.buf(),1,ms.size(),file);
-		fclose(file);
-		return (elems_written == ms.size());
-	} else return false;
+
+	//the blocks are written straight to the file from where the compressor left them
+	EMUFILE_FILE file(file_name,"wb");
+	if(file.fail())
+		return false;
+	writeSavestate(&file,len,comprlen);
+	return !file.fail();
 }
 
 static void writechunks(EMUFILE* os) {
@@ -1042,6 +1165,9 @@ static void writechunks(EMUFILE* os) {
 
 	save_time = tm.get_Ticks();
 
+	//the 3d renderer may still be drawing a frame on the job pool
+	gpu3D->NDS_3D_RenderFinish();
+
 	savestate_WriteChunk(os,1,SF_ARM9);
 	savestate_WriteChunk(os,2,SF_ARM7);
 	savestate_WriteChunk(os,3,cp15_savestate);
@@ -1094,6 +1220,10 @@ static bool ReadStateChunks(EMUFILE* is, s32 totalsize)
 	};
 	memset(&header, 0, sizeof(header));
 
+	//the 3d renderer may still be drawing a frame on the job pool, out of the state the chunks below overwrite.
+	//savestate_load gets here through NDS_Reset, which finishes it, but rewinding does not
+	gpu3D->NDS_3D_RenderFinish();
+
 	while(totalsize > 0)
 	{
 		u32 size = 0;
@@ -1176,6 +1306,18 @@ static bool ReadStateChunks(EMUFILE* is, s32 totalsize)
 
 static void loadstate()
 {
+	// the memory was replaced under the opcode cache, and the handlers of the fetched instructions aren't saved
+	opcache_reset();
+	armcpu_redecode(&NDS_ARM9);
+	armcpu_redecode(&NDS_ARM7);
+
+	// the memory map may have changed with WRAMCNT and the vram banks
+	MMU_RemapAllPages();
+
+	// and the sprites were replaced under their bins
+	GPU_InvalidateOAM(0);
+	GPU_InvalidateOAM(ADDRESS_STEP_1KB);
+
     // This should regenerate the vram banks
     for (int i = 0; i < 0xA; i++)
        _MMU_write08<ARMCPU_ARM9>(0x04000240+i, _MMU_read08<ARMCPU_ARM9>(0x04000240+i));
@@ -1293,10 +1435,10 @@ bool savestate_load(const char *file_name)
 	return savestate_load(&f);
 }
 
-static std::stack<EMUFILE_MEMORY*> rewindFreeList;
-static std::vector<EMUFILE_MEMORY*> rewindbuffer;
+//the state is serialized into the same buffer every time; the store keeps just what changed
+static EMUFILE_MEMORY rewindScratch;
 
-int rewindstates = 16;
+int rewindstates = 0; //0 keeps as many as fit the rewind budget
 int rewindinterval = 4;
 
 void rewindsave () {
@@ -1306,24 +1448,15 @@ void rewindsave () {
 
 	//printf("rewindsave"); printf("%d%s", currFrameCounter, "\n");
 
-	
-	EMUFILE_MEMORY *ms;
-	if(!rewindFreeList.empty()) {
-		ms = rewindFreeList.top();
-		rewindFreeList.pop();
-	} else {
-		ms = new EMUFILE_MEMORY(1024*1024*12);
-	}
+#ifdef HAVE_JIT 
+	arm_jit_sync();
+#endif
 
-	if(!savestate_save(ms, Z_NO_COMPRESSION))
-		return;
+	rewindScratch.fseek(0,SEEK_SET);
+	writechunks(&rewindScratch);
 
-	rewindbuffer.push_back(ms);
-	
-	if((int)rewindbuffer.size() > rewindstates) {
-		delete *rewindbuffer.begin();
-		rewindbuffer.erase(rewindbuffer.begin());
-	}
+	rewindStore.setMaxCount(rewindstates);
+	rewindStore.push(rewindScratch.buf(), rewindScratch.ftell());
 }
 
 void dorewind()
@@ -1333,25 +1466,20 @@ void dorewind()
 
 	//printf("rewind\n");
 
-	int size = rewindbuffer.size();
+	const std::vector<u8>* state = rewindStore.top();
 
-	if(size < 1) {
+	if(!state) {
 		printf("rewind buffer empty\n");
 		return;
 	}
 
-	printf("%d", size);
+	printf("%d", rewindStore.count());
 
-	EMUFILE_MEMORY* loadms = rewindbuffer[size-1];
-	loadms->fseek(32, SEEK_SET);
+	//the store's copy is read in place
+	EMUFILE_MEMORY loadms(const_cast<std::vector<u8>*>(state));
 
-	ReadStateChunks(loadms,loadms->size()-32);
+	ReadStateChunks(&loadms,loadms.size());
 	loadstate();
 
-	if(rewindbuffer.size()>1)
-	{
-		rewindFreeList.push(loadms);
-		rewindbuffer.pop_back();
-	}
-
+	rewindStore.pop();
 }
@@ -31,6 +31,10 @@
 #include "MMU.h"
 #include "NDSSystem.h"
 
+#ifdef ENABLE_SSE2
+#include <emmintrin.h>
+#endif
+
 using std::min;
 using std::max;
 
@@ -46,7 +50,7 @@ public:
 	static const int MAXSIZE = 17; //max size for textures: 1024*1024*2 bytes / 128*1024 banks + 1 for wraparound
 
 	MemSpan() 
-		: numItems(0), size(0)
+		: numItems(0), size(0), slots(0)
 	{}
 
 	int numItems;
@@ -60,6 +64,9 @@ public:
 
 	int size;
 
+	//bitmask of the texture or palette slots the items were taken from
+	u8 slots;
+
 	//this MemSpan shall be considered the first argument to a standard memcmp
 	//the length shall be as specified in this MemSpan, unless you specify otherwise
 	int memcmp(void* buf2, int size=-1)
@@ -128,8 +135,56 @@ public:
 		}
 		return done;
 	}
+
+	//a quick 64bit hash of the contents, for noticing when they change without keeping a copy around.
+	//the four lanes are independent so it can run about as fast as the memory can be read
+	u64 hash(u64 seed) const
+	{
+		static const u64 kPrime1 = 0x9E3779B185EBCA87ULL;
+		static const u64 kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+		u64 h = seed ^ ((u64)size * kPrime1);
+		for(int i=0;i<numItems;i++)
+		{
+			const Item &item = items[i];
+			const u8* ptr = item.ptr;
+			u32 todo = item.len;
+
+			u64 lane[4] = { h + kPrime1, h + kPrime2, h, h - kPrime1 };
+			for(;todo>=32;todo-=32,ptr+=32)
+			{
+				for(int j=0;j<4;j++)
+				{
+					lane[j] += ((const u64*)ptr)[j] * kPrime2;
+					lane[j] = ((lane[j] << 31) | (lane[j] >> 33)) * kPrime1;
+				}
+			}
+			h = lane[0] ^ ((lane[1] << 7) | (lane[1] >> 57)) ^ ((lane[2] << 12) | (lane[2] >> 52)) ^ ((lane[3] << 18) | (lane[3] >> 46));
+
+			for(;todo>0;todo--,ptr++)
+				h = (h ^ *ptr) * kPrime1;
+			h ^= h >> 29;
+		}
+		return h;
+	}
+
+	//sets the bits of the vram_dirty pages this span reads from
+	void markPages(u32* pages) const
+	{
+		for(int i=0;i<numItems;i++)
+		{
+			const Item &item = items[i];
+			if(item.ptr < MMU.ARM9_LCD || item.ptr >= MMU.ARM9_LCD + sizeof(MMU.ARM9_LCD)) continue;
+			const u32 ofs = (u32)(item.ptr - MMU.ARM9_LCD);
+			u32 last = (ofs + item.len - 1)>>VRAM_DIRTY_PAGE_SHIFT;
+			if(last >= VRAM_DIRTY_PAGES) last = VRAM_DIRTY_PAGES-1;
+			for(u32 page=ofs>>VRAM_DIRTY_PAGE_SHIFT;page<=last;page++)
+				pages[page>>5] |= 1<<(page&31);
+		}
+	}
 };
 
+CTASSERT(TexCacheItem::Source::kPageWords*32 >= VRAM_DIRTY_PAGES);
+
 //creates a MemSpan in texture memory
 static MemSpan MemSpan_TexMem(u32 ofs, u32 len) 
 {
@@ -140,6 +195,7 @@ static MemSpan MemSpan_TexMem(u32 ofs, u32 len)
 		MemSpan::Item &curr = ret.items[ret.numItems++];
 		curr.start = ofs&0x1FFFF;
 		u32 slot = (ofs>>17)&3; //slots will wrap around
+		ret.slots |= 1<<slot;
 		curr.len = min(len,0x20000-curr.start);
 		curr.ofs = currofs;
 		len -= curr.len;
@@ -170,6 +226,7 @@ static MemSpan MemSpan_TexPalette(u32 ofs, u32 len, bool silent)
 			PROGINFO("Texture palette overruns texture memory. Wrapping at palette slot 0.\n");
 			slot -= 5;
 		}
+		ret.slots |= 1<<slot;
 		curr.len = min(len,0x4000-curr.start);
 		curr.ofs = currofs;
 		len -= curr.len;
@@ -201,13 +258,87 @@ static void DebugDumpTexture(TexCacheItem* item)
 }
 #endif
 
+//converts the palette of a palettized texture up front, so that decoding a texel is one table lookup
+//instead of a trip through the 128KB color_15bit_to_24bit table for every texel
+template<TexCache_TexFormat TEXFORMAT>
+static void TexCache_BuildPaletteLUT(u32* lut, const u16* pal, int count, u32 alphaZero, u32 alpha)
+{
+	lut[0] = CONVERT(pal[0],alphaZero);
+	for(int i=1;i<count;i++)
+		lut[i] = CONVERT(pal[i],alpha);
+}
+
+#if defined(ENABLE_SSE2) && !defined(WORDS_BIGENDIAN)
+//converts four 16bpp texels (zero extended to 32 bits) the same way as CONVERT does
+template<TexCache_TexFormat TEXFORMAT>
+static FORCEINLINE __m128i TexCache_Convert16bpp(__m128i c)
+{
+	const __m128i mask5 = _mm_set1_epi32(0x1F);
+
+	//spread the 5bit components out to one byte each
+	__m128i rgb = _mm_and_si128(c,mask5);
+	rgb = _mm_or_si128(rgb,_mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(c,5),mask5),8));
+	rgb = _mm_or_si128(rgb,_mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(c,10),mask5),16));
+
+	//bit 15 set -> opaque
+	const __m128i opaque = _mm_srai_epi32(_mm_slli_epi32(c,16),31);
+
+	if(TEXFORMAT == TexFormat_15bpp)
+	{
+		//6665: each component becomes (x<<1)+1
+		rgb = _mm_add_epi32(_mm_slli_epi32(rgb,1),_mm_set1_epi32(0x010101));
+		return _mm_or_si128(rgb,_mm_and_si128(opaque,_mm_set1_epi32(31<<24)));
+	}
+	else
+	{
+		//8888: each component becomes (x<<3)|(x>>2), which is what color_15bit_to_24bit holds
+		rgb = _mm_or_si128(_mm_slli_epi32(rgb,3),_mm_and_si128(_mm_srli_epi32(rgb,2),_mm_set1_epi32(0x070707)));
+		return _mm_or_si128(rgb,_mm_and_si128(opaque,_mm_set1_epi32(0xFF000000)));
+	}
+}
+#endif
+
+//decodes a run of 16bpp texels, returning the advanced destination
+template<TexCache_TexFormat TEXFORMAT>
+static u32* TexCache_Decode16bpp(u32* dst, const u16* src, int count)
+{
+	int x = 0;
+
+#if defined(ENABLE_SSE2) && !defined(WORDS_BIGENDIAN)
+	const __m128i zero = _mm_setzero_si128();
+	for(;x<=count-8;x+=8,dst+=8)
+	{
+		const __m128i c = _mm_loadu_si128((__m128i*)(src+x));
+		_mm_storeu_si128((__m128i*)dst,TexCache_Convert16bpp<TEXFORMAT>(_mm_unpacklo_epi16(c,zero)));
+		_mm_storeu_si128((__m128i*)(dst+4),TexCache_Convert16bpp<TEXFORMAT>(_mm_unpackhi_epi16(c,zero)));
+	}
+#endif
+
+	const u32 opaqueColor = TEXFORMAT==TexFormat_32bpp?255:31;
+	for(;x<count;x++)
+	{
+		const u16 c = src[x];
+		*dst++ = CONVERT(c&0x7FFF,(c&0x8000)?opaqueColor:0);
+	}
+	return dst;
+}
+
 class TexCache
 {
 public:
 	TexCache()
 		: cache_size(0)
+		, budget(kMaxCacheSize)
+		, lruHead(NULL)
+		, lruTail(NULL)
+		, frame(1)
+		, revalidatePending(true)
 	{
 		memset(paletteDump,0,sizeof(paletteDump));
+		memset(&validTexInfo,0,sizeof(validTexInfo));
+		memset(&frameStats,0,sizeof(frameStats));
+		memset(&lastFrameStats,0,sizeof(lastFrameStats));
+		memset(&totalStats,0,sizeof(totalStats));
 	}
 
 	TTexCacheItemMultimap index;
@@ -221,21 +352,92 @@ public:
 	//this is not really precise, it is off by a constant factor
 	u32 cache_size;
 
+	//the size evict() trims the cache to. kMaxCacheSize unless a frontend picked something else
+	u32 budget;
+
+	//every item, most recently used first
+	TexCacheItem *lruHead, *lruTail;
+
+	//counts the frames ended by TexCache_EvictFrame
+	u32 frame;
+
+	TexCacheStats frameStats, lastFrameStats, totalStats;
+
 	void list_remove(TexCacheItem* item)
 	{
 		index.erase(item->iterator);
 		cache_size -= item->decode_len;
+
+		if(item->lruPrev) item->lruPrev->lruNext = item->lruNext;
+		else lruHead = item->lruNext;
+		if(item->lruNext) item->lruNext->lruPrev = item->lruPrev;
+		else lruTail = item->lruPrev;
+		item->lruPrev = item->lruNext = NULL;
 	}
 
 	void list_push_front(TexCacheItem* item)
 	{
 		item->iterator = index.insert(std::make_pair(item->texformat,item));
 		cache_size += item->decode_len;
+
+		item->lruPrev = NULL;
+		item->lruNext = lruHead;
+		if(lruHead) lruHead->lruPrev = item;
+		else lruTail = item;
+		lruHead = item;
+		item->lastUsedFrame = frame;
+	}
+
+	//moves an item to the front of the recently used list
+	void touch(TexCacheItem* item)
+	{
+		item->lastUsedFrame = frame;
+		if(item == lruHead) return;
+
+		item->lruPrev->lruNext = item->lruNext;
+		if(item->lruNext) item->lruNext->lruPrev = item->lruPrev;
+		else lruTail = item->lruPrev;
+
+		item->lruPrev = NULL;
+		item->lruNext = lruHead;
+		lruHead->lruPrev = item;
+		lruHead = item;
+	}
+
+	static u64 hashSource(const MemSpan &ms, const MemSpan &msIndex, const u16* pal, int palSize)
+	{
+		//the palette was already copied out to pal, so hash that copy
+		MemSpan mspal;
+		if(palSize)
+		{
+			mspal.numItems = 1;
+			mspal.size = palSize*2;
+			mspal.items[0].start = 0;
+			mspal.items[0].len = palSize*2;
+			mspal.items[0].ptr = (u8*)pal;
+			mspal.items[0].ofs = 0;
+		}
+		return mspal.hash(msIndex.hash(ms.hash(0)));
+	}
+
+	//remembers where the item's data came from, for revalidate()
+	static void setSource(TexCacheItem* item, u64 hash, const MemSpan &ms, const MemSpan &msIndex, const MemSpan &mspal)
+	{
+		item->source.hash = hash;
+		memset(item->source.vramPages,0,sizeof(item->source.vramPages));
+		ms.markPages(item->source.vramPages);
+		msIndex.markPages(item->source.vramPages);
+		mspal.markPages(item->source.vramPages);
+		item->source.texSlots = ms.slots | msIndex.slots;
+		item->source.palSlots = mspal.slots;
 	}
 
 	template<TexCache_TexFormat TEXFORMAT>
 	TexCacheItem* scan(u32 format, u32 texpal)
 	{
+		if(revalidatePending)
+			revalidate();
+
 		//for each texformat, number of palette entries
 		static const int palSizes[] = {0, 32, 4, 16, 256, 0, 8, 0};
 
@@ -303,6 +505,12 @@ public:
 
 			//TODO - as a special optimization, keep the last item returned and check it first
 
+		//only needed when a suspect item turns up or a new item is made, and then only once
+		u64 hash = 0;
+		bool hashed = false;
+
+		bool stale = false;
+
 		for(std::pair<TTexCacheItemMultimap::iterator,TTexCacheItemMultimap::iterator>
 			iters = index.equal_range(format);
 			iters.first != iters.second;
@@ -325,30 +533,29 @@ public:
 			if(curr->assumedInvalid) goto REJECT; 
 
 			//the texture matches params, but isnt suspected invalid. accept it.
-			if(!curr->suspectedInvalid) return curr;
-
-			//we suspect the texture may be invalid. we need to do a byte-for-byte comparison to re-establish that it is valid:
+			if(!curr->suspectedInvalid)
+			{
+				touch(curr);
+				frameStats.hits++;
+				return curr;
+			}
 
-			//when the palettes dont match:
+			//we suspect the texture may be invalid. we need to compare the data hash to re-establish that it is valid.
 			//note that we are considering 4x4 textures to have a palette size of 0.
 			//they really have a potentially HUGE palette, too big for us to handle like a normal palette,
 			//so they go through a different system
-			if(mspal.size != 0 && memcmp(curr->dump.palette,pal,mspal.size)) goto REJECT;
-
-			//when the texture data doesn't match
-			if(ms.memcmp(&curr->dump.texture[0],curr->dump.textureSize)) goto REJECT;
-
-			//if the texture is 4x4 then the index data must match
-			if(textureMode == TEXMODE_4X4)
+			if(!hashed)
 			{
-				if(msIndex.memcmp(curr->dump.texture + curr->dump.textureSize,curr->dump.indexSize)) goto REJECT; 
+				hash = hashSource(ms,msIndex,pal,palSize);
+				hashed = true;
 			}
+			if(curr->source.hash != hash) goto REJECT;
 
-			//we found a match. just return it
-			//REMINDER to make it primary/newest when we have smarter code
-			//list_remove(curr);
-			//list_push_front(curr);
+			//we found a match. the data may have been found through a different mapping than before, so note where it is now
+			setSource(curr,hash,ms,msIndex,mspal);
 			curr->suspectedInvalid = false;
+			touch(curr);
+			frameStats.hits++;
 			return curr;
 
 		REJECT:
@@ -356,9 +563,12 @@ public:
 			//for a variety of complicated reasons, we need to throw it out right this instant.
 			list_remove(curr);
 			delete curr;
+			stale = true;
 			break;
 		}
 
+		if(!stale) frameStats.misses++;
+
 		//item was not found. recruit an existing one (the oldest), or create a new one
 		//evict(); //reduce the size of the cache if necessary
 		//TODO - as a peculiarity of the texcache, eviction must happen after the entire 3d frame runs
@@ -378,21 +588,15 @@ public:
 		list_push_front(newitem);
 		//printf("allocating: up to %d with %d items\n",cache_size,index.size());
 
+		frameStats.decodes++;
+		frameStats.bytesDecoded += newitem->decode_len;
+
 		u32 *dwdst = (u32*)newitem->decoded;
 		
-		//dump palette data for cache keying
-		if(palSize)
-		{
-			memcpy(newitem->dump.palette, pal, palSize*2);
-		}
-
-		//dump texture and 4x4 index data for cache keying
-		const int texsize = newitem->dump.textureSize = ms.size;
-		const int indexsize = newitem->dump.indexSize = msIndex.size;
-		newitem->dump.texture = new u8[texsize+indexsize];
-		ms.dump(&newitem->dump.texture[0],newitem->dump.maxTextureSize); //dump texture
-		if(textureMode == TEXMODE_4X4)
-			msIndex.dump(newitem->dump.texture+newitem->dump.textureSize,newitem->dump.indexSize); //dump 4x4
+		//hash the texture, 4x4 index and palette data for revalidating the item later
+		if(!hashed)
+			hash = hashSource(ms,msIndex,pal,palSize);
+		setSource(newitem,hash,ms,msIndex,mspal);
 
 
 		//============================================================================ 
@@ -413,89 +617,79 @@ public:
 		{
 		case TEXMODE_A3I5:
 			{
+				u32 colorLUT[32];
+				TexCache_BuildPaletteLUT<TEXFORMAT>(colorLUT,pal,32,0,0);
+				const u32 noAlpha = CONVERT(0,0);
+				u32 alphaLUT[8];
+				for(int i=0;i<8;i++)
+					alphaLUT[i] = (TEXFORMAT == TexFormat_15bpp ? CONVERT(0,material_3bit_to_5bit[i]) : CONVERT(0,material_3bit_to_8bit[i])) ^ noAlpha;
+
+				#ifdef X432R_OPENGL_CUSTOMSTENCILTEST2
+				u32 alphasSeen = 0;
+				#endif
+
 				for(int j=0;j<ms.numItems;j++) {
 					adr = ms.items[j].ptr;
 					for(u32 x = 0; x < ms.items[j].len; x++)
 					{
-						u16 c = pal[*adr&31];
-						u8 alpha = *adr>>5;
-						if(TEXFORMAT == TexFormat_15bpp)
-							*dwdst++ = RGB15TO6665(c,material_3bit_to_5bit[alpha]);
-						else
-							*dwdst++ = RGB15TO32(c,material_3bit_to_8bit[alpha]);
-						
+						const u8 texel = *adr++;
+						*dwdst++ = colorLUT[texel&31] | alphaLUT[texel>>5];
+
 						#ifdef X432R_OPENGL_CUSTOMSTENCILTEST2
-						if( (alpha > 0) && (alpha < 7) && !newitem->IsTranslucent )
-							newitem->IsTranslucent = true;		// alphaԊK̏ꍇɔtOZbg
+						alphasSeen |= 1<<(texel>>5);
 						#endif
-						
-						adr++;
 					}
 				}
+
+				#ifdef X432R_OPENGL_CUSTOMSTENCILTEST2
+				if(alphasSeen & 0x7E)
+					newitem->IsTranslucent = true;		// alphaԊK̏ꍇɔtOZbg
+				#endif
 				break;
 			}
 
 		case TEXMODE_I2:
 			{
+				u32 colorLUT[4];
+				TexCache_BuildPaletteLUT<TEXFORMAT>(colorLUT,pal,4,palZeroTransparent,opaqueColor);
 				for(int j=0;j<ms.numItems;j++) {
 					adr = ms.items[j].ptr;
 					for(u32 x = 0; x < ms.items[j].len; x++)
 					{
-						u8 bits;
-						u16 c;
-
-						bits = (*adr)&0x3;
-						c = pal[bits];
-						*dwdst++ = CONVERT(c,(bits == 0) ? palZeroTransparent : opaqueColor);
-
-						bits = ((*adr)>>2)&0x3;
-						c = pal[bits];
-						*dwdst++ = CONVERT(c,(bits == 0) ? palZeroTransparent : opaqueColor);
-
-						bits = ((*adr)>>4)&0x3;
-						c = pal[bits];
-						*dwdst++ = CONVERT(c,(bits == 0) ? palZeroTransparent : opaqueColor);
-
-						bits = ((*adr)>>6)&0x3;
-						c = pal[bits];
-						*dwdst++ = CONVERT(c,(bits == 0) ? palZeroTransparent : opaqueColor);
-
-						adr++;
+						const u8 texels = *adr++;
+						dwdst[0] = colorLUT[texels&3];
+						dwdst[1] = colorLUT[(texels>>2)&3];
+						dwdst[2] = colorLUT[(texels>>4)&3];
+						dwdst[3] = colorLUT[texels>>6];
+						dwdst += 4;
 					}
 				}
 				break;
 			}
 		case TEXMODE_I4:
 			{
+				u32 colorLUT[16];
+				TexCache_BuildPaletteLUT<TEXFORMAT>(colorLUT,pal,16,palZeroTransparent,opaqueColor);
 				for(int j=0;j<ms.numItems;j++) {
 					adr = ms.items[j].ptr;
 					for(u32 x = 0; x < ms.items[j].len; x++)
 					{
-						u8 bits;
-						u16 c;
-
-						bits = (*adr)&0xF;
-						c = pal[bits];
-						*dwdst++ = CONVERT(c,(bits == 0) ? palZeroTransparent : opaqueColor);
-
-						bits = ((*adr)>>4);
-						c = pal[bits];
-						*dwdst++ = CONVERT(c,(bits == 0) ? palZeroTransparent : opaqueColor);
-						adr++;
+						const u8 texels = *adr++;
+						dwdst[0] = colorLUT[texels&0xF];
+						dwdst[1] = colorLUT[texels>>4];
+						dwdst += 2;
 					}
 				}
 				break;
 			}
 		case TEXMODE_I8:
 			{
+				u32 colorLUT[256];
+				TexCache_BuildPaletteLUT<TEXFORMAT>(colorLUT,pal,256,palZeroTransparent,opaqueColor);
 				for(int j=0;j<ms.numItems;j++) {
 					adr = ms.items[j].ptr;
 					for(u32 x = 0; x < ms.items[j].len; ++x)
-					{
-						u16 c = pal[*adr];
-						*dwdst++ = CONVERT(c,(*adr == 0) ? palZeroTransparent : opaqueColor);
-						adr++;
-					}
+						*dwdst++ = colorLUT[*adr++];
 				}
 			}
 			break;
@@ -601,6 +795,13 @@ public:
 
 						if(TEXFORMAT==TexFormat_15bpp)
 						{
+#if defined(ENABLE_SSE2) && !defined(WORDS_BIGENDIAN)
+							__m128i cols = _mm_srli_epi32(_mm_loadu_si128((__m128i*)tmp_col),2);
+							cols = _mm_and_si128(cols,_mm_set1_epi32(0x3F3F3F3F));
+							const __m128i a = _mm_slli_epi32(_mm_srli_epi32(cols,25),24);
+							cols = _mm_or_si128(_mm_and_si128(cols,_mm_set1_epi32(0x00FFFFFF)),a);
+							_mm_storeu_si128((__m128i*)tmp_col,cols);
+#else
 							for(int i=0;i<4;i++)
 							{
 								tmp_col[i] >>= 2;
@@ -609,6 +810,7 @@ public:
 								tmp_col[i] &= 0x00FFFFFF;
 								tmp_col[i] |= (a>>1)<<24;
 							}
+#endif
 						}
 
 						//TODO - this could be more precise for 32bpp mode (run it through the color separation table)
@@ -635,25 +837,34 @@ public:
 			}
 		case TEXMODE_A5I3:
 			{
+				u32 colorLUT[8];
+				TexCache_BuildPaletteLUT<TEXFORMAT>(colorLUT,pal,8,0,0);
+				const u32 noAlpha = CONVERT(0,0);
+				u32 alphaLUT[32];
+				for(int i=0;i<32;i++)
+					alphaLUT[i] = (TEXFORMAT == TexFormat_15bpp ? CONVERT(0,i) : CONVERT(0,material_5bit_to_8bit[i])) ^ noAlpha;
+
+				#ifdef X432R_OPENGL_CUSTOMSTENCILTEST2
+				u32 alphasSeen = 0;
+				#endif
+
 				for(int j=0;j<ms.numItems;j++) {
 					adr = ms.items[j].ptr;
 					for(u32 x = 0; x < ms.items[j].len; ++x)
 					{
-						u16 c = pal[*adr&0x07];
-						u8 alpha = (*adr>>3);
-						if(TEXFORMAT == TexFormat_15bpp)
-							*dwdst++ = RGB15TO6665(c,alpha);
-						else
-							*dwdst++ = RGB15TO32(c,material_5bit_to_8bit[alpha]);
-						
+						const u8 texel = *adr++;
+						*dwdst++ = colorLUT[texel&0x07] | alphaLUT[texel>>3];
+
 						#ifdef X432R_OPENGL_CUSTOMSTENCILTEST2
-						if( (alpha > 0) && (alpha < 31) && !newitem->IsTranslucent )
-							newitem->IsTranslucent = true;		// alphaԊK̏ꍇɔtOZbg
+						alphasSeen |= 1<<(texel>>3);
 						#endif
-						
-						adr++;
 					}
 				}
+
+				#ifdef X432R_OPENGL_CUSTOMSTENCILTEST2
+				if(alphasSeen & 0x7FFFFFFE)
+					newitem->IsTranslucent = true;		// alphaԊK̏ꍇɔtOZbg
+				#endif
 				break;
 			}
 		case TEXMODE_16BPP:
@@ -666,16 +877,8 @@ public:
 				}
 				#endif
 				
-				for(int j=0;j<ms.numItems;j++) {
-					u16* map = (u16*)ms.items[j].ptr;
-					int len = ms.items[j].len>>1;
-					for(int x = 0; x < len; ++x)
-					{
-						u16 c = map[x];
-						int alpha = ((c&0x8000)?opaqueColor:0);
-						*dwdst++ = CONVERT(c&0x7FFF,alpha);
-					}
-				}
+				for(int j=0;j<ms.numItems;j++)
+					dwdst = TexCache_Decode16bpp<TEXFORMAT>(dwdst,(u16*)ms.items[j].ptr,ms.items[j].len>>1);
 				break;
 			}
 		} //switch(texture format)
@@ -690,60 +893,141 @@ public:
 	static const int PALETTE_DUMP_SIZE = (64+16+16)*1024;
 	u8 paletteDump[PALETTE_DUMP_SIZE];
 
+	//the texture mapping the cached items were last checked against
+	MMU_struct::TextureInfo validTexInfo;
+	bool revalidatePending;
+
 	void invalidate()
 	{
-		//check whether the palette memory changed
-		//TODO - we should handle this instead by setting dirty flags in the vram memory mapping and noting whether palette memory was dirty.
-		//but this will work for now
+		//games usually unmap texture banks, write them and map them back several times per frame,
+		//so just note it here and sort it out once, when the next texture is looked up
+		revalidatePending = true;
+	}
+
+	//finds the items whose vram was written or remapped since they were last checked and marks them suspected invalid
+	void revalidate()
+	{
+		revalidatePending = false;
+
+		u32 dirtyPages[TexCacheItem::Source::kPageWords];
+		memset(dirtyPages,0,sizeof(dirtyPages));
+		bool anyDirty = false;
+		for(int i=0;i<VRAM_DIRTY_PAGES;i++)
+		{
+			if(!vram_dirty[i]) continue;
+			dirtyPages[i>>5] |= 1<<(i&31);
+			anyDirty = true;
+		}
+		memset(vram_dirty,0,sizeof(vram_dirty));
+
+		u8 texSlotsChanged = 0, palSlotsChanged = 0;
+		for(int i=0;i<4;i++)
+			if(MMU.texInfo.textureSlotAddr[i] != validTexInfo.textureSlotAddr[i]) texSlotsChanged |= 1<<i;
+		for(int i=0;i<6;i++)
+			if(MMU.texInfo.texPalSlot[i] != validTexInfo.texPalSlot[i]) palSlotsChanged |= 1<<i;
+		validTexInfo = MMU.texInfo;
+
+		if(!anyDirty && !texSlotsChanged && !palSlotsChanged) return;
+
+		//check whether the palette memory changed. this is only worth doing when it was written or remapped
 		MemSpan mspal = MemSpan_TexPalette(0,PALETTE_DUMP_SIZE,true);
-		bool paletteDirty = mspal.memcmp(paletteDump);
-		if(paletteDirty)
+		u32 palettePages[TexCacheItem::Source::kPageWords];
+		memset(palettePages,0,sizeof(palettePages));
+		mspal.markPages(palettePages);
+		bool paletteDirty = false;
+		if(palSlotsChanged || pagesOverlap(palettePages,dirtyPages))
 		{
-			mspal.dump(paletteDump);
+			paletteDirty = mspal.memcmp(paletteDump) != 0;
+			if(paletteDirty)
+			{
+				mspal.dump(paletteDump);
+			}
 		}
 
 		for(TTexCacheItemMultimap::iterator it(index.begin()); it != index.end(); ++it)
 		{
-			it->second->suspectedInvalid = true;
+			TexCacheItem* item = it->second;
+
+			if((item->source.texSlots & texSlotsChanged) || (item->source.palSlots & palSlotsChanged) || pagesOverlap(item->source.vramPages,dirtyPages))
+				item->suspectedInvalid = true;
 			
 			//when the palette changes, we assume all 4x4 textures are dirty.
 			//this is because each 4x4 item doesnt carry along with it a copy of the entire palette, for verification
 			//instead, we just use the one paletteDump for verifying of all 4x4 textures; and if paletteDirty is set, verification has failed
-			if(it->second->getTextureMode() == TEXMODE_4X4 && paletteDirty)
+			if(item->getTextureMode() == TEXMODE_4X4 && paletteDirty)
 			{
-				it->second->assumedInvalid = true;
+				item->assumedInvalid = true;
 			}
 		}
 	}
 
-	void evict(u32 target = kMaxCacheSize)
+	static bool pagesOverlap(const u32* a, const u32* b)
+	{
+		u32 overlap = 0;
+		for(int i=0;i<TexCacheItem::Source::kPageWords;i++)
+			overlap |= a[i] & b[i];
+		return overlap != 0;
+	}
+
+	void evict()
 	{
 		//debug print
-		//printf("%d %d/%d\n",index.size(),cache_size/1024,target/1024);
+		//printf("%d %d/%d\n",index.size(),cache_size/1024,budget/1024);
 
-		//dont do anything unless we're over the target
-		if(cache_size<target) return;
+		//dont do anything unless we're over the budget
+		if(cache_size<=budget) return;
 
-		//aim at cutting the cache to half of the max size
-		target/=2;
+		//trim a quarter below the budget so that a cache hovering around it doesnt evict a little every frame
+		const u32 target = budget - budget/4;
 
-		//evicts items in an arbitrary order until it is less than the max cache size
-		//TODO - do this based on age and not arbitrarily
-		while(cache_size > target)
+		//evicts the least recently used items until it is below the target.
+		//textures used in the frame just rendered are kept even if that leaves the cache over its budget,
+		//since throwing them out would only mean decoding them all again in the next frame
+		while(cache_size > target && lruTail && lruTail->lastUsedFrame != frame)
 		{
-			if(index.size()==0) break; //just in case.. doesnt seem possible, cache_size wouldve been 0
-
-			TexCacheItem* item = index.begin()->second;
+			TexCacheItem* item = lruTail;
 			list_remove(item);
 			//printf("evicting! totalsize:%d\n",cache_size);
 			delete item;
+			frameStats.evictions++;
+		}
+	}
+
+	void clear()
+	{
+		while(lruTail)
+		{
+			TexCacheItem* item = lruTail;
+			list_remove(item);
+			delete item;
 		}
 	}
+
+	void endFrame()
+	{
+		evict();
+
+		frameStats.items = (u32)index.size();
+		frameStats.bytes = cache_size;
+		lastFrameStats = frameStats;
+
+		totalStats.hits += frameStats.hits;
+		totalStats.misses += frameStats.misses;
+		totalStats.decodes += frameStats.decodes;
+		totalStats.bytesDecoded += frameStats.bytesDecoded;
+		totalStats.evictions += frameStats.evictions;
+		totalStats.items = frameStats.items;
+		totalStats.bytes = frameStats.bytes;
+
+		memset(&frameStats,0,sizeof(frameStats));
+		frame++;
+	}
 } texCache;
 
 void TexCache_Reset()
 {
-	texCache.evict(0);
+	texCache.clear();
+	texCache.invalidate();
 }
 
 void TexCache_Invalidate()
@@ -765,5 +1049,31 @@ TexCacheItem* TexCache_SetTexture(TexCache_TexFormat TEXFORMAT, u32 format, u32
 //call this periodically to keep the tex cache clean
 void TexCache_EvictFrame()
 {
-	texCache.evict();
+	texCache.endFrame();
+}
+
+void TexCache_SetBudget(u32 bytes)
+{
+	texCache.budget = bytes;
+}
+
+u32 TexCache_GetBudget()
+{
+	return texCache.budget;
+}
+
+TexCacheStats TexCache_GetFrameStats()
+{
+	return texCache.lastFrameStats;
+}
+
+TexCacheStats TexCache_GetTotalStats()
+{
+	return texCache.totalStats;
+}
+
+void TexCache_ResetStats()
+{
+	memset(&texCache.lastFrameStats,0,sizeof(texCache.lastFrameStats));
+	memset(&texCache.totalStats,0,sizeof(texCache.totalStats));
 }
@@ -26,7 +26,9 @@
 
 
 //---CUSTOM--->
+#ifdef HOST_WINDOWS
 #include "X432R_BuildSwitch.h"
+#endif
 //<---CUSTOM---
 
 
@@ -47,6 +49,9 @@ public:
 	TexCacheItem() 
 		: decode_len(0)
 		, decoded(NULL)
+		, lruPrev(NULL)
+		, lruNext(NULL)
+		, lastUsedFrame(0)
 		, suspectedInvalid(false)
 		, assumedInvalid(false)
 		, deleteCallback(NULL)
@@ -65,6 +70,8 @@ public:
 	u32 decode_len;
 	u32 mode;
 	u8* decoded; //decoded texture data
+	TexCacheItem *lruPrev, *lruNext; //neighbours in the cache's recently used list, newest first
+	u32 lastUsedFrame;
 	bool suspectedInvalid;
 	bool assumedInvalid;
 	TTexCacheItemMultimap::iterator iterator;
@@ -80,15 +87,13 @@ public:
 
 	TexCache_TexFormat cacheFormat;
 
-	struct Dump {
-		~Dump() {
-			delete[] texture;
-		}
-		int textureSize, indexSize;
-		static const int maxTextureSize=128*1024;
-		u8* texture;
-		u8 palette[256*2];
-	} dump;
+	//where the texture was decoded from, so that it can be checked again after vram gets written or remapped
+	struct Source {
+		static const int kPageWords = 6; //enough bits for every vram_dirty page
+		u64 hash; //of the texture, 4x4 index and palette data
+		u32 vramPages[kPageWords]; //vram_dirty pages the data was read from
+		u8 texSlots, palSlots; //texture and palette slots the data was read through
+	} source;
 	
 	#ifdef X432R_OPENGL_CUSTOMSTENCILTEST2
 	bool IsTranslucent;
@@ -98,10 +103,29 @@ public:
 	#endif
 };
 
+struct TexCacheStats
+{
+	u32 hits; //lookups answered from the cache
+	u32 misses; //lookups for textures that werent cached at all
+	u32 decodes; //misses plus cached textures which were found stale
+	u64 bytesDecoded;
+	u32 evictions;
+	u32 items, bytes; //what the cache holds (at the end of the frame, for per-frame stats)
+};
+
 void TexCache_Invalidate();
 void TexCache_Reset();
 void TexCache_EvictFrame();
 
+//the decoded size the cache may grow to before the least recently used textures get evicted. 16MB by default
+void TexCache_SetBudget(u32 bytes);
+u32 TexCache_GetBudget();
+
+//counters for the last completed frame (ended by TexCache_EvictFrame) and since the last TexCache_ResetStats
+TexCacheStats TexCache_GetFrameStats();
+TexCacheStats TexCache_GetTotalStats();
+void TexCache_ResetStats();
+
 TexCacheItem* TexCache_SetTexture(TexCache_TexFormat TEXFORMAT, u32 format, u32 texpal);
 
 #endif
@@ -0,0 +1,391 @@
+/*
+	Copyright (C) 2015 DeSmuME team
+
+	This file is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This file is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with the this software.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "types.h"
+#include "jobpool.h"
+#include "task.h"
+
+#include <assert.h>
+#include <deque>
+#include <vector>
+
+#ifdef HOST_WINDOWS
+#include <windows.h>
+typedef CRITICAL_SECTION PoolLock;
+typedef CONDITION_VARIABLE PoolCond;
+typedef HANDLE PoolThread;
+
+static void lockInit(PoolLock *lock) { InitializeCriticalSection(lock); }
+static void lockDestroy(PoolLock *lock) { DeleteCriticalSection(lock); }
+static void lockLock(PoolLock *lock) { EnterCriticalSection(lock); }
+static void lockUnlock(PoolLock *lock) { LeaveCriticalSection(lock); }
+static void condInit(PoolCond *cond) { InitializeConditionVariable(cond); }
+static void condDestroy(PoolCond *cond) { }
+static void condWait(PoolCond *cond, PoolLock *lock) { SleepConditionVariableCS(cond, lock, INFINITE); }
+static void condBroadcast(PoolCond *cond) { WakeAllConditionVariable(cond); }
+static void yieldThread() { Sleep(0); }
+static long atomicCompareExchange(volatile long *val, long exchange, long comparand) { return InterlockedCompareExchange(val, exchange, comparand); }
+static long atomicLoadAcquire(volatile long *val) { return InterlockedCompareExchange(val, 0, 0); }
+static void atomicStoreRelease(volatile long *val, long value) { InterlockedExchange(val, value); }
+#else
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+typedef pthread_mutex_t PoolLock;
+typedef pthread_cond_t PoolCond;
+typedef pthread_t PoolThread;
+
+static void lockInit(PoolLock *lock) { pthread_mutex_init(lock, NULL); }
+static void lockDestroy(PoolLock *lock) { pthread_mutex_destroy(lock); }
+static void lockLock(PoolLock *lock) { pthread_mutex_lock(lock); }
+static void lockUnlock(PoolLock *lock) { pthread_mutex_unlock(lock); }
+static void condInit(PoolCond *cond) { pthread_cond_init(cond, NULL); }
+static void condDestroy(PoolCond *cond) { pthread_cond_destroy(cond); }
+static void condWait(PoolCond *cond, PoolLock *lock) { pthread_cond_wait(cond, lock); }
+static void condBroadcast(PoolCond *cond) { pthread_cond_broadcast(cond); }
+static void yieldThread() { sched_yield(); }
+static long atomicCompareExchange(volatile long *val, long exchange, long comparand) { return __sync_val_compare_and_swap(val, comparand, exchange); }
+static long atomicLoadAcquire(volatile long *val) { return __atomic_load_n(val, __ATOMIC_ACQUIRE); }
+static void atomicStoreRelease(volatile long *val, long value) { __atomic_store_n(val, value, __ATOMIC_RELEASE); }
+#endif
+
+struct Job
+{
+	TJobWork work;
+	void *param;
+	JobGroup *group;
+};
+
+struct JobQueue
+{
+	PoolLock lock;
+	std::deque<Job> jobs;
+};
+
+static struct JobPool
+{
+	JobPool()
+		: configuredCount(0)
+		, onlineCores(0)
+		, started(0)
+		, exiting(false)
+		, queued(0)
+		, active(0)
+		, nextQueue(0)
+		, startLock(0)
+	{}
+
+	int configuredCount;
+	//detected once; the count is asked for every scanline through CommonSettings.single_core()
+	int onlineCores;
+	//set with release semantics once the queues and threads below are complete, so run() may test it without the start lock
+	volatile long started;
+	volatile bool exiting;
+
+	std::vector<JobQueue*> queues;
+	std::vector<PoolThread> threads;
+
+	//idle workers and waiting owners sleep on this; it is signalled whenever work is queued or a group finishes
+	PoolLock sleepLock;
+	PoolCond sleepCond;
+
+	//jobs sitting in any queue
+	volatile long queued;
+	//jobs queued and not yet finished, whoever runs them. shutting down waits for this to drop to 0
+	volatile long active;
+	volatile long nextQueue;
+
+	//guards starting and stopping, which may be raced by the emulator and a frontend thread
+	volatile long startLock;
+} pool;
+
+static void acquireStartLock()
+{
+	while(atomicCompareExchange(&pool.startLock, 1, 0) != 0)
+		yieldThread();
+}
+
+static void releaseStartLock()
+{
+	atomicCompareExchange(&pool.startLock, 0, 1);
+}
+
+int JobPool_GetWorkerCount()
+{
+	if(pool.configuredCount > 0)
+		return pool.configuredCount;
+
+	//racing callers all store the same value
+	if(pool.onlineCores == 0)
+	{
+		const int cores = getOnlineCores();
+		pool.onlineCores = (cores < 1) ? 1 : cores;
+	}
+
+	return pool.onlineCores;
+}
+
+//takes a job from the front of queue 'preferred' or, failing that, steals one from the back of another queue.
+//with 'only' set, just that group's jobs are considered
+static bool takeJob(int preferred, JobGroup *only, Job &job)
+{
+	const int count = (int)pool.queues.size();
+	if(count == 0 || pool.queued == 0) return false;
+
+	if(preferred < 0) preferred = 0;
+
+	for(int n=0;n<count;n++)
+	{
+		const int index = (preferred + n) % count;
+		const bool own = (n == 0);
+		JobQueue *queue = pool.queues[index];
+
+		lockLock(&queue->lock);
+		bool found = false;
+		if(only == NULL)
+		{
+			if(!queue->jobs.empty())
+			{
+				if(own) { job = queue->jobs.front(); queue->jobs.pop_front(); }
+				else { job = queue->jobs.back(); queue->jobs.pop_back(); }
+				found = true;
+			}
+		}
+		else
+		{
+			for(std::deque<Job>::iterator it = queue->jobs.begin(); it != queue->jobs.end(); ++it)
+			{
+				if(it->group != only) continue;
+				job = *it;
+				queue->jobs.erase(it);
+				found = true;
+				break;
+			}
+		}
+		lockUnlock(&queue->lock);
+
+		if(found)
+		{
+			JobPool_AtomicAdd(&pool.queued, -1);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void runJob(const Job &job)
+{
+	void *result = job.work(job.param);
+	job.group->result = result;
+
+	const bool groupDone = (JobPool_AtomicAdd(&job.group->pending, -1) == 0);
+	const bool poolIdle = (JobPool_AtomicAdd(&pool.active, -1) == 0);
+	if(groupDone || poolIdle)
+	{
+		lockLock(&pool.sleepLock);
+		condBroadcast(&pool.sleepCond);
+		lockUnlock(&pool.sleepLock);
+	}
+}
+
+static void workerProc(int index)
+{
+	for(;;)
+	{
+		Job job;
+		if(takeJob(index, NULL, job))
+		{
+			runJob(job);
+			continue;
+		}
+
+		lockLock(&pool.sleepLock);
+		while(pool.queued == 0 && !pool.exiting)
+			condWait(&pool.sleepCond, &pool.sleepLock);
+		const bool exit = pool.exiting && pool.queued == 0;
+		lockUnlock(&pool.sleepLock);
+
+		if(exit) break;
+	}
+}
+
+#ifdef HOST_WINDOWS
+static DWORD __stdcall s_workerProc(void *arg)
+{
+	workerProc((int)(intptr_t)arg);
+	return 0;
+}
+#else
+static void* s_workerProc(void *arg)
+{
+	workerProc((int)(intptr_t)arg);
+	return NULL;
+}
+#endif
+
+static void startPool()
+{
+	acquireStartLock();
+
+	if(!pool.started)
+	{
+		const int count = JobPool_GetWorkerCount();
+
+		lockInit(&pool.sleepLock);
+		condInit(&pool.sleepCond);
+		pool.exiting = false;
+		pool.queued = 0;
+		pool.active = 0;
+		pool.nextQueue = 0;
+
+		for(int i=0;i<count;i++)
+		{
+			JobQueue *queue = new JobQueue();
+			lockInit(&queue->lock);
+			pool.queues.push_back(queue);
+		}
+
+		for(int i=0;i<count;i++)
+		{
+#ifdef HOST_WINDOWS
+			PoolThread thread = CreateThread(NULL, 0, s_workerProc, (void*)(intptr_t)i, 0, NULL);
+#else
+			PoolThread thread;
+			pthread_create(&thread, NULL, &s_workerProc, (void*)(intptr_t)i);
+#endif
+			pool.threads.push_back(thread);
+		}
+
+		atomicStoreRelease(&pool.started, 1);
+	}
+
+	releaseStartLock();
+}
+
+void JobPool_Shutdown()
+{
+	acquireStartLock();
+
+	if(pool.started)
+	{
+		//let every job still in flight finish first; its owner may be about to wait() on it
+		lockLock(&pool.sleepLock);
+		while(pool.active != 0)
+			condWait(&pool.sleepCond, &pool.sleepLock);
+		pool.exiting = true;
+		condBroadcast(&pool.sleepCond);
+		lockUnlock(&pool.sleepLock);
+
+		for(size_t i=0;i<pool.threads.size();i++)
+		{
+#ifdef HOST_WINDOWS
+			WaitForSingleObject(pool.threads[i], INFINITE);
+			CloseHandle(pool.threads[i]);
+#else
+			pthread_join(pool.threads[i], NULL);
+#endif
+		}
+		pool.threads.clear();
+
+		for(size_t i=0;i<pool.queues.size();i++)
+		{
+			lockDestroy(&pool.queues[i]->lock);
+			delete pool.queues[i];
+		}
+		pool.queues.clear();
+
+		condDestroy(&pool.sleepCond);
+		lockDestroy(&pool.sleepLock);
+
+		pool.started = 0;
+	}
+
+	releaseStartLock();
+}
+
+void JobPool_SetWorkerCount(int count)
+{
+	if(count < 0) count = 0;
+	if(count == pool.configuredCount) return;
+
+	JobPool_Shutdown();
+	pool.configuredCount = count;
+}
+
+JobGroup::JobGroup()
+	: pending(0)
+	, result(NULL)
+{
+}
+
+JobGroup::~JobGroup()
+{
+	wait();
+}
+
+void JobGroup::run(TJobWork work, void *param, int affinity)
+{
+	if(!atomicLoadAcquire(&pool.started))
+		startPool();
+
+	//the pool is being torn down underneath us: JobPool_SetWorkerCount() or JobPool_Shutdown() was called while work was still being queued
+	assert(!pool.exiting);
+
+	Job job;
+	job.work = work;
+	job.param = param;
+	job.group = this;
+
+	JobPool_AtomicAdd(&pending, 1);
+	JobPool_AtomicAdd(&pool.active, 1);
+
+	const long count = (long)pool.queues.size();
+	const long index = (affinity >= 0) ? (affinity % count) : ((JobPool_AtomicAdd(&pool.nextQueue, 1) & 0x7FFFFFFF) % count);
+	JobQueue *queue = pool.queues[index];
+
+	lockLock(&queue->lock);
+	queue->jobs.push_back(job);
+	lockUnlock(&queue->lock);
+
+	JobPool_AtomicAdd(&pool.queued, 1);
+
+	lockLock(&pool.sleepLock);
+	condBroadcast(&pool.sleepCond);
+	lockUnlock(&pool.sleepLock);
+}
+
+void* JobGroup::wait()
+{
+	while(pending != 0)
+	{
+		Job job;
+		if(takeJob(0, this, job))
+		{
+			runJob(job);
+			continue;
+		}
+
+		//everything left is already running on a worker
+		lockLock(&pool.sleepLock);
+		while(pending != 0)
+			condWait(&pool.sleepCond, &pool.sleepLock);
+		lockUnlock(&pool.sleepLock);
+	}
+
+	return result;
+}
@@ -0,0 +1,76 @@
+/*
+	Copyright (C) 2015 DeSmuME team
+
+	This file is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This file is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with the this software.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _JOBPOOL_H_
+#define _JOBPOOL_H_
+
+#include "types.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+//One set of worker threads for the whole process, shared by everything that wants to run work in parallel
+//(the rasterizer, the video filters, the 2d line worker, Task) so that neither the subsystems nor several
+//emulator instances in one process each bring up their own threads.
+//Every worker has its own queue; a worker which runs dry steals from the back of the others.
+
+typedef void* (*TJobWork)(void *);
+
+//Tracks a batch of jobs so the owner can wait for all of them.
+//A group holding a single job doubles as a future: wait() hands back what the job returned.
+class JobGroup
+{
+public:
+	JobGroup();
+	~JobGroup();
+
+	//queue work on the pool. jobs given the same affinity (>= 0) go to the same worker's queue,
+	//which keeps their data in one cache when the same job comes back every frame
+	void run(TJobWork work, void *param, int affinity = -1);
+
+	//block until every job queued through this group is finished; meanwhile the caller runs this group's queued jobs itself.
+	//returns what the job returned when the group held just one
+	void* wait();
+
+	bool done() const { return pending == 0; }
+
+	volatile long pending;
+	void *result;
+};
+
+//the number of pool threads. 0 picks one per online core, which is also the default.
+//the pool comes back up at the new size the next time work is queued.
+//call this (and JobPool_Shutdown) only from the emulation thread, or with emulation paused: jobs already queued are
+//finished first, but nothing may queue or wait on work while the threads and queues are torn down
+void JobPool_SetWorkerCount(int count);
+int JobPool_GetWorkerCount();
+
+//stops the threads once every queued job has finished
+void JobPool_Shutdown();
+
+//returns the new value
+FORCEINLINE long JobPool_AtomicAdd(volatile long *val, long delta)
+{
+#ifdef _MSC_VER
+	return _InterlockedExchangeAdd(val, delta) + delta;
+#else
+	return __sync_add_and_fetch(val, delta);
+#endif
+}
+
+#endif
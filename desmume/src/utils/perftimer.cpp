@@ -0,0 +1,80 @@
+/*
+	Copyright (C) 2015 DeSmuME team
+
+	This file is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This file is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with the this software.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "perftimer.h"
+
+#ifdef HOST_WINDOWS
+#include <windows.h>
+#elif defined HOST_DARWIN
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#include <sys/time.h>
+#endif
+
+#ifdef HOST_WINDOWS
+
+u64 getPerfTicks(void)
+{
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return (u64)now.QuadPart;
+}
+
+u64 getPerfTicksPerSecond(void)
+{
+	LARGE_INTEGER freq;
+	QueryPerformanceFrequency(&freq);
+	return (u64)freq.QuadPart;
+}
+
+#elif defined HOST_DARWIN
+
+u64 getPerfTicks(void)
+{
+	static mach_timebase_info_data_t timebase = {0,0};
+	if(timebase.denom == 0)
+		mach_timebase_info(&timebase);
+	return mach_absolute_time() * timebase.numer / timebase.denom;
+}
+
+u64 getPerfTicksPerSecond(void)
+{
+	return 1000000000ULL;
+}
+
+#else
+
+u64 getPerfTicks(void)
+{
+#if defined(CLOCK_MONOTONIC)
+	struct timespec now;
+	if(clock_gettime(CLOCK_MONOTONIC, &now) == 0)
+		return (u64)now.tv_sec * 1000000000ULL + (u64)now.tv_nsec;
+#endif
+	//fall back to wall clock time; this can jump, but it is better than nothing
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (u64)tv.tv_sec * 1000000000ULL + (u64)tv.tv_usec * 1000ULL;
+}
+
+u64 getPerfTicksPerSecond(void)
+{
+	return 1000000000ULL;
+}
+
+#endif
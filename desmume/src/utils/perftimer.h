@@ -0,0 +1,28 @@
+/*
+	Copyright (C) 2015 DeSmuME team
+
+	This file is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This file is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with the this software.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _PERFTIMER_H_
+#define _PERFTIMER_H_
+
+#include "../types.h"
+
+//a monotonic high resolution host clock, for measuring how long the emulator spends doing things.
+//this has nothing to do with emulated time; don't use it for anything that affects emulation.
+u64 getPerfTicks(void);
+u64 getPerfTicksPerSecond(void);
+
+#endif
@@ -18,7 +18,7 @@
 #ifndef _TASK_H_
 #define _TASK_H_
 
-//Sort of like a single-thread thread pool.
+//Runs one piece of work at a time on the shared JobPool (see jobpool.h).
 //You hand it a worker function and then call finish() to synch with its completion
 class Task
 {
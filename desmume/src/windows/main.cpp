@@ -65,6 +65,7 @@
 #include "../lua-engine.h"
 #include "../path.h"
 #include "../utils/advanscene.h"
+#include "../utils/jobpool.h"
 
 //other random stuff
 #include "recentroms.h"
@@ -4980,9 +4981,9 @@ int _main()
 	GetSystemInfo(&systemInfo);
 	
 	#ifndef X432R_SINGLECORE_TEST
-	CommonSettings.num_cores = systemInfo.dwNumberOfProcessors;
+	JobPool_SetWorkerCount(systemInfo.dwNumberOfProcessors);
 	#else
-	CommonSettings.num_cores = 1;
+	JobPool_SetWorkerCount(1);
 	#endif
 
 	msgbox = &msgBoxWnd;
@@ -5081,6 +5082,7 @@ int _main()
 	CommonSettings.showGpu.sub = GetPrivateProfileInt("Display", "SubGpu", 1, IniName) != 0;
 	CommonSettings.spu_advanced = GetPrivateProfileBool("Sound", "SpuAdvanced", false, IniName);
 	CommonSettings.advanced_timing = GetPrivateProfileBool("Emulation", "AdvancedTiming", true, IniName);
+	CommonSettings.async_2d = GetPrivateProfileBool("Emulation", "Async2D", false, IniName);
 	CommonSettings.StylusJitter = GetPrivateProfileBool("Emulation", "StylusJitter", false, IniName);
 
 	CommonSettings.GFX3D_Zelda_Shadow_Depth_Hack = GetPrivateProfileInt("3D", "ZeldaShadowDepthHack", 0, IniName);